@@ -1,9 +1,10 @@
 #include "mainwindow.h"
+#include "scrollbackview.h"
 
 #include <QDate>
 #include <QDir>
 #include <QLabel>
-#include <QPlainTextEdit>
+#include <QLineEdit>
 #include <QStandardPaths>
 #include <QTimer>
 #include <QVBoxLayout>
@@ -13,28 +14,85 @@
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent),
-      m_textEdit(new QPlainTextEdit(this)),
+      m_view(nullptr),
+      m_search(new QLineEdit(this)),
       m_totalLabel(new QLabel(this)),
       m_dayLabel(new QLabel(this)),
       m_statusLabel(new QLabel(this)),
+      m_timingLabel(new QLabel(this)),
+      m_latencyLabel(new QLabel(this)),
       m_timer(new QTimer(this)),
+      m_frameTimer(new QTimer(this)),
+      m_drainTimer(new QTimer(this)),
+      m_scrollback{},
+      m_textDirty(false),
+      m_countersDirty(false),
       m_fd(-1),
+      m_useRing(false),
+      m_forceRecords(false),
+      m_ring{},
+      m_format(KBD_FORMAT_RAW),
+      m_reader{},
+      m_readerRunning(false),
+      m_lastLatencyNs(0),
+      m_timing{},
+      m_latency{},
+      m_latencyDirty(false),
       m_stats{},
-      m_statsReady(false) {
+      m_statsReady(false),
+      m_layout(SCANCODE_LAYOUT_US),
+      m_backend(KBD_READER_BACKEND_AUTO) {
   setWindowTitle("Kbd Sim Monitor");
-  scancode_state_init(&m_scancodeState);
+  kbd_timing_init(&m_timing, KBD_TIMING_DEFAULT_WINDOW_NS, KBD_TIMING_DEFAULT_IDLE_NS);
+  kbd_latency_init(&m_latency);
+  m_latencyPath = qEnvironmentVariable("KBD_LATENCY");
 
-  m_textEdit->setReadOnly(true);
+  // KBD_SCROLLBACK is the history size in bytes; both it and the line
+  // count are hard caps, with the oldest text evicted first.
+  bool sizeOk = false;
+  qulonglong scrollback = qEnvironmentVariable("KBD_SCROLLBACK").toULongLong(&sizeOk);
+  kbd_scrollback_init(&m_scrollback, sizeOk ? static_cast<size_t>(scrollback) : 0, 0);
+  m_view = new ScrollbackView(&m_scrollback, this);
+  m_search->setPlaceholderText("search history (Enter for next)");
+  connect(m_search, &QLineEdit::returnPressed, this, &MainWindow::onSearch);
+  connect(m_view, &ScrollbackView::painted, this, &MainWindow::onPainted);
+
+  // Text and counter changes are coalesced into at most one repaint per
+  // ~60 Hz frame, however many characters a read delivers.
+  m_frameTimer->setSingleShot(true);
+  m_frameTimer->setInterval(16);
+  connect(m_frameTimer, &QTimer::timeout, this, &MainWindow::renderFrame);
+  // Capture and decoding run on the reader thread; this side only drains
+  // its queue, at the same frame rate.
+  m_drainTimer->setInterval(16);
+  connect(m_drainTimer, &QTimer::timeout, this, &MainWindow::drainReader);
 
   QWidget *central = new QWidget(this);
   QVBoxLayout *layout = new QVBoxLayout(central);
   layout->addWidget(m_statusLabel);
   layout->addWidget(m_totalLabel);
   layout->addWidget(m_dayLabel);
-  layout->addWidget(m_textEdit);
+  layout->addWidget(m_timingLabel);
+  layout->addWidget(m_latencyLabel);
+  m_latencyLabel->setVisible(!m_latencyPath.isEmpty());
+  m_latencyLabel->setText("latency: waiting for input");
+  layout->addWidget(m_search);
+  layout->addWidget(m_view);
   setCentralWidget(central);
 
   m_devicePath = qEnvironmentVariable("DEVICE_PATH", "/dev/kbd");
+  m_useRing = qEnvironmentVariableIsSet("KBD_MMAP");
+  // Stand-ins such as kbd_replay's pipe cannot answer KBD_IOC_GET_FORMAT.
+  m_forceRecords = qEnvironmentVariable("KBD_FORMAT") == "record";
+  int keyLayout = scancode_layout_from_name(qEnvironmentVariable("KBD_LAYOUT", "us").toUtf8().constData());
+  if (keyLayout >= 0) {
+    m_layout = static_cast<scancode_layout_t>(keyLayout);
+  }
+  // KBD_BACKEND=poll|uring; the default uses io_uring when available.
+  int backend = kbd_reader_backend_from_name(qEnvironmentVariable("KBD_BACKEND", "auto").toUtf8().constData());
+  if (backend >= 0) {
+    m_backend = static_cast<kbd_reader_backend_t>(backend);
+  }
 
   QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
   if (!dataDir.isEmpty()) {
@@ -45,111 +103,251 @@ MainWindow::MainWindow(QWidget *parent)
   m_day = currentDay();
   QByteArray pathBytes = m_statsPath.toLocal8Bit();
   QByteArray dayBytes = m_day.toLocal8Bit();
-  if (stats_init(&m_stats, pathBytes.constData(), dayBytes.constData()) == 0) {
+  if (stats_flusher_start(&m_stats, pathBytes.constData(), dayBytes.constData(), nullptr) == 0) {
     m_statsReady = true;
   }
 
-  updateCounters(0);
+  updateCounters();
+  updateTimingLabel();
   m_statusLabel->setText("device: waiting for /dev/kbd");
 
+  // Device data arrives through the reader thread; this timer only retries
+  // opening the device and rotates the day, so it can tick slowly.
   connect(m_timer, &QTimer::timeout, this, &MainWindow::onTick);
-  m_timer->start(100);
+  m_timer->start(1000);
+  onTick();
 }
 
 MainWindow::~MainWindow() {
+  // The reader thread records into m_stats, so it has to go first.
+  closeDevice();
+  updateLatency();
   if (m_statsReady) {
-    stats_save(&m_stats);
-    stats_free(&m_stats);
-  }
-  if (m_fd >= 0) {
-    ::close(m_fd);
+    // Final flush and compaction happen on this thread after the flusher
+    // thread has exited.
+    stats_flusher_stop(&m_stats);
   }
+  kbd_scrollback_free(&m_scrollback);
 }
 
 void MainWindow::onTick() {
   rotateDayIfNeeded();
   openDeviceIfNeeded();
-  readDevice();
+  if (m_fd >= 0) {
+    updateDeviceStatus();
+  }
+  // The rate window decays while idle, so refresh even without input.
+  updateTimingLabel();
+  updateLatency();
 }
 
 void MainWindow::openDeviceIfNeeded() {
   if (m_fd >= 0) {
     return;
   }
-  m_fd = open(m_devicePath.toLocal8Bit().constData(), O_RDONLY | O_NONBLOCK);
-  if (m_fd >= 0) {
-    m_statusLabel->setText(QString("device: %1").arg(m_devicePath));
+  QByteArray path = m_devicePath.toLocal8Bit();
+  if (m_useRing) {
+    // The ring's consumer index is written through the mapping, which needs
+    // a writable fd; fall back to plain reads if either step fails.
+    m_fd = open(path.constData(), O_RDWR | O_NONBLOCK);
+    if (m_fd >= 0 && kbd_ring_map_device(&m_ring, m_fd) != 0) {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+  }
+  if (m_fd < 0) {
+    m_fd = open(path.constData(), O_RDONLY | O_NONBLOCK);
   }
-}
-
-void MainWindow::readDevice() {
   if (m_fd < 0) {
     return;
   }
+  m_format = m_forceRecords ? KBD_FORMAT_RECORD : kbd_record_device_format(m_fd);
 
-  unsigned char buf[256];
-  ssize_t n = 0;
-  unsigned long added = 0;
-  char out[32];
-  while ((n = read(m_fd, buf, sizeof(buf))) > 0) {
-    for (ssize_t i = 0; i < n; ++i) {
-      unsigned long counted = 0;
-      size_t out_len = scancode_process(&m_scancodeState, buf[i], out, sizeof(out), &counted);
-      if (out_len == 0) {
-        continue;
-      }
-      for (size_t j = 0; j < out_len; ++j) {
-        applyChar(out[j]);
+  kbd_reader_config_t config = {};
+  config.fd = m_fd;
+  config.format = m_format;
+  config.ring = m_ring.hdr ? &m_ring : nullptr;
+  config.layout = m_layout;
+  config.stats = m_statsReady ? &m_stats : nullptr;
+  config.trace = !m_latencyPath.isEmpty();
+  config.backend = m_backend;
+  if (kbd_reader_start(&m_reader, &config) != 0) {
+    closeDevice();
+    return;
+  }
+  m_readerRunning = true;
+  m_lastLatencyNs = 0;
+  m_drainTimer->start();
+  updateDeviceStatus();
+}
+
+void MainWindow::updateDeviceStatus() {
+  QString text = QString("device: %1").arg(m_devicePath);
+  kbd_reader_status_t status;
+  kbd_reader_status(&m_reader, &status);
+  if (m_ring.hdr) {
+    text += " (mmap)";
+  } else {
+    text += QString(" (%1)").arg(kbd_reader_backend_name(status.backend));
+  }
+  if (m_format == KBD_FORMAT_RECORD) {
+    text += QString(" | events %1, lost %2, latency %3 us")
+                .arg(status.events)
+                .arg(status.lost)
+                .arg(m_lastLatencyNs / 1000);
+  }
+  if (status.dropped > 0) {
+    text += QString(" | display drops %1").arg(status.dropped);
+  }
+  struct kbd_fifo_info info;
+  if (kbd_device_fifo_info(m_fd, &info) == 0) {
+    text += QString(" | kernel drops %1 (%2, fifo %3)")
+                .arg(info.dropped)
+                .arg(kbd_device_overflow_name(info.overflow))
+                .arg(info.fifo_size);
+  }
+  m_statusLabel->setText(text);
+}
+
+void MainWindow::closeDevice() {
+  m_drainTimer->stop();
+  if (m_readerRunning) {
+    kbd_reader_stop(&m_reader);
+    m_readerRunning = false;
+  }
+  kbd_ring_unmap(&m_ring);
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+void MainWindow::drainReader() {
+  // Status first: once the thread reports EOF, everything it queued before
+  // that is visible to the drain below.
+  kbd_reader_status_t status;
+  kbd_reader_status(&m_reader, &status);
+
+  kbd_reader_batch_t batches[64];
+  size_t drained = 0;
+  size_t n = 0;
+  // Bounded so a flood cannot starve the event loop; the rest waits a frame.
+  while (drained < KBD_READER_DEFAULT_QUEUE && (n = kbd_reader_drain(&m_reader, batches, 64)) > 0) {
+    uint64_t now = kbd_record_now_ns();
+    for (size_t i = 0; i < n; ++i) {
+      const kbd_reader_batch_t &batch = batches[i];
+      kbd_timing_feed(&m_timing, batch.codes, batch.code_len, batch.ts_ns);
+      kbd_timing_count(&m_timing, batch.counted, batch.ts_ns);
+      kbd_scrollback_append(&m_scrollback, batch.text, batch.text_len);
+      if (m_format == KBD_FORMAT_RECORD) {
+        m_lastLatencyNs = now - batch.ts_ns;
       }
-      added += counted;
+      kbd_latency_drained(&m_latency, &batch, m_format == KBD_FORMAT_RECORD, now);
     }
+    drained += n;
+  }
+  if (drained > 0) {
+    m_textDirty = true;
+    updateCounters();
+    m_frameTimer->stop();
+    renderFrame();
   }
 
-  if (n == 0) {
-    return;
+  // /dev/kbd never returns 0 for a non-empty read; EOF means the source
+  // (e.g. a pipe) went away, so drop it and let onTick() reopen it.
+  if (status.closed && drained < KBD_READER_DEFAULT_QUEUE) {
+    closeDevice();
+    m_statusLabel->setText(QString("device: waiting for %1").arg(m_devicePath));
   }
+}
 
-  if (n < 0 && added == 0) {
-    return;
+void MainWindow::scheduleFrame() {
+  if (!m_frameTimer->isActive()) {
+    m_frameTimer->start();
   }
+}
 
-  if (added > 0) {
-    updateCounters(added);
+void MainWindow::renderFrame() {
+  if (m_countersDirty) {
+    m_countersDirty = false;
+    refreshCounterLabels();
+  }
+  if (m_textDirty) {
+    m_textDirty = false;
+    m_view->refresh();
   }
 }
 
-void MainWindow::applyChar(char ch) {
-  if (ch == '\b') {
-    if (!m_buffer.isEmpty()) {
-      m_buffer.chop(1);
-    }
-  } else if (ch == '\n') {
-    m_buffer.append('\n');
-  } else {
-    m_buffer.append(ch);
+void MainWindow::onSearch() {
+  if (!m_view->findNext(m_search->text())) {
+    m_statusLabel->setText(QString("search: '%1' not found").arg(m_search->text()));
   }
+}
 
-  if (m_buffer.size() > 200) {
-    m_buffer = m_buffer.right(200);
+void MainWindow::onPainted() {
+  if (m_latency.pending > 0) {
+    kbd_latency_painted(&m_latency, kbd_record_now_ns());
+    m_latencyDirty = true;
   }
+}
 
-  m_textEdit->setPlainText(m_buffer);
+void MainWindow::updateCounters() {
+  // Counts are recorded on the reader thread; this only refreshes labels.
+  m_countersDirty = true;
+  scheduleFrame();
 }
 
-void MainWindow::updateCounters(unsigned long added) {
+void MainWindow::refreshCounterLabels() {
   if (!m_statsReady) {
     m_totalLabel->setText("total count (since start/save): unavailable");
     m_dayLabel->setText("today count: unavailable");
     return;
   }
 
-  if (added > 0) {
-    stats_record(&m_stats, added);
-    stats_save(&m_stats);
+  unsigned long total = 0;
+  unsigned long dayCount = 0;
+  stats_flusher_counts(&m_stats, &total, &dayCount);
+  m_totalLabel->setText(QString("total count (since start/save): %1").arg(total));
+  m_dayLabel->setText(QString("today count: %1").arg(dayCount));
+}
+
+void MainWindow::updateTimingLabel() {
+  double cpm = kbd_rate_cpm(&m_timing.rate, kbd_record_now_ns());
+  if (m_timing.interkey.total == 0) {
+    m_timingLabel->setText(QString("typing: %1 wpm (%2 cpm)").arg(cpm / 5.0, 0, 'f', 0).arg(cpm, 0, 'f', 0));
+    return;
   }
+  // Histograms are in nanoseconds; milliseconds read better.
+  auto ms = [](uint64_t ns) { return QString::number(ns / 1e6, 'f', 0); };
+  m_timingLabel->setText(QString("typing: %1 wpm (%2 cpm) | inter-key p50/p90/p99 %3/%4/%5 ms | dwell p50 %6 ms")
+                             .arg(cpm / 5.0, 0, 'f', 0)
+                             .arg(cpm, 0, 'f', 0)
+                             .arg(ms(kbd_hist_percentile(&m_timing.interkey, 50.0)))
+                             .arg(ms(kbd_hist_percentile(&m_timing.interkey, 90.0)))
+                             .arg(ms(kbd_hist_percentile(&m_timing.interkey, 99.0)))
+                             .arg(ms(kbd_hist_percentile(&m_timing.dwell, 50.0))));
+}
 
-  m_totalLabel->setText(QString("total count (since start/save): %1").arg(m_stats.total));
-  m_dayLabel->setText(QString("today count: %1").arg(m_stats.day_count));
+void MainWindow::updateLatency() {
+  if (m_latencyPath.isEmpty() || !m_latencyDirty) {
+    return;
+  }
+  m_latencyDirty = false;
+  QString text = "latency p50/p99 us:";
+  for (int s = 0; s < KBD_LAT_STAGES; ++s) {
+    const kbd_hist_t &hist = m_latency.stages[s];
+    if (hist.total == 0) {
+      continue;
+    }
+    text += QString(" %1 %2/%3")
+                .arg(kbd_latency_stage_name(static_cast<kbd_latency_stage_t>(s)))
+                .arg(kbd_hist_percentile(&hist, 50.0) / 1000)
+                .arg(kbd_hist_percentile(&hist, 99.0) / 1000);
+  }
+  m_latencyLabel->setText(text);
+  // Rewritten while running, so the numbers survive a kill.
+  QByteArray path = m_latencyPath.toLocal8Bit();
+  kbd_latency_write_csv(&m_latency, path.constData());
 }
 
 void MainWindow::rotateDayIfNeeded() {
@@ -158,19 +356,23 @@ void MainWindow::rotateDayIfNeeded() {
     return;
   }
 
+  QByteArray dayBytes = today.toLocal8Bit();
   if (m_statsReady) {
-    stats_save(&m_stats);
-    stats_free(&m_stats);
-    m_statsReady = false;
+    // Flushes and compacts the finished day before switching; on failure
+    // the old day stays active and the next tick retries.
+    if (stats_flusher_set_day(&m_stats, dayBytes.constData()) != 0) {
+      return;
+    }
+  } else {
+    QByteArray pathBytes = m_statsPath.toLocal8Bit();
+    if (stats_flusher_start(&m_stats, pathBytes.constData(), dayBytes.constData(), nullptr) == 0) {
+      m_statsReady = true;
+      // The reader was started without stats; reopening hands them over.
+      closeDevice();
+    }
   }
-
   m_day = today;
-  QByteArray pathBytes = m_statsPath.toLocal8Bit();
-  QByteArray dayBytes = m_day.toLocal8Bit();
-  if (stats_init(&m_stats, pathBytes.constData(), dayBytes.constData()) == 0) {
-    m_statsReady = true;
-  }
-  updateCounters(0);
+  updateCounters();
 }
 
 QString MainWindow::currentDay() const {
@@ -6,13 +6,21 @@
 #include <QString>
 
 extern "C" {
-#include "stats.h"
+#include "kbd_device.h"
+#include "kbd_latency.h"
+#include "kbd_reader.h"
+#include "kbd_record.h"
+#include "kbd_ring.h"
+#include "kbd_scrollback.h"
+#include "kbd_timing.h"
+#include "stats_flusher.h"
 #include "scancode_map.h"
 }
 
 class QLabel;
-class QPlainTextEdit;
+class QLineEdit;
 class QTimer;
+class ScrollbackView;
 
 class MainWindow : public QMainWindow {
   Q_OBJECT
@@ -23,29 +31,58 @@ public:
 
 private slots:
   void onTick();
+  void drainReader();
+  void renderFrame();
+  void onSearch();
+  void onPainted();
 
 private:
   void openDeviceIfNeeded();
-  void readDevice();
-  void applyChar(char ch);
-  void updateCounters(unsigned long added);
+  void closeDevice();
+  void updateDeviceStatus();
+  void updateCounters();
+  void refreshCounterLabels();
+  void scheduleFrame();
+  void updateTimingLabel();
+  void updateLatency();
   void rotateDayIfNeeded();
   QString currentDay() const;
 
-  QPlainTextEdit *m_textEdit;
+  ScrollbackView *m_view;
+  QLineEdit *m_search;
   QLabel *m_totalLabel;
   QLabel *m_dayLabel;
   QLabel *m_statusLabel;
+  QLabel *m_timingLabel;
+  QLabel *m_latencyLabel;
   QTimer *m_timer;
+  QTimer *m_frameTimer;
+  QTimer *m_drainTimer;
 
-  QString m_buffer;
+  // Decoded history; the view repaints from it once per frame.
+  kbd_scrollback_t m_scrollback;
+  bool m_textDirty;
+  bool m_countersDirty;
   int m_fd;
-  stats_t m_stats;
+  bool m_useRing;
+  bool m_forceRecords;
+  kbd_ring_t m_ring;
+  unsigned int m_format;
+  kbd_reader_t m_reader;
+  bool m_readerRunning;
+  uint64_t m_lastLatencyNs;
+  kbd_timing_t m_timing;
+  // Per-stage latency tracing, enabled by KBD_LATENCY (the CSV path).
+  kbd_latency_t m_latency;
+  QString m_latencyPath;
+  bool m_latencyDirty;
+  stats_flusher_t m_stats;
   QString m_day;
   QString m_devicePath;
   QString m_statsPath;
   bool m_statsReady;
-  scancode_state_t m_scancodeState;
+  scancode_layout_t m_layout;
+  kbd_reader_backend_t m_backend;
 };
 
 #endif
@@ -0,0 +1,117 @@
+#include "scrollbackview.h"
+
+#include <QByteArray>
+#include <QPaintEvent>
+#include <QPainter>
+#include <QScrollBar>
+
+#include <algorithm>
+#include <climits>
+
+// Longer lines are clipped to this many bytes before layout.
+static const int kMaxLineBytes = 4096;
+
+ScrollbackView::ScrollbackView(const kbd_scrollback_t *text, QWidget *parent)
+    : QAbstractScrollArea(parent),
+      m_text(text),
+      m_firstLine(text->first_line),
+      m_matchBegin(-1),
+      m_matchEnd(-1) {
+  setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+  setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOn);
+  viewport()->setBackgroundRole(QPalette::Base);
+  viewport()->setAutoFillBackground(true);
+  updateScrollRange();
+}
+
+int ScrollbackView::visibleRows() const {
+  return std::max(1, viewport()->height() / fontMetrics().lineSpacing());
+}
+
+void ScrollbackView::updateScrollRange() {
+  int lines = static_cast<int>(std::min<size_t>(kbd_scrollback_line_count(m_text), INT_MAX));
+  int rows = visibleRows();
+  verticalScrollBar()->setPageStep(rows);
+  verticalScrollBar()->setRange(0, std::max(0, lines - rows));
+}
+
+void ScrollbackView::refresh() {
+  QScrollBar *bar = verticalScrollBar();
+  bool follow = bar->value() == bar->maximum();
+  // Keep the same text on screen when old lines were evicted.
+  int evicted = static_cast<int>(m_text->first_line - m_firstLine);
+  m_firstLine = m_text->first_line;
+  int value = bar->value() - evicted;
+
+  updateScrollRange();
+  bar->setValue(follow ? bar->maximum() : std::max(0, value));
+  viewport()->update();
+}
+
+bool ScrollbackView::findNext(const QString &needle) {
+  QByteArray bytes = needle.toUtf8();
+  if (bytes.isEmpty()) {
+    return false;
+  }
+  uint64_t from = m_matchBegin >= 0 ? static_cast<uint64_t>(m_matchBegin) + 1 : m_text->start;
+  int64_t hit = kbd_scrollback_find(m_text, bytes.constData(), static_cast<size_t>(bytes.size()), from);
+  if (hit < 0 && from > m_text->start) {
+    hit = kbd_scrollback_find(m_text, bytes.constData(), static_cast<size_t>(bytes.size()), m_text->start);
+  }
+  if (hit < 0) {
+    m_matchBegin = m_matchEnd = -1;
+    viewport()->update();
+    return false;
+  }
+
+  m_matchBegin = hit;
+  m_matchEnd = hit + bytes.size();
+  int line = static_cast<int>(kbd_scrollback_line_at(m_text, static_cast<uint64_t>(hit)));
+  verticalScrollBar()->setValue(std::max(0, line - visibleRows() / 2));
+  viewport()->update();
+  return true;
+}
+
+void ScrollbackView::paintEvent(QPaintEvent *) {
+  QPainter painter(viewport());
+  const QFontMetrics metrics = fontMetrics();
+  const int lineHeight = metrics.lineSpacing();
+  const size_t count = kbd_scrollback_line_count(m_text);
+  const size_t first = static_cast<size_t>(verticalScrollBar()->value());
+  const size_t last = std::min(count, first + static_cast<size_t>(visibleRows()) + 1);
+
+  char buf[kMaxLineBytes];
+  int y = 0;
+  for (size_t i = first; i < last; ++i, y += lineHeight) {
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    if (kbd_scrollback_line_range(m_text, i, &begin, &end) != 0) {
+      break;
+    }
+    size_t len = kbd_scrollback_copy(m_text, begin, end, buf, sizeof(buf));
+    const QString text = QString::fromUtf8(buf, static_cast<int>(len));
+
+    if (m_matchBegin >= 0 && static_cast<uint64_t>(m_matchBegin) < end &&
+        static_cast<uint64_t>(m_matchEnd) > begin) {
+      // Offsets are bytes; measure the UTF-8 prefix and match as text.
+      uint64_t from = std::max<uint64_t>(static_cast<uint64_t>(m_matchBegin), begin);
+      uint64_t to = std::min<uint64_t>(static_cast<uint64_t>(m_matchEnd), begin + len);
+      int x0 = metrics.horizontalAdvance(QString::fromUtf8(buf, static_cast<int>(from - begin)));
+      int x1 = metrics.horizontalAdvance(QString::fromUtf8(buf, static_cast<int>(to - begin)));
+      painter.fillRect(QRect(4 + x0, y, std::max(1, x1 - x0), lineHeight), palette().highlight());
+    }
+    painter.drawText(4, y + metrics.ascent(), text);
+  }
+  painter.end();
+  emit painted();
+}
+
+void ScrollbackView::resizeEvent(QResizeEvent *event) {
+  QAbstractScrollArea::resizeEvent(event);
+  QScrollBar *bar = verticalScrollBar();
+  bool follow = bar->value() == bar->maximum();
+  updateScrollRange();
+  if (follow) {
+    bar->setValue(bar->maximum());
+  }
+}
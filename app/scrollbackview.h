@@ -0,0 +1,46 @@
+#ifndef SCROLLBACKVIEW_H
+#define SCROLLBACKVIEW_H
+
+#include <QAbstractScrollArea>
+#include <QString>
+
+extern "C" {
+#include "kbd_scrollback.h"
+}
+
+// Read-only view over a kbd_scrollback_t that lays out and paints only the
+// lines in the viewport, so its cost is independent of the history size.
+// Lines are not wrapped. The view follows new text while scrolled to the
+// bottom.
+class ScrollbackView : public QAbstractScrollArea {
+  Q_OBJECT
+
+public:
+  explicit ScrollbackView(const kbd_scrollback_t *text, QWidget *parent = nullptr);
+
+  // Call after appending to the scrollback.
+  void refresh();
+
+  // Selects the next occurrence of `needle` after the current match,
+  // wrapping to the oldest text. Returns false if there is none.
+  bool findNext(const QString &needle);
+
+signals:
+  // Emitted after each repaint, once the visible lines are drawn.
+  void painted();
+
+protected:
+  void paintEvent(QPaintEvent *event) override;
+  void resizeEvent(QResizeEvent *event) override;
+
+private:
+  int visibleRows() const;
+  void updateScrollRange();
+
+  const kbd_scrollback_t *m_text;
+  uint64_t m_firstLine; // m_text->first_line as of the last refresh
+  int64_t m_matchBegin; // -1 when nothing is selected
+  int64_t m_matchEnd;
+};
+
+#endif
@@ -1,20 +1,145 @@
+#include <linux/compat.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
 #include <linux/fs.h>
+#include <linux/hrtimer.h>
 #include <linux/kernel.h>
 #include <linux/kfifo.h>
+#include <linux/kthread.h>
+#include <linux/log2.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+#include <linux/serio.h>
+#include <linux/slab.h>
 #include <linux/spinlock.h>
-#include <linux/timer.h>
+#include <linux/string.h>
+#include <linux/sysfs.h>
+#include <linux/timekeeping.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #include <linux/kprobes.h>
 #include <linux/io.h>
 
-#define BUFFER_SIZE 4096
+#include "kbd_sim_uapi.h"
+
+#define CREATE_TRACE_POINTS
+#include "kbd_sim_trace.h"
+
 #define MODULE_NAME "kbd"
+#define MAX_FIFO_EVENTS (1u << 20)
+
+static bool record_format;
+module_param(record_format, bool, 0444);
+MODULE_PARM_DESC(record_format, "Emit struct kbd_event records instead of raw scancode bytes");
+
+static bool percpu = true;
+module_param(percpu, bool, 0444);
+MODULE_PARM_DESC(percpu, "Capture into lockless per-CPU rings merged by the reader (0 = shared locked fifo)");
+
+static bool aggregate;
+module_param(aggregate, bool, 0644);
+MODULE_PARM_DESC(aggregate, "Count key presses in per-CPU counters for KBD_IOC_GET_KEY_COUNTS; writable at runtime");
+
+static unsigned int stress_threads;
+module_param(stress_threads, uint, 0444);
+MODULE_PARM_DESC(stress_threads, "Producer threads to start at load for a capture-path stress run (0 = off)");
+
+static unsigned int stress_events = 100000;
+module_param(stress_events, uint, 0444);
+MODULE_PARM_DESC(stress_events, "Events pushed by each stress thread");
+
+static unsigned int fifo_size = 4096;
+module_param(fifo_size, uint, 0444);
+MODULE_PARM_DESC(fifo_size, "Capture buffer capacity in events, per CPU when percpu=1 (rounded up to a power of two)");
+
+static const char *const overflow_names[] = {
+    [KBD_OVERFLOW_DROP_NEWEST] = "drop-newest",
+    [KBD_OVERFLOW_DROP_OLDEST] = "drop-oldest",
+    [KBD_OVERFLOW_BLOCK] = "block",
+};
+static int overflow_policy = KBD_OVERFLOW_DROP_NEWEST;
+
+static int overflow_set(const char *val, const struct kernel_param *kp) {
+  int policy = sysfs_match_string(overflow_names, val);
+
+  if (policy < 0)
+    return policy;
+  WRITE_ONCE(*(int *)kp->arg, policy);
+  return 0;
+}
+
+static int overflow_get(char *buf, const struct kernel_param *kp) {
+  return sysfs_emit(buf, "%s\n", overflow_names[READ_ONCE(*(int *)kp->arg)]);
+}
+
+static const struct kernel_param_ops overflow_ops = {
+    .set = overflow_set,
+    .get = overflow_get,
+};
+module_param_cb(overflow, &overflow_ops, &overflow_policy, 0644);
+MODULE_PARM_DESC(overflow, "Full buffer policy: drop-newest, drop-oldest or block (blocks simulated producers only)");
+
+static int gen_rate_set(const char *val, const struct kernel_param *kp);
+
+static const struct kernel_param_ops gen_rate_ops = {
+    .set = gen_rate_set,
+    .get = param_get_uint,
+};
+
+static unsigned int gen_rate;
+module_param_cb(gen_rate, &gen_rate_ops, &gen_rate, 0644);
+MODULE_PARM_DESC(gen_rate, "Load generator rate in events per second (0 = off); writable at runtime");
+
+static unsigned int gen_burst = 1;
+module_param(gen_burst, uint, 0644);
+MODULE_PARM_DESC(gen_burst, "Events the load generator pushes per hrtimer expiry");
+
+enum { GEN_SEQUENCE, GEN_RANDOM };
+static const char *const gen_pattern_names[] = {
+    [GEN_SEQUENCE] = "sequence",
+    [GEN_RANDOM] = "random",
+};
+static int gen_pattern = GEN_SEQUENCE;
 
-static unsigned int interval_ms = 120;
-module_param(interval_ms, uint, 0644);
-MODULE_PARM_DESC(interval_ms, "Timer interval for simulated scancodes");
+static int gen_pattern_set(const char *val, const struct kernel_param *kp) {
+  int pattern = sysfs_match_string(gen_pattern_names, val);
+
+  if (pattern < 0)
+    return pattern;
+  WRITE_ONCE(*(int *)kp->arg, pattern);
+  return 0;
+}
+
+static int gen_pattern_get(char *buf, const struct kernel_param *kp) {
+  return sysfs_emit(buf, "%s\n", gen_pattern_names[READ_ONCE(*(int *)kp->arg)]);
+}
+
+static const struct kernel_param_ops gen_pattern_ops = {
+    .set = gen_pattern_set,
+    .get = gen_pattern_get,
+};
+module_param_cb(gen_pattern, &gen_pattern_ops, &gen_pattern, 0644);
+MODULE_PARM_DESC(gen_pattern, "Load generator pattern: sequence (built-in scancodes) or random (make/break pairs)");
+
+#define MAX_PORTS 8
+/* port_index() result for a serio port beyond MAX_PORTS; never stored. */
+#define KBD_PORT_NONE 0xfdu
+#define HIST_BUCKETS 16
+/* Cap on expiries made up for after the generator timer ran late. */
+#define GEN_MAX_CATCHUP 16
+
+static unsigned int ring_size = 65536;
+module_param(ring_size, uint, 0444);
+MODULE_PARM_DESC(ring_size, "Data bytes in the mmap ring (rounded up to a power of two)");
 
 static const unsigned char scancodes[] = {
     0x23, 0x12, 0x26, 0x26, 0x18, 0x39,
@@ -24,22 +149,623 @@ static const unsigned char scancodes[] = {
 
 static size_t seq_idx;
 static DEFINE_SPINLOCK(buffer_lock);
-static struct timer_list sim_timer;
-static DEFINE_KFIFO(kbd_fifo, unsigned char, BUFFER_SIZE);
+static struct hrtimer gen_timer;
+static bool gen_ready;
+static int gen_pending_break = -1;
 static DECLARE_WAIT_QUEUE_HEAD(read_wait);
+static DECLARE_WAIT_QUEUE_HEAD(space_wait);
+static atomic_t open_count = ATOMIC_INIT(0);
 static struct kprobe kp;
 static const char *hook_symbol;
+static u32 event_seq;
+static struct serio *ports[MAX_PORTS];
+
+/*
+ * Per-CPU capture rings. Each CPU is the only producer of its ring (with
+ * local IRQs off) and the reader, serialized by pcpu_read_lock, is the only
+ * consumer, so neither side takes a shared lock. Both sides advance `tail`
+ * with cmpxchg so a producer can evict the oldest event under drop-oldest.
+ * `dropped` is written by the producer, `dropped_seen` by the reader.
+ */
+struct pcpu_ring {
+  u32 head;
+  u32 dropped;
+  struct kbd_event *ev;
+  u32 tail ____cacheline_aligned;
+  u32 dropped_seen;
+};
+
+/*
+ * Capture buffers, replaced as a whole by KBD_IOC_SET_FIFO_SIZE. Producers
+ * run with IRQs off (an RCU-sched read side); the reader and the resize
+ * path serialize on pcpu_read_lock and buffer_lock.
+ */
+struct kbd_buffers {
+  u32 mask;
+  struct pcpu_ring __percpu *rings;
+  struct kfifo fifo;
+};
+
+static struct kbd_buffers __rcu *bufs;
+static DEFINE_MUTEX(pcpu_read_lock);
+static u32 pcpu_seq;
+
+/*
+ * Counters exported through debugfs (kbd_sim/stats). Per-CPU so the
+ * capture path never shares a cache line; the reader sums them on demand.
+ * handler_hist[i] counts kprobe handler runs of [64 << (i - 1), 64 << i) ns.
+ */
+struct kbd_stats {
+  u64 captured;
+  u64 dropped;
+  u64 reads;
+  u64 read_bytes;
+  u32 high_water;
+  u64 handler_hist[HIST_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct kbd_stats, kbd_stats);
+static struct dentry *debug_dir;
+
+/*
+ * Key press counters for aggregate=1, per CPU like kbd_stats and summed by
+ * the ioctl. Prefix state is per source (serio ports, generator,
+ * injection). Each port's bytes arrive serialized by serio, the generator
+ * only emits plain codes, and writes to /dev/kbd, which may carry any
+ * prefix, are serialized by inject_lock.
+ */
+struct kbd_key_pcpu {
+  u64 presses[KBD_KEY_COUNT];
+  u64 printable;
+};
+
+struct kbd_key_seq {
+  u8 ext;
+  u8 skip;
+};
+
+static DEFINE_PER_CPU(struct kbd_key_pcpu, kbd_keys);
+static struct kbd_key_seq key_seq[MAX_PORTS + 2];
+/* One writer at a time, so an E0/E1 never applies to another's bytes. */
+static DEFINE_MUTEX(inject_lock);
+
+/* Keys that type a character on the US layout, as counted by lib/. */
+static const u8 key_printable[KBD_KEY_COUNT] = {
+    [0x02 ... 0x0D] = 1, [0x0F ... 0x1C] = 1, [0x1E ... 0x29] = 1,
+    [0x2B ... 0x35] = 1, [0x37] = 1, [0x39] = 1, [0x4A] = 1, [0x4E] = 1,
+    [0x80 | 0x1C] = 1, [0x80 | 0x35] = 1,
+};
+
+static struct task_struct **stress_tasks;
+static atomic_t stress_running;
+static atomic64_t stress_ns;
+
+/*
+ * mmap ring state. The header page is writable by userspace, so the kernel
+ * keeps its own copies of the size and producer index and never trusts what
+ * it reads back except `consumer`, which is only used for the free check.
+ */
+static void *ring_mem;
+static struct kbd_ring_header *ring_hdr;
+static unsigned char *ring_data;
+static u32 ring_mask;
+static u32 ring_prod;
+static u64 ring_dropped;
+static atomic_t ring_maps = ATOMIC_INIT(0);
+
+static size_t ring_mem_size(void) {
+  return PAGE_SIZE + ring_mask + 1;
+}
+
+static bool ring_active(void) {
+  return atomic_read(&ring_maps) > 0;
+}
+
+static bool ring_empty(void) {
+  return READ_ONCE(ring_prod) == smp_load_acquire(&ring_hdr->consumer);
+}
+
+static unsigned int event_unit(void) {
+  return record_format ? sizeof(struct kbd_event) : 1;
+}
+
+static struct kbd_buffers *buffers_locked(void) {
+  return rcu_dereference_protected(bufs, lockdep_is_held(&pcpu_read_lock) ||
+                                             lockdep_is_held(&buffer_lock));
+}
+
+static void buffers_free(struct kbd_buffers *b) {
+  int cpu;
+
+  if (!b)
+    return;
+  if (b->rings) {
+    for_each_possible_cpu(cpu)
+      kvfree(per_cpu_ptr(b->rings, cpu)->ev);
+    free_percpu(b->rings);
+  } else {
+    kfifo_free(&b->fifo);
+  }
+  kfree(b);
+}
+
+static struct kbd_buffers *buffers_alloc(u32 events) {
+  struct kbd_buffers *b;
+  int cpu;
+
+  events = roundup_pow_of_two(clamp_t(u32, events, 16, MAX_FIFO_EVENTS));
+  b = kzalloc(sizeof(*b), GFP_KERNEL);
+  if (!b)
+    return NULL;
+  b->mask = events - 1;
+
+  if (!percpu) {
+    if (kfifo_alloc(&b->fifo, events * event_unit(), GFP_KERNEL)) {
+      kfree(b);
+      return NULL;
+    }
+    return b;
+  }
+
+  b->rings = alloc_percpu(struct pcpu_ring);
+  if (!b->rings) {
+    kfree(b);
+    return NULL;
+  }
+  for_each_possible_cpu(cpu) {
+    struct pcpu_ring *r = per_cpu_ptr(b->rings, cpu);
+
+    r->ev = kvcalloc_node(events, sizeof(*r->ev), GFP_KERNEL, cpu_to_node(cpu));
+    if (!r->ev) {
+      buffers_free(b);
+      return NULL;
+    }
+  }
+  return b;
+}
+
+static void note_fill(u32 events) {
+  if (events > this_cpu_read(kbd_stats.high_water))
+    this_cpu_write(kbd_stats.high_water, events);
+}
+
+/* Called with buffer_lock held. Returns false when the ring is full. */
+static bool ring_push(const void *src, u32 len) {
+  u32 cons = smp_load_acquire(&ring_hdr->consumer);
+  u32 off = ring_prod & ring_mask;
+  u32 first = min_t(u32, len, ring_mask + 1 - off);
+
+  if (ring_prod - cons > ring_mask + 1 - len) {
+    ring_dropped++;
+    WRITE_ONCE(ring_hdr->dropped, ring_dropped);
+    return false;
+  }
+  memcpy(ring_data + off, src, first);
+  memcpy(ring_data, (const u8 *)src + first, len - first);
+  ring_prod += len;
+  smp_store_release(&ring_hdr->producer, ring_prod);
+  note_fill((ring_prod - cons) / len);
+  return true;
+}
+
+static void note_drop(u8 port, u8 scancode) {
+  this_cpu_inc(kbd_stats.dropped);
+  trace_kbd_drop(port, scancode);
+}
+
+/*
+ * Called with buffer_lock held. Never stores a partial record. The mmap
+ * ring's consumer index belongs to userspace, so it only drops newest.
+ */
+static bool buffer_store(const void *src, unsigned int len, int policy) {
+  struct kfifo *fifo;
+  unsigned char old[sizeof(struct kbd_event)];
+
+  if (ring_active())
+    return ring_push(src, len);
+
+  fifo = &buffers_locked()->fifo;
+  if (kfifo_avail(fifo) < len) {
+    if (policy != KBD_OVERFLOW_DROP_OLDEST)
+      return false;
+    /* The fifo only holds whole records, so one pop frees enough room. */
+    if (kfifo_out(fifo, old, len) == len)
+      note_drop(len == 1 ? 0 : ((struct kbd_event *)old)->port,
+                len == 1 ? old[0] : ((struct kbd_event *)old)->scancode);
+  }
+  kfifo_in(fifo, (const unsigned char *)src, len);
+  note_fill(kfifo_len(fifo) / len);
+  return true;
+}
+
+/*
+ * Per-port capture nodes, /dev/kbd0 to /dev/kbd7, one per serio port in
+ * `ports`. Each port has its own fifo, lock and wait queue, so readers of
+ * different ports never contend with each other or with /dev/kbd, which
+ * still sees every event. A port only stores events while its node is
+ * open. Nodes are registered from port_work, which port_index() schedules
+ * the first time it sees a port; the kprobe handler cannot register them.
+ */
+struct kbd_port {
+  spinlock_t lock;
+  struct kfifo fifo;
+  wait_queue_head_t wait;
+  atomic_t readers;
+  u32 seq;
+  u32 high_water;
+  u64 captured;
+  u64 dropped;
+  bool registered;
+  char name[8];
+  struct miscdevice misc;
+};
+
+static struct kbd_port port_nodes[MAX_PORTS];
+static const struct file_operations kbd_port_fops;
+
+static void port_register_fn(struct work_struct *work) {
+  unsigned int i;
+
+  for (i = 0; i < MAX_PORTS; i++) {
+    struct kbd_port *p = &port_nodes[i];
+
+    if (p->registered || !READ_ONCE(ports[i]))
+      continue;
+    if (kfifo_alloc(&p->fifo, READ_ONCE(fifo_size) * event_unit(), GFP_KERNEL))
+      continue;
+    snprintf(p->name, sizeof(p->name), "kbd%u", i);
+    p->misc.minor = MISC_DYNAMIC_MINOR;
+    p->misc.name = p->name;
+    p->misc.fops = &kbd_port_fops;
+    p->misc.mode = 0444;
+    if (misc_register(&p->misc)) {
+      kfifo_free(&p->fifo);
+      continue;
+    }
+    p->registered = true;
+    pr_info(MODULE_NAME ": serio port %u captured on /dev/%s\n", i, p->name);
+  }
+}
+static DECLARE_WORK(port_work, port_register_fn);
 
-static void buffer_push(unsigned char val) {
+/*
+ * Stores one event for an open port node. Ports never block, so the block
+ * policy drops newest here as it does for the kprobe path.
+ */
+static void port_push(u8 index, unsigned char val, const struct kbd_event *ev) {
+  unsigned char old[sizeof(struct kbd_event)];
+  unsigned int len = event_unit();
+  struct kbd_event rec;
+  struct kbd_port *p;
   unsigned long flags;
+  bool stored = true;
 
-  spin_lock_irqsave(&buffer_lock, flags);
-  kfifo_in(&kbd_fifo, &val, 1);
-  spin_unlock_irqrestore(&buffer_lock, flags);
-  wake_up_interruptible(&read_wait);
+  if (index >= MAX_PORTS)
+    return;
+  p = &port_nodes[index];
+  if (!atomic_read(&p->readers))
+    return;
+
+  spin_lock_irqsave(&p->lock, flags);
+  p->captured++;
+  if (kfifo_avail(&p->fifo) < len) {
+    if (READ_ONCE(overflow_policy) == KBD_OVERFLOW_DROP_OLDEST &&
+        kfifo_out(&p->fifo, old, len) == len)
+      p->dropped++;
+    else
+      stored = false;
+  }
+  if (stored) {
+    if (len == 1) {
+      kfifo_in(&p->fifo, &val, 1);
+    } else {
+      rec = *ev;
+      rec.seq = p->seq;
+      kfifo_in(&p->fifo, (const unsigned char *)&rec, len);
+    }
+    p->high_water = max(p->high_water, kfifo_len(&p->fifo) / len);
+  } else {
+    p->dropped++;
+  }
+  /* Per-port sequence numbers: a gap is a loss on this port only. */
+  p->seq++;
+  spin_unlock_irqrestore(&p->lock, flags);
+
+  if (wq_has_sleeper(&p->wait))
+    wake_up_interruptible(&p->wait);
+}
+
+/*
+ * Small serio -> port index table, filled on first sight of each port.
+ * Lookups are lock-free so this is safe from the kprobe handler. Returns
+ * KBD_PORT_NONE once the table is full: sharing a slot would interleave
+ * two devices' prefixes.
+ */
+static u8 port_index(struct serio *serio) {
+  unsigned int i;
+
+  if (!serio)
+    return 0;
+  for (i = 0; i < MAX_PORTS; i++) {
+    struct serio *cur = READ_ONCE(ports[i]);
+
+    if (cur == serio)
+      return i;
+    if (!cur && !cmpxchg(&ports[i], NULL, serio)) {
+      schedule_work(&port_work);
+      return i;
+    }
+    if (READ_ONCE(ports[i]) == serio)
+      return i;
+  }
+  return KBD_PORT_NONE;
+}
+
+/*
+ * Stores `ev` in this CPU's ring. Returns false if the ring is full and
+ * the policy is not drop-oldest; the caller decides whether that is a drop.
+ */
+static bool pcpu_push(const struct kbd_event *ev, int policy) {
+  struct kbd_buffers *b;
+  struct pcpu_ring *r;
+  unsigned long flags;
+  bool stored = true;
+  u32 head, tail;
+
+  local_irq_save(flags);
+  b = rcu_dereference_sched(bufs);
+  r = this_cpu_ptr(b->rings);
+  head = r->head;
+  tail = smp_load_acquire(&r->tail);
+  if (head - tail > b->mask) {
+    if (policy != KBD_OVERFLOW_DROP_OLDEST) {
+      stored = false;
+      goto out;
+    }
+    /*
+     * Evict the oldest event. If the reader won the race for that slot
+     * instead, there is room now and nothing was lost.
+     */
+    if (cmpxchg(&r->tail, tail, tail + 1) == tail) {
+      WRITE_ONCE(r->dropped, r->dropped + 1);
+      note_drop(ev->port, r->ev[tail & b->mask].scancode);
+    }
+  }
+  r->ev[head & b->mask] = *ev;
+  smp_store_release(&r->head, head + 1);
+  note_fill(head + 1 - READ_ONCE(r->tail));
+out:
+  local_irq_restore(flags);
+  return stored;
+}
+
+static void pcpu_count_drop(void) {
+  struct pcpu_ring *r;
+  unsigned long flags;
+
+  local_irq_save(flags);
+  r = this_cpu_ptr(rcu_dereference_sched(bufs)->rings);
+  WRITE_ONCE(r->dropped, r->dropped + 1);
+  local_irq_restore(flags);
+}
+
+static bool buffer_empty(void) {
+  struct kbd_buffers *b;
+  bool empty = true;
+  int cpu;
+
+  rcu_read_lock_sched();
+  b = rcu_dereference_sched(bufs);
+  if (!percpu) {
+    empty = kfifo_is_empty(&b->fifo);
+  } else {
+    for_each_possible_cpu(cpu) {
+      struct pcpu_ring *r = per_cpu_ptr(b->rings, cpu);
+
+      if (READ_ONCE(r->tail) != smp_load_acquire(&r->head)) {
+        empty = false;
+        break;
+      }
+    }
+  }
+  rcu_read_unlock_sched();
+  return empty;
+}
+
+/* Whether a producer on the current CPU could store one more event. */
+static bool buffer_has_space(void) {
+  struct kbd_buffers *b;
+  struct pcpu_ring *r;
+  bool space;
+
+  rcu_read_lock_sched();
+  b = rcu_dereference_sched(bufs);
+  if (!percpu) {
+    space = kfifo_avail(&b->fifo) >= event_unit();
+  } else {
+    r = this_cpu_ptr(b->rings);
+    space = READ_ONCE(r->head) - READ_ONCE(r->tail) <= b->mask;
+  }
+  rcu_read_unlock_sched();
+  return space;
+}
+
+/* Same key ids and skipping rules as scancode_key_id() in lib/. */
+static void count_key(u8 port, unsigned char val) {
+  struct kbd_key_seq *seq;
+  unsigned int ext, id;
+
+  if (port < MAX_PORTS)
+    seq = &key_seq[port];
+  else
+    seq = &key_seq[MAX_PORTS + (port == KBD_PORT_INJECT)];
+  if (seq->skip) {
+    seq->skip--;
+    return;
+  }
+  if (val == 0xE0) {
+    seq->ext = 0x80;
+    return;
+  }
+  if (val == 0xE1) {
+    seq->skip = 2; /* E1 1D 45 / E1 9D C5 */
+    return;
+  }
+  ext = seq->ext;
+  seq->ext = 0;
+  if ((val & 0x80) || (ext && (val == 0x2A || val == 0x36)))
+    return;
+
+  id = val | ext;
+  this_cpu_inc(kbd_keys.presses[id]);
+  if (key_printable[id])
+    this_cpu_inc(kbd_keys.printable);
+}
+
+/*
+ * Queues one captured scancode. `may_block` is true only for process
+ * context producers (simulators), which sleep under the block policy;
+ * the kprobe path can never block and drops instead.
+ */
+static void buffer_push(unsigned char val, u8 port, bool may_block) {
+  bool records = READ_ONCE(record_format);
+  int policy = READ_ONCE(overflow_policy);
+  struct kbd_event ev = {};
+  bool have_seq = false;
+  bool use_pcpu;
+  unsigned long flags;
+  bool stored;
+
+  if (READ_ONCE(aggregate))
+    count_key(port, val);
+
+  /* Per-CPU rings are merged by timestamp, so they always need one. */
+  if (records || percpu) {
+    ev.timestamp_ns = ktime_get_ns();
+    ev.port = port;
+    ev.scancode = val;
+  }
+
+  for (;;) {
+    /* The mmap ring has a single shared producer index; keep it locked. */
+    use_pcpu = percpu && !ring_active();
+    if (use_pcpu) {
+      stored = pcpu_push(&ev, policy);
+    } else {
+      spin_lock_irqsave(&buffer_lock, flags);
+      if (records) {
+        /* Retries after blocking keep their original sequence number. */
+        if (!have_seq) {
+          ev.seq = event_seq++;
+          have_seq = true;
+        }
+        stored = buffer_store(&ev, sizeof(ev), policy);
+      } else {
+        stored = buffer_store(&val, 1, policy);
+      }
+      spin_unlock_irqrestore(&buffer_lock, flags);
+    }
+
+    if (stored || policy != KBD_OVERFLOW_BLOCK || !may_block || ring_active())
+      break;
+    if (wait_event_interruptible(space_wait, buffer_has_space()))
+      break;
+  }
+
+  this_cpu_inc(kbd_stats.captured);
+  if (!stored) {
+    if (use_pcpu)
+      pcpu_count_drop();
+    note_drop(port, val);
+  }
+  port_push(port, val, &ev);
+
+  /* Skip the wait-queue lock entirely when nobody is sleeping. */
+  if (wq_has_sleeper(&read_wait))
+    wake_up_interruptible(&read_wait);
+}
+
+/*
+ * Pops the oldest event across all per-CPU rings. Called with
+ * pcpu_read_lock held. Drops seen since the last pop are folded into the
+ * sequence number so userspace sees them as a gap.
+ */
+static bool pcpu_pop_one(struct kbd_buffers *b, struct kbd_event *out) {
+  struct pcpu_ring *best;
+  u64 best_ts;
+  u32 dropped, tail;
+  int cpu;
+
+retry:
+  best = NULL;
+  best_ts = 0;
+  for_each_possible_cpu(cpu) {
+    struct pcpu_ring *r = per_cpu_ptr(b->rings, cpu);
+    const struct kbd_event *ev;
+
+    tail = READ_ONCE(r->tail);
+    if (tail == smp_load_acquire(&r->head))
+      continue;
+    ev = &r->ev[tail & b->mask];
+    if (!best || ev->timestamp_ns < best_ts) {
+      best = r;
+      best_ts = ev->timestamp_ns;
+    }
+  }
+  if (!best)
+    return false;
+
+  /* A drop-oldest producer may evict the slot while we copy it. */
+  tail = READ_ONCE(best->tail);
+  *out = best->ev[tail & b->mask];
+  if (cmpxchg(&best->tail, tail, tail + 1) != tail)
+    goto retry;
+
+  dropped = READ_ONCE(best->dropped);
+  pcpu_seq += dropped - best->dropped_seen;
+  best->dropped_seen = dropped;
+  out->seq = pcpu_seq++;
+  return true;
+}
+
+static ssize_t pcpu_pop(char __user *out, size_t count) {
+  size_t unit = event_unit();
+  struct kbd_buffers *b;
+  size_t copied = 0;
+  unsigned char tmp[256];
+
+  mutex_lock(&pcpu_read_lock);
+  b = buffers_locked();
+  while (copied < count) {
+    size_t chunk = min_t(size_t, count - copied, sizeof(tmp));
+    size_t n = 0;
+    struct kbd_event ev;
+
+    while (n + unit <= chunk && pcpu_pop_one(b, &ev)) {
+      if (record_format)
+        memcpy(tmp + n, &ev, sizeof(ev));
+      else
+        tmp[n] = ev.scancode;
+      n += unit;
+    }
+    if (n == 0)
+      break;
+
+    if (copy_to_user(out + copied, tmp, n)) {
+      mutex_unlock(&pcpu_read_lock);
+      return -EFAULT;
+    }
+    copied += n;
+  }
+  mutex_unlock(&pcpu_read_lock);
+
+  if (copied > 0 && wq_has_sleeper(&space_wait))
+    wake_up_interruptible(&space_wait);
+  return copied;
 }
 
 static ssize_t buffer_pop(char __user *out, size_t count) {
+  struct kfifo *fifo;
   unsigned long flags;
   size_t copied = 0;
   unsigned char tmp[256];
@@ -49,11 +775,12 @@ static ssize_t buffer_pop(char __user *out, size_t count) {
     unsigned int out_len = 0;
 
     spin_lock_irqsave(&buffer_lock, flags);
-    if (kfifo_is_empty(&kbd_fifo)) {
+    fifo = &buffers_locked()->fifo;
+    if (kfifo_is_empty(fifo)) {
       spin_unlock_irqrestore(&buffer_lock, flags);
       break;
     }
-    out_len = kfifo_out(&kbd_fifo, tmp, chunk);
+    out_len = kfifo_out(fifo, tmp, chunk);
     spin_unlock_irqrestore(&buffer_lock, flags);
 
     if (copy_to_user(out + copied, tmp, out_len)) {
@@ -63,14 +790,175 @@ static ssize_t buffer_pop(char __user *out, size_t count) {
     copied += out_len;
   }
 
+  if (copied > 0 && wq_has_sleeper(&space_wait))
+    wake_up_interruptible(&space_wait);
   return copied;
 }
 
-//tmp : disabled
-static void sim_timer_fn(struct timer_list *t) {
-  buffer_push(scancodes[seq_idx]);
-  seq_idx = (seq_idx + 1) % ARRAY_SIZE(scancodes);
-  mod_timer(&sim_timer, jiffies + msecs_to_jiffies(interval_ms));
+/*
+ * Swaps in buffers of `events` capacity. Pending events are discarded, so
+ * the ioctl only allows this while the caller is the sole opener.
+ */
+static int buffers_resize(u32 events) {
+  struct kbd_buffers *nb, *old;
+  unsigned long flags;
+
+  nb = buffers_alloc(events);
+  if (!nb)
+    return -ENOMEM;
+
+  mutex_lock(&pcpu_read_lock);
+  spin_lock_irqsave(&buffer_lock, flags);
+  old = buffers_locked();
+  rcu_assign_pointer(bufs, nb);
+  fifo_size = nb->mask + 1;
+  spin_unlock_irqrestore(&buffer_lock, flags);
+  mutex_unlock(&pcpu_read_lock);
+
+  /* Wait out producers still using the old rings (they run IRQs-off). */
+  synchronize_rcu();
+  buffers_free(old);
+  wake_up_interruptible(&space_wait);
+  return 0;
+}
+
+static int stress_thread_fn(void *arg) {
+  u64 start = ktime_get_ns();
+  unsigned int i;
+
+  for (i = 0; i < stress_events && !kthread_should_stop(); i++)
+    buffer_push(scancodes[i % ARRAY_SIZE(scancodes)], KBD_PORT_GENERATOR, true);
+  atomic64_add(ktime_get_ns() - start, &stress_ns);
+
+  if (atomic_dec_and_test(&stress_running)) {
+    u64 total = (u64)stress_threads * stress_events;
+
+    pr_info(MODULE_NAME ": stress: %u threads x %u events, %s path, %llu ns/push\n",
+            stress_threads, stress_events, percpu ? "per-cpu" : "locked",
+            div64_u64(atomic64_read(&stress_ns), max_t(u64, total, 1)));
+  }
+
+  /* Park until kbd_sim_exit() stops us so kthread_stop() is always valid. */
+  while (!kthread_should_stop()) {
+    set_current_state(TASK_INTERRUPTIBLE);
+    if (!kthread_should_stop())
+      schedule();
+    __set_current_state(TASK_RUNNING);
+  }
+  return 0;
+}
+
+/* Starts one producer per online CPU (up to stress_threads), all at once. */
+static int stress_start(void) {
+  unsigned int started = 0;
+  int cpu;
+
+  if (stress_threads == 0)
+    return 0;
+
+  stress_threads = min_t(unsigned int, stress_threads, num_online_cpus());
+  stress_tasks = kcalloc(stress_threads, sizeof(*stress_tasks), GFP_KERNEL);
+  if (!stress_tasks)
+    return -ENOMEM;
+
+  atomic_set(&stress_running, stress_threads);
+  for_each_online_cpu(cpu) {
+    struct task_struct *t;
+
+    if (started == stress_threads)
+      break;
+    t = kthread_create(stress_thread_fn, NULL, "kbd_stress/%d", cpu);
+    if (IS_ERR(t)) {
+      atomic_sub(stress_threads - started, &stress_running);
+      stress_threads = started;
+      break;
+    }
+    kthread_bind(t, cpu);
+    stress_tasks[started++] = t;
+  }
+  for (cpu = 0; cpu < started; cpu++)
+    wake_up_process(stress_tasks[cpu]);
+  return 0;
+}
+
+static void stress_stop(void) {
+  unsigned int i;
+
+  if (!stress_tasks)
+    return;
+  for (i = 0; i < stress_threads; i++)
+    kthread_stop(stress_tasks[i]);
+  kfree(stress_tasks);
+  stress_tasks = NULL;
+}
+
+/* Make codes of the printable keys (digits through '/') and space. */
+static u8 gen_random_key(void) {
+  static const u8 keys[] = {
+      0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D,
+      0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B,
+      0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29,
+      0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x39,
+  };
+
+  return keys[get_random_u32() % ARRAY_SIZE(keys)];
+}
+
+/* Runs in hrtimer softirq context only, so the state needs no lock. */
+static void gen_emit_one(void) {
+  u8 code;
+
+  if (READ_ONCE(gen_pattern) == GEN_SEQUENCE) {
+    code = scancodes[seq_idx];
+    seq_idx = (seq_idx + 1) % ARRAY_SIZE(scancodes);
+  } else if (gen_pending_break >= 0) {
+    code = (u8)gen_pending_break;
+    gen_pending_break = -1;
+  } else {
+    code = gen_random_key();
+    gen_pending_break = code | 0x80;
+  }
+  buffer_push(code, KBD_PORT_GENERATOR, false);
+}
+
+static ktime_t gen_period(unsigned int rate, unsigned int burst) {
+  return ns_to_ktime(max_t(u64, div_u64((u64)burst * NSEC_PER_SEC, rate), 1000));
+}
+
+static enum hrtimer_restart gen_timer_fn(struct hrtimer *t) {
+  unsigned int rate = READ_ONCE(gen_rate);
+  unsigned int burst = max(READ_ONCE(gen_burst), 1u);
+  u64 periods, i;
+
+  if (!rate)
+    return HRTIMER_NORESTART;
+
+  /* Make up for late expiries so the average rate holds, within reason. */
+  periods = hrtimer_forward_now(t, gen_period(rate, burst));
+  periods = clamp_t(u64, periods, 1, GEN_MAX_CATCHUP);
+  for (i = 0; i < periods * burst; i++)
+    gen_emit_one();
+  return HRTIMER_RESTART;
+}
+
+static void gen_restart(void) {
+  unsigned int rate = READ_ONCE(gen_rate);
+
+  hrtimer_cancel(&gen_timer);
+  if (rate)
+    hrtimer_start(&gen_timer, gen_period(rate, max(READ_ONCE(gen_burst), 1u)),
+                  HRTIMER_MODE_REL_SOFT);
+}
+
+static int gen_rate_set(const char *val, const struct kernel_param *kp) {
+  int ret = param_set_uint(val, kp);
+
+  if (ret)
+    return ret;
+  /* Before init the timer does not exist yet; init starts it. */
+  if (READ_ONCE(gen_ready))
+    gen_restart();
+  return 0;
 }
 
 static inline bool get_arg_data_byte(struct pt_regs *regs, u8 *out)
@@ -110,38 +998,472 @@ static inline bool get_arg_data_byte(struct pt_regs *regs, u8 *out)
 #endif
 }
 
-//TODO for me: monitor serio port
+/* Both hooked symbols take (struct serio *serio, unsigned char data, ...). */
+static inline struct serio *get_arg_serio(struct pt_regs *regs)
+{
+#if defined(CONFIG_X86_64)
+    return (struct serio *)regs->di;
+#elif defined(CONFIG_ARM64)
+    return (struct serio *)regs->regs[0];
+#else
+    /* Stack-passed args: report everything as port 0. */
+    (void)regs;
+    return NULL;
+#endif
+}
+
+static void note_handler_ns(u64 ns) {
+    unsigned int bucket = min_t(unsigned int, fls64(ns >> 6), HIST_BUCKETS - 1);
+
+    this_cpu_inc(kbd_stats.handler_hist[bucket]);
+}
+
 static int kp_pre_handler(struct kprobe *p, struct pt_regs *regs)
 {
+    u64 start = ktime_get_ns();
     u8 data;
+    u8 port;
+    u64 ns;
+
     if (get_arg_data_byte(regs, &data)){
-        buffer_push(data);
-        pr_info("scancode : %d", data);
+        port = port_index(get_arg_serio(regs));
+        if (port == KBD_PORT_NONE) {
+            this_cpu_inc(kbd_stats.dropped);
+            return 0;
+        }
+        buffer_push(data, port, false);
+        ns = ktime_get_ns() - start;
+        note_handler_ns(ns);
+        trace_kbd_capture(port, data, ns);
     }
     return 0;
 }
 
 
-//TODO for me: use wait_queue
 static ssize_t kbd_sim_read(struct file *file, char __user *buf, size_t len, loff_t *ppos) {
-  if (kfifo_is_empty(&kbd_fifo)) {
-    if (file->f_flags & O_NONBLOCK)
-      return -EAGAIN;
+  ssize_t ret;
+
+  if (record_format) {
+    if (len < sizeof(struct kbd_event))
+      return -EINVAL;
+    /* Only hand out whole records; buffer_pop chunks are record multiples. */
+    len = rounddown(len, sizeof(struct kbd_event));
+  }
+  if (len == 0)
+    return 0;
+
+  for (;;) {
+    ret = percpu ? pcpu_pop(buf, len) : buffer_pop(buf, len);
+    if (ret != 0)
+      break;
+
+    if (file->f_flags & O_NONBLOCK) {
+      ret = -EAGAIN;
+      break;
+    }
+
+    /* Another reader may drain the fifo between wakeup and pop; loop again. */
+    if (wait_event_interruptible(read_wait, !buffer_empty())) {
+      ret = -ERESTARTSYS;
+      break;
+    }
+  }
+
+  if (ret > 0) {
+    this_cpu_inc(kbd_stats.reads);
+    this_cpu_add(kbd_stats.read_bytes, ret);
+  }
+  trace_kbd_read(len, ret);
+  return ret;
+}
+
+/*
+ * Injects a raw scancode stream through the same path as captured bytes.
+ * Under the block overflow policy the writer sleeps until there is room.
+ */
+static ssize_t kbd_sim_write(struct file *file, const char __user *buf, size_t len, loff_t *ppos) {
+  unsigned char tmp[256];
+  size_t done = 0;
+
+  if (mutex_lock_interruptible(&inject_lock))
+    return -ERESTARTSYS;
+  while (done < len) {
+    size_t chunk = min_t(size_t, len - done, sizeof(tmp));
+    size_t i;
+
+    if (copy_from_user(tmp, buf + done, chunk)) {
+      mutex_unlock(&inject_lock);
+      return done ? (ssize_t)done : -EFAULT;
+    }
+    for (i = 0; i < chunk; i++)
+      buffer_push(tmp[i], KBD_PORT_INJECT, true);
+    done += chunk;
+
+    if (signal_pending(current))
+      break;
+    cond_resched();
+  }
+  mutex_unlock(&inject_lock);
+  return done;
+}
+
+static __poll_t kbd_sim_poll(struct file *file, poll_table *wait) {
+  bool ready;
+
+  poll_wait(file, &read_wait, wait);
+  /* private_data outlives the mapping; after munmap bytes go to the buffers. */
+  if (file->private_data == ring_hdr && ring_active())
+    ready = !ring_empty();
+  else
+    ready = !buffer_empty();
+  return ready ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static void kbd_stats_sum(struct kbd_stats *sum) {
+  unsigned int i;
+  int cpu;
+
+  memset(sum, 0, sizeof(*sum));
+  for_each_possible_cpu(cpu) {
+    const struct kbd_stats *st = per_cpu_ptr(&kbd_stats, cpu);
+
+    sum->captured += READ_ONCE(st->captured);
+    sum->dropped += READ_ONCE(st->dropped);
+    sum->reads += READ_ONCE(st->reads);
+    sum->read_bytes += READ_ONCE(st->read_bytes);
+    sum->high_water = max(sum->high_water, READ_ONCE(st->high_water));
+    for (i = 0; i < HIST_BUCKETS; i++)
+      sum->handler_hist[i] += READ_ONCE(st->handler_hist[i]);
+  }
+}
+
+static int kbd_stats_show(struct seq_file *m, void *unused) {
+  struct kbd_stats sum;
+  unsigned int i;
+
+  kbd_stats_sum(&sum);
+
+  seq_printf(m, "captured: %llu\n", sum.captured);
+  seq_printf(m, "dropped: %llu\n", sum.dropped);
+  seq_printf(m, "reads: %llu\n", sum.reads);
+  seq_printf(m, "read_bytes: %llu\n", sum.read_bytes);
+  seq_printf(m, "fifo_size: %u%s\n", READ_ONCE(fifo_size), percpu ? " per cpu" : "");
+  seq_printf(m, "overflow: %s\n", overflow_names[READ_ONCE(overflow_policy)]);
+  seq_printf(m, "fifo_high_water: %u\n", sum.high_water);
+  seq_printf(m, "aggregate: %s\n", READ_ONCE(aggregate) ? "on" : "off");
+  seq_puts(m, "handler_ns:\n");
+  for (i = 0; i < HIST_BUCKETS; i++) {
+    if (i == HIST_BUCKETS - 1)
+      seq_printf(m, "  >=%llu: %llu\n", 64ull << (i - 1), sum.handler_hist[i]);
+    else
+      seq_printf(m, "  <%llu: %llu\n", 64ull << i, sum.handler_hist[i]);
+  }
+  for (i = 0; i < MAX_PORTS; i++) {
+    const struct kbd_port *p = &port_nodes[i];
+
+    if (READ_ONCE(p->registered))
+      seq_printf(m, "%s: captured %llu dropped %llu readers %d\n", p->name,
+                 READ_ONCE(p->captured), READ_ONCE(p->dropped), atomic_read(&p->readers));
+  }
+  return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(kbd_stats);
+
+static void kbd_key_counts_sum(struct kbd_key_counts *sum) {
+  unsigned int i;
+  int cpu;
+
+  memset(sum, 0, sizeof(*sum));
+  for_each_possible_cpu(cpu) {
+    const struct kbd_key_pcpu *k = per_cpu_ptr(&kbd_keys, cpu);
+
+    for (i = 0; i < KBD_KEY_COUNT; i++)
+      sum->presses[i] += READ_ONCE(k->presses[i]);
+    sum->printable += READ_ONCE(k->printable);
   }
-  return buffer_pop(buf, len);
+  for (i = 0; i < KBD_KEY_COUNT; i++)
+    sum->total += sum->presses[i];
+  sum->enabled = READ_ONCE(aggregate);
+}
+
+/* The snapshot is 2 KiB, too much for the ioctl's stack frame. */
+static long kbd_key_counts_copy(void __user *argp) {
+  struct kbd_key_counts *sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+  long ret;
+
+  if (!sum)
+    return -ENOMEM;
+  kbd_key_counts_sum(sum);
+  ret = copy_to_user(argp, sum, sizeof(*sum)) ? -EFAULT : 0;
+  kfree(sum);
+  return ret;
+}
+
+static long kbd_sim_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+  void __user *argp = (void __user *)arg;
+  struct kbd_fifo_info info = {};
+  struct kbd_stats sum;
+  u32 format, value;
+
+  switch (cmd) {
+  case KBD_IOC_GET_FORMAT:
+    format = record_format ? KBD_FORMAT_RECORD : KBD_FORMAT_RAW;
+    return put_user(format, (u32 __user *)argp);
+  case KBD_IOC_GET_FIFO_INFO:
+    kbd_stats_sum(&sum);
+    info.fifo_size = READ_ONCE(fifo_size);
+    info.overflow = READ_ONCE(overflow_policy);
+    info.percpu = percpu;
+    info.high_water = sum.high_water;
+    info.captured = sum.captured;
+    info.dropped = sum.dropped;
+    return copy_to_user(argp, &info, sizeof(info)) ? -EFAULT : 0;
+  case KBD_IOC_SET_FIFO_SIZE:
+    if (!(file->f_mode & FMODE_WRITE))
+      return -EBADF;
+    if (get_user(value, (u32 __user *)argp))
+      return -EFAULT;
+    if (value == 0 || value > MAX_FIFO_EVENTS)
+      return -EINVAL;
+    /* Resizing discards pending events: only while nobody else uses them. */
+    if (atomic_read(&open_count) != 1 || ring_active())
+      return -EBUSY;
+    return buffers_resize(value);
+  case KBD_IOC_SET_OVERFLOW:
+    if (!(file->f_mode & FMODE_WRITE))
+      return -EBADF;
+    if (get_user(value, (u32 __user *)argp))
+      return -EFAULT;
+    if (value >= ARRAY_SIZE(overflow_names))
+      return -EINVAL;
+    WRITE_ONCE(overflow_policy, value);
+    wake_up_interruptible(&space_wait);
+    return 0;
+  case KBD_IOC_GET_KEY_COUNTS:
+    return kbd_key_counts_copy(argp);
+  default:
+    return -ENOTTY;
+  }
+}
+
+static void kbd_ring_vm_open(struct vm_area_struct *vma) {
+  atomic_inc(&ring_maps);
+}
+
+static void kbd_ring_vm_close(struct vm_area_struct *vma) {
+  atomic_dec(&ring_maps);
+}
+
+static const struct vm_operations_struct kbd_ring_vm_ops = {
+    .open = kbd_ring_vm_open,
+    .close = kbd_ring_vm_close,
+};
+
+/*
+ * Maps the header page plus ring data. Only one consumer may own the ring;
+ * while it is mapped, captured bytes go to the ring instead of the fifo.
+ * The consumer index lives in the mapping, so the fd must be open for write.
+ */
+static int kbd_sim_mmap(struct file *file, struct vm_area_struct *vma) {
+  unsigned long flags;
+  int ret;
+
+  if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != ring_mem_size())
+    return -EINVAL;
+  if (!(vma->vm_flags & VM_SHARED) || !(file->f_mode & FMODE_WRITE))
+    return -EACCES;
+  if (atomic_cmpxchg(&ring_maps, 0, 1) != 0)
+    return -EBUSY;
+
+  ret = remap_vmalloc_range(vma, ring_mem, 0);
+  if (ret) {
+    atomic_dec(&ring_maps);
+    return ret;
+  }
+
+  /* Start the new consumer on an empty ring. */
+  spin_lock_irqsave(&buffer_lock, flags);
+  WRITE_ONCE(ring_hdr->consumer, ring_prod);
+  spin_unlock_irqrestore(&buffer_lock, flags);
+
+  vma->vm_ops = &kbd_ring_vm_ops;
+  file->private_data = ring_hdr;
+  return 0;
+}
+
+static int kbd_ring_alloc(void) {
+  u32 size = roundup_pow_of_two(clamp_t(u32, ring_size, PAGE_SIZE, 1u << 24));
+
+  /* Report the effective size through the read-only parameter. */
+  ring_size = size;
+  ring_mask = size - 1;
+  ring_mem = vmalloc_user(ring_mem_size());
+  if (!ring_mem)
+    return -ENOMEM;
+
+  ring_hdr = ring_mem;
+  ring_data = (unsigned char *)ring_mem + PAGE_SIZE;
+  ring_hdr->magic = KBD_RING_MAGIC;
+  ring_hdr->version = KBD_RING_VERSION;
+  ring_hdr->data_offset = PAGE_SIZE;
+  ring_hdr->data_size = size;
+  return 0;
+}
+
+static int kbd_sim_open(struct inode *inode, struct file *file) {
+  atomic_inc(&open_count);
+  return 0;
+}
+
+static int kbd_sim_release(struct inode *inode, struct file *file) {
+  atomic_dec(&open_count);
+  return 0;
 }
 
 static const struct file_operations kbd_sim_fops = {
     .owner = THIS_MODULE,
+    .open = kbd_sim_open,
+    .release = kbd_sim_release,
     .read = kbd_sim_read,
+    .write = kbd_sim_write,
+    .poll = kbd_sim_poll,
+    .mmap = kbd_sim_mmap,
+    .unlocked_ioctl = kbd_sim_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
     .llseek = noop_llseek,
 };
 
+static struct kbd_port *port_of(struct file *file) {
+  /* misc_open() leaves the miscdevice in private_data. */
+  return container_of(file->private_data, struct kbd_port, misc);
+}
+
+static int kbd_port_open(struct inode *inode, struct file *file) {
+  atomic_inc(&port_of(file)->readers);
+  return 0;
+}
+
+static int kbd_port_release(struct inode *inode, struct file *file) {
+  struct kbd_port *p = port_of(file);
+  unsigned long flags;
+
+  /* The next opener starts from an empty fifo, like a fresh mmap ring. */
+  if (atomic_dec_and_test(&p->readers)) {
+    spin_lock_irqsave(&p->lock, flags);
+    kfifo_reset(&p->fifo);
+    spin_unlock_irqrestore(&p->lock, flags);
+  }
+  return 0;
+}
+
+static ssize_t kbd_port_read(struct file *file, char __user *buf, size_t len, loff_t *ppos) {
+  struct kbd_port *p = port_of(file);
+  unsigned int unit = event_unit();
+  unsigned char tmp[256];
+  unsigned long flags;
+  size_t copied = 0;
+  unsigned int n;
+
+  if (len < unit)
+    return -EINVAL;
+  len = rounddown(len, unit);
+
+  while (copied < len) {
+    /* sizeof(tmp) is a record multiple, so chunks stay whole records. */
+    spin_lock_irqsave(&p->lock, flags);
+    n = kfifo_out(&p->fifo, tmp, min_t(size_t, len - copied, sizeof(tmp)));
+    spin_unlock_irqrestore(&p->lock, flags);
+
+    if (n == 0) {
+      if (copied > 0)
+        break;
+      if (file->f_flags & O_NONBLOCK)
+        return -EAGAIN;
+      if (wait_event_interruptible(p->wait, !kfifo_is_empty(&p->fifo)))
+        return -ERESTARTSYS;
+      continue;
+    }
+    if (copy_to_user(buf + copied, tmp, n))
+      return -EFAULT;
+    copied += n;
+  }
+  return copied;
+}
+
+static __poll_t kbd_port_poll(struct file *file, poll_table *wait) {
+  struct kbd_port *p = port_of(file);
+
+  poll_wait(file, &p->wait, wait);
+  return kfifo_is_empty(&p->fifo) ? 0 : EPOLLIN | EPOLLRDNORM;
+}
+
+/* The stream format and this port's fifo counters; nothing is settable. */
+static long kbd_port_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+  struct kbd_port *p = port_of(file);
+  void __user *argp = (void __user *)arg;
+  struct kbd_fifo_info info = {};
+  unsigned long flags;
+  u32 format;
+
+  switch (cmd) {
+  case KBD_IOC_GET_FORMAT:
+    format = record_format ? KBD_FORMAT_RECORD : KBD_FORMAT_RAW;
+    return put_user(format, (u32 __user *)argp);
+  case KBD_IOC_GET_FIFO_INFO:
+    spin_lock_irqsave(&p->lock, flags);
+    info.fifo_size = kfifo_size(&p->fifo) / event_unit();
+    info.high_water = p->high_water;
+    info.captured = p->captured;
+    info.dropped = p->dropped;
+    spin_unlock_irqrestore(&p->lock, flags);
+    info.overflow = READ_ONCE(overflow_policy);
+    return copy_to_user(argp, &info, sizeof(info)) ? -EFAULT : 0;
+  default:
+    return -ENOTTY;
+  }
+}
+
+static const struct file_operations kbd_port_fops = {
+    .owner = THIS_MODULE,
+    .open = kbd_port_open,
+    .release = kbd_port_release,
+    .read = kbd_port_read,
+    .poll = kbd_port_poll,
+    .unlocked_ioctl = kbd_port_ioctl,
+    .compat_ioctl = compat_ptr_ioctl,
+    .llseek = noop_llseek,
+};
+
+static void kbd_ports_init(void) {
+  unsigned int i;
+
+  for (i = 0; i < MAX_PORTS; i++) {
+    spin_lock_init(&port_nodes[i].lock);
+    init_waitqueue_head(&port_nodes[i].wait);
+  }
+}
+
+/* Call after the kprobe is gone, so port_work cannot be queued again. */
+static void kbd_ports_exit(void) {
+  unsigned int i;
+
+  cancel_work_sync(&port_work);
+  for (i = 0; i < MAX_PORTS; i++) {
+    struct kbd_port *p = &port_nodes[i];
+
+    if (!p->registered)
+      continue;
+    misc_deregister(&p->misc);
+    kfifo_free(&p->fifo);
+    p->registered = false;
+  }
+}
+
 static struct miscdevice kbd_sim_device = {
     .minor = MISC_DYNAMIC_MINOR,
     .name = "kbd",
     .fops = &kbd_sim_fops,
-    .mode = 0444,
+    .mode = 0644,
 };
 
 static int try_register_kprobe(const char *sym)
@@ -160,9 +1482,32 @@ static int try_register_kprobe(const char *sym)
     return ret;
 }
 
+static void kbd_buffers_exit(void) {
+  buffers_free(rcu_dereference_protected(bufs, 1));
+  RCU_INIT_POINTER(bufs, NULL);
+  vfree(ring_mem);
+}
+
 static int __init kbd_sim_init(void) {
-  int ret = misc_register(&kbd_sim_device);
+  struct kbd_buffers *b;
+  int ret = kbd_ring_alloc();
+  if (ret) {
+    return ret;
+  }
+
+  b = buffers_alloc(fifo_size);
+  if (!b) {
+    vfree(ring_mem);
+    return -ENOMEM;
+  }
+  /* Report the effective (rounded) size through the parameter. */
+  fifo_size = b->mask + 1;
+  RCU_INIT_POINTER(bufs, b);
+  kbd_ports_init();
+
+  ret = misc_register(&kbd_sim_device);
   if (ret) {
+    kbd_buffers_exit();
     return ret;
   }
 
@@ -172,21 +1517,45 @@ static int __init kbd_sim_init(void) {
       ret = try_register_kprobe("atkbd_interrupt");
       if (ret != 0) {
           pr_err(MODULE_NAME ": register kprobe failed on both symbols (serio_interrupt, atkbd_interrupt): %d\n", ret);
+          kbd_ports_exit();
           misc_deregister(&kbd_sim_device);
+          kbd_buffers_exit();
           return ret;
       }
   }
 
-  //timer_setup(&sim_timer, sim_timer_fn, 0);
-  //mod_timer(&sim_timer, jiffies + msecs_to_jiffies(interval_ms));
-  pr_info(MODULE_NAME ": simulated scancode device /dev/kbd\n");
+  /* debugfs is optional; a failed create just leaves no stats file. */
+  debug_dir = debugfs_create_dir("kbd_sim", NULL);
+  debugfs_create_file("stats", 0444, debug_dir, NULL, &kbd_stats_fops);
+
+  ret = stress_start();
+  if (ret != 0) {
+      debugfs_remove_recursive(debug_dir);
+      unregister_kprobe(&kp);
+      kbd_ports_exit();
+      misc_deregister(&kbd_sim_device);
+      kbd_buffers_exit();
+      return ret;
+  }
+
+  hrtimer_setup(&gen_timer, gen_timer_fn, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+  WRITE_ONCE(gen_ready, true);
+  gen_restart();
+
+  pr_info(MODULE_NAME ": simulated scancode device /dev/kbd, serio ports on /dev/kbd0..%u\n",
+          MAX_PORTS - 1);
   return 0;
 }
 
 static void __exit kbd_sim_exit(void) {
-  //timer_delete_sync(&sim_timer);
+  WRITE_ONCE(gen_ready, false);
+  hrtimer_cancel(&gen_timer);
+  stress_stop();
+  debugfs_remove_recursive(debug_dir);
   misc_deregister(&kbd_sim_device);
   unregister_kprobe(&kp);
+  kbd_ports_exit();
+  kbd_buffers_exit();
 }
 
 module_init(kbd_sim_init);
@@ -0,0 +1,61 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM kbd_sim
+
+#if !defined(_KBD_SIM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _KBD_SIM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(kbd_capture,
+    TP_PROTO(u8 port, u8 scancode, u64 handler_ns),
+    TP_ARGS(port, scancode, handler_ns),
+    TP_STRUCT__entry(
+        __field(u8, port)
+        __field(u8, scancode)
+        __field(u64, handler_ns)
+    ),
+    TP_fast_assign(
+        __entry->port = port;
+        __entry->scancode = scancode;
+        __entry->handler_ns = handler_ns;
+    ),
+    TP_printk("port=%u scancode=0x%02x handler_ns=%llu",
+              __entry->port, __entry->scancode, __entry->handler_ns)
+);
+
+TRACE_EVENT(kbd_drop,
+    TP_PROTO(u8 port, u8 scancode),
+    TP_ARGS(port, scancode),
+    TP_STRUCT__entry(
+        __field(u8, port)
+        __field(u8, scancode)
+    ),
+    TP_fast_assign(
+        __entry->port = port;
+        __entry->scancode = scancode;
+    ),
+    TP_printk("port=%u scancode=0x%02x", __entry->port, __entry->scancode)
+);
+
+TRACE_EVENT(kbd_read,
+    TP_PROTO(size_t requested, ssize_t ret),
+    TP_ARGS(requested, ret),
+    TP_STRUCT__entry(
+        __field(size_t, requested)
+        __field(ssize_t, ret)
+    ),
+    TP_fast_assign(
+        __entry->requested = requested;
+        __entry->ret = ret;
+    ),
+    TP_printk("requested=%zu ret=%zd", __entry->requested, __entry->ret)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE kbd_sim_trace
+
+#include <trace/define_trace.h>
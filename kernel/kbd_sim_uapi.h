@@ -0,0 +1,119 @@
+#ifndef KBD_SIM_UAPI_H
+#define KBD_SIM_UAPI_H
+
+/*
+ * Interface shared by kbd_sim.ko and its userspace consumers (lib/).
+ * Only fixed-width types from <linux/types.h> so it builds on both sides.
+ */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Shared-memory ring exported through mmap() on /dev/kbd.
+ *
+ * The mapping starts with one page holding struct kbd_ring_header, followed
+ * by `data_size` bytes of scancode data. `producer` and `consumer` are
+ * free-running byte indices; the data offset of an index is
+ * `index & (data_size - 1)`. The kernel only writes `producer` and `dropped`,
+ * userspace only writes `consumer`. Each index lives on its own cache line.
+ */
+#define KBD_RING_MAGIC 0x6b626472u /* "kbdr" */
+#define KBD_RING_VERSION 1u
+
+struct kbd_ring_header {
+  __u32 magic;
+  __u32 version;
+  __u32 data_offset;
+  __u32 data_size;
+  __u64 dropped;
+  __u8 pad0[40];
+  __u32 producer;
+  __u8 pad1[60];
+  __u32 consumer;
+  __u8 pad2[60];
+};
+
+/*
+ * Stream formats. KBD_FORMAT_RAW emits one scancode byte per event;
+ * KBD_FORMAT_RECORD emits fixed-size struct kbd_event records. read()
+ * returns whole records only in record mode.
+ */
+#define KBD_FORMAT_RAW 0u
+#define KBD_FORMAT_RECORD 1u
+
+/*
+ * One captured scancode. `timestamp_ns` is CLOCK_MONOTONIC at capture time.
+ * `seq` increments for every captured byte, including bytes dropped on
+ * overflow, so a gap in `seq` is exactly the number of lost events.
+ * Records are 16 bytes so four share a cache line and none straddles the
+ * end of the mmap ring.
+ */
+struct kbd_event {
+  __u64 timestamp_ns;
+  __u32 seq;
+  __u8 port;
+  __u8 scancode;
+  __u8 flags;
+  __u8 reserved;
+};
+
+/* What happens when a capture buffer is full. */
+#define KBD_OVERFLOW_DROP_NEWEST 0u
+#define KBD_OVERFLOW_DROP_OLDEST 1u
+#define KBD_OVERFLOW_BLOCK 2u /* simulated producers wait; capture drops newest */
+
+/*
+ * Capture buffer configuration and counters. `fifo_size` is in events and
+ * applies per CPU when `percpu` is set. `dropped` counts every event lost
+ * to overflow, whichever policy discarded it.
+ */
+struct kbd_fifo_info {
+  __u32 fifo_size;
+  __u32 overflow;
+  __u32 percpu;
+  __u32 high_water;
+  __u64 captured;
+  __u64 dropped;
+};
+
+/*
+ * Events from serio port N are also delivered on /dev/kbdN (N < 8), in the
+ * same format, while that node is open. Port nodes are read-only, support
+ * KBD_IOC_GET_FORMAT and KBD_IOC_GET_FIFO_INFO (for their own fifo), and
+ * number `seq` per port. They appear once the port has produced a byte.
+ * Bytes from any further serio ports are counted as dropped.
+ */
+
+/* `port` values for events that did not come from a serio port. */
+#define KBD_PORT_GENERATOR 0xfeu /* hrtimer load generator, stress threads */
+#define KBD_PORT_INJECT 0xffu    /* bytes written to /dev/kbd */
+
+/*
+ * Key press counters kept in the kernel when the module is loaded with
+ * aggregate=1, so consumers that only need counts can skip the event
+ * stream. Key ids are set-1 make codes with 0x80 set for 0xE0-prefixed
+ * keys; breaks, Pause and the fake shifts around Print Screen are not
+ * counted. `printable` counts presses of keys that type a character on
+ * the US layout (keypad digits excluded, they depend on NumLock).
+ * Counters run from module load; consumers diff two snapshots.
+ */
+#define KBD_KEY_COUNT 256
+
+struct kbd_key_counts {
+  __u64 presses[KBD_KEY_COUNT];
+  __u64 total;
+  __u64 printable;
+  __u32 enabled; /* aggregate=1 right now */
+  __u32 reserved;
+};
+
+#define KBD_IOC_MAGIC 'k'
+#define KBD_IOC_GET_FORMAT _IOR(KBD_IOC_MAGIC, 1, __u32)
+#define KBD_IOC_GET_FIFO_INFO _IOR(KBD_IOC_MAGIC, 2, struct kbd_fifo_info)
+/* Needs a writable fd and no other opener; pending events are discarded. */
+#define KBD_IOC_SET_FIFO_SIZE _IOW(KBD_IOC_MAGIC, 3, __u32)
+#define KBD_IOC_SET_OVERFLOW _IOW(KBD_IOC_MAGIC, 4, __u32)
+#define KBD_IOC_GET_KEY_COUNTS _IOR(KBD_IOC_MAGIC, 5, struct kbd_key_counts)
+
+#endif
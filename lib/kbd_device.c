@@ -0,0 +1,65 @@
+#include "kbd_device.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
+int kbd_device_fifo_info(int fd, struct kbd_fifo_info *info) {
+  if (fd < 0 || !info) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(info, 0, sizeof(*info));
+  return ioctl(fd, KBD_IOC_GET_FIFO_INFO, info) == 0 ? 0 : -1;
+}
+
+int kbd_device_set_fifo_size(int fd, uint32_t events) {
+  __u32 value = events;
+  return ioctl(fd, KBD_IOC_SET_FIFO_SIZE, &value) == 0 ? 0 : -1;
+}
+
+int kbd_device_set_overflow(int fd, uint32_t policy) {
+  __u32 value = policy;
+  return ioctl(fd, KBD_IOC_SET_OVERFLOW, &value) == 0 ? 0 : -1;
+}
+
+const char *kbd_device_overflow_name(uint32_t policy) {
+  switch (policy) {
+    case KBD_OVERFLOW_DROP_NEWEST:
+      return "drop-newest";
+    case KBD_OVERFLOW_DROP_OLDEST:
+      return "drop-oldest";
+    case KBD_OVERFLOW_BLOCK:
+      return "block";
+    default:
+      return "unknown";
+  }
+}
+
+int kbd_device_key_counts(int fd, struct kbd_key_counts *counts) {
+  if (fd < 0 || !counts) {
+    errno = EINVAL;
+    return -1;
+  }
+  memset(counts, 0, sizeof(*counts));
+  return ioctl(fd, KBD_IOC_GET_KEY_COUNTS, counts) == 0 ? 0 : -1;
+}
+
+unsigned long kbd_device_key_delta(const struct kbd_key_counts *prev,
+                                   const struct kbd_key_counts *cur,
+                                   scancode_layout_t layout,
+                                   uint64_t *presses) {
+  if (!cur || !presses) {
+    return 0;
+  }
+  int reset = !prev || cur->total < prev->total;
+  unsigned long counted = 0;
+  for (size_t i = 0; i < KBD_KEY_COUNT; ++i) {
+    uint64_t before = reset ? 0 : prev->presses[i];
+    presses[i] = cur->presses[i] >= before ? cur->presses[i] - before : cur->presses[i];
+    if (presses[i] && scancode_key_counted(layout, (unsigned int)i)) {
+      counted += (unsigned long)presses[i];
+    }
+  }
+  return counted;
+}
@@ -0,0 +1,47 @@
+#ifndef KBD_DEVICE_H
+#define KBD_DEVICE_H
+
+#include <stdint.h>
+
+#include "kbd_sim_uapi.h"
+#include "scancode_map.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Thin wrappers over the /dev/kbd ioctls. All return 0 on success and -1
+ * with errno set on failure (ENOTTY for sources that are not the module).
+ */
+int kbd_device_fifo_info(int fd, struct kbd_fifo_info *info);
+int kbd_device_set_fifo_size(int fd, uint32_t events);
+int kbd_device_set_overflow(int fd, uint32_t policy);
+
+/*
+ * Returns "drop-newest", "drop-oldest", "block" or "unknown".
+ */
+const char *kbd_device_overflow_name(uint32_t policy);
+
+/*
+ * Snapshot of the kernel's key press counters (module parameter
+ * aggregate=1). Returns 0 or -1 with errno set.
+ */
+int kbd_device_key_counts(int fd, struct kbd_key_counts *counts);
+
+/*
+ * Presses between two snapshots, per key into `presses` (KBD_KEY_COUNT
+ * entries), and the characters they type on `layout`, which is returned.
+ * A `cur` behind `prev` means the module was reloaded, so `cur` counts
+ * from zero.
+ */
+unsigned long kbd_device_key_delta(const struct kbd_key_counts *prev,
+                                   const struct kbd_key_counts *cur,
+                                   scancode_layout_t layout,
+                                   uint64_t *presses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+#include "kbd_latency.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char *const stage_names[KBD_LAT_STAGES] = {"read", "decode", "queue", "paint", "total"};
+
+void kbd_latency_init(kbd_latency_t *latency) {
+  if (!latency) {
+    return;
+  }
+  memset(latency, 0, sizeof(*latency));
+}
+
+const char *kbd_latency_stage_name(kbd_latency_stage_t stage) {
+  return stage < KBD_LAT_STAGES ? stage_names[stage] : "unknown";
+}
+
+/* Clocks are monotonic, but stamps from different threads can tie. */
+static void record_span(kbd_latency_t *latency, kbd_latency_stage_t stage, uint64_t from, uint64_t to) {
+  kbd_hist_record(&latency->stages[stage], to > from ? to - from : 0);
+}
+
+void kbd_latency_drained(kbd_latency_t *latency, const kbd_reader_batch_t *batch, int captured,
+                         uint64_t now_ns) {
+  if (!latency || !batch || batch->read_ns == 0) {
+    return;
+  }
+  if (captured) {
+    record_span(latency, KBD_LAT_READ, batch->ts_ns, batch->read_ns);
+  }
+  record_span(latency, KBD_LAT_DECODE, batch->read_ns, batch->decode_ns);
+  record_span(latency, KBD_LAT_QUEUE, batch->decode_ns, now_ns);
+
+  if (latency->pending == KBD_LATENCY_PENDING) {
+    latency->unsampled++;
+    return;
+  }
+  latency->pending_origin[latency->pending] = captured ? batch->ts_ns : batch->read_ns;
+  latency->pending_drain[latency->pending] = now_ns;
+  latency->pending++;
+}
+
+void kbd_latency_painted(kbd_latency_t *latency, uint64_t now_ns) {
+  if (!latency) {
+    return;
+  }
+  for (size_t i = 0; i < latency->pending; ++i) {
+    record_span(latency, KBD_LAT_PAINT, latency->pending_drain[i], now_ns);
+    record_span(latency, KBD_LAT_TOTAL, latency->pending_origin[i], now_ns);
+  }
+  latency->pending = 0;
+}
+
+int kbd_latency_write_csv(const kbd_latency_t *latency, const char *path) {
+  if (!latency || !path) {
+    return -1;
+  }
+  size_t len = strlen(path);
+  char *tmp_path = malloc(len + sizeof(".tmp"));
+  if (!tmp_path) {
+    return -1;
+  }
+  memcpy(tmp_path, path, len);
+  memcpy(tmp_path + len, ".tmp", sizeof(".tmp"));
+  FILE *fp = fopen(tmp_path, "w");
+  if (!fp) {
+    free(tmp_path);
+    return -1;
+  }
+
+  fprintf(fp, "stage,count,min_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+  for (int s = 0; s < KBD_LAT_STAGES; ++s) {
+    const kbd_hist_t *hist = &latency->stages[s];
+    fprintf(fp, "%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n", stage_names[s],
+            (unsigned long long)hist->total, (unsigned long long)hist->min,
+            (unsigned long long)kbd_hist_percentile(hist, 50.0),
+            (unsigned long long)kbd_hist_percentile(hist, 90.0),
+            (unsigned long long)kbd_hist_percentile(hist, 99.0),
+            (unsigned long long)kbd_hist_percentile(hist, 99.9), (unsigned long long)hist->max);
+  }
+
+  int rc = fclose(fp) == 0 ? 0 : -1;
+  if (rc == 0 && rename(tmp_path, path) != 0) {
+    rc = -1;
+  }
+  if (rc != 0) {
+    unlink(tmp_path);
+  }
+  free(tmp_path);
+  return rc;
+}
@@ -0,0 +1,74 @@
+#ifndef KBD_LATENCY_H
+#define KBD_LATENCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kbd_reader.h"
+#include "kbd_timing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stages of a keystroke's trip from the kprobe to the screen. Capture is
+ * the kernel's timestamp (record format only); read and decode are stamped
+ * by the reader thread, drain when the GUI takes the batch off the queue
+ * and paint after the view has drawn it. TOTAL spans capture (or read, for
+ * raw streams) to paint.
+ */
+typedef enum {
+  KBD_LAT_READ = 0, /* capture -> read() returned */
+  KBD_LAT_DECODE,   /* read -> decoded into a queue slot */
+  KBD_LAT_QUEUE,    /* decoded -> drained by the consumer */
+  KBD_LAT_PAINT,    /* drained -> painted */
+  KBD_LAT_TOTAL,
+  KBD_LAT_STAGES
+} kbd_latency_stage_t;
+
+/* Batches drained but not yet painted; more than this go unsampled. */
+#define KBD_LATENCY_PENDING 4096
+
+/*
+ * Per-stage latency histograms. Only touched by the consumer thread: it
+ * feeds each drained batch, then marks the paint that showed them.
+ */
+typedef struct {
+  kbd_hist_t stages[KBD_LAT_STAGES];
+  uint64_t pending_origin[KBD_LATENCY_PENDING];
+  uint64_t pending_drain[KBD_LATENCY_PENDING];
+  size_t pending;
+  uint64_t unsampled;
+} kbd_latency_t;
+
+void kbd_latency_init(kbd_latency_t *latency);
+
+const char *kbd_latency_stage_name(kbd_latency_stage_t stage);
+
+/*
+ * Records the read, decode and queue stages of a batch drained at
+ * `now_ns` and holds it until the next kbd_latency_painted(). `captured`
+ * says whether `ts_ns` is a kernel capture time (record format) rather
+ * than the read time. Batches from a reader without `trace` are ignored.
+ */
+void kbd_latency_drained(kbd_latency_t *latency, const kbd_reader_batch_t *batch, int captured,
+                         uint64_t now_ns);
+
+/*
+ * Closes the paint and total stages of every pending batch.
+ */
+void kbd_latency_painted(kbd_latency_t *latency, uint64_t now_ns);
+
+/*
+ * Writes one line per stage: stage,count,min_ns,p50_ns,p90_ns,p99_ns,
+ * p999_ns,max_ns. The file is replaced atomically. Returns 0 on success
+ * or -1.
+ */
+int kbd_latency_write_csv(const kbd_latency_t *latency, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
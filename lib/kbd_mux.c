@@ -0,0 +1,183 @@
+#include "kbd_mux.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define KBD_MUX_EVENTS 64
+
+/*
+ * Level-triggered, so a pump that stops at EAGAIN loses nothing. A NULL
+ * pointer is the wake fd.
+ */
+static void *worker_main(void *arg) {
+  kbd_mux_worker_t *worker = arg;
+  struct epoll_event events[KBD_MUX_EVENTS];
+  for (;;) {
+    int n = epoll_wait(worker->epoll_fd, events, KBD_MUX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return NULL;
+    }
+    for (int i = 0; i < n; ++i) {
+      kbd_mux_source_t *source = events[i].data.ptr;
+      if (!source) {
+        return NULL;
+      }
+      if (kbd_reader_pump(&source->reader) != 0) {
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, source->reader.config.fd, NULL);
+        /* Last touch: the control thread may reuse the slot after this. */
+        __atomic_store_n(&source->state, KBD_MUX_CLOSED, __ATOMIC_RELEASE);
+      }
+    }
+  }
+}
+
+static void stop_workers(kbd_mux_t *mux, unsigned int count) {
+  for (unsigned int i = 0; i < count; ++i) {
+    kbd_mux_worker_t *worker = &mux->workers[i];
+    uint64_t one = 1;
+    while (write(worker->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+    pthread_join(worker->thread, NULL);
+  }
+  for (unsigned int i = 0; i < mux->worker_count; ++i) {
+    if (mux->workers[i].wake_fd >= 0) {
+      close(mux->workers[i].wake_fd);
+    }
+    if (mux->workers[i].epoll_fd >= 0) {
+      close(mux->workers[i].epoll_fd);
+    }
+  }
+}
+
+static int worker_init(kbd_mux_worker_t *worker) {
+  worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  worker->wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (worker->epoll_fd < 0 || worker->wake_fd < 0) {
+    return -1;
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  return epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &ev);
+}
+
+int kbd_mux_start(kbd_mux_t *mux, size_t max_sources, unsigned int workers) {
+  if (!mux || max_sources == 0) {
+    return -1;
+  }
+  memset(mux, 0, sizeof(*mux));
+  if (workers == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    workers = cpus > 0 ? (unsigned int)cpus : 1;
+  }
+  if (workers > KBD_MUX_MAX_WORKERS) {
+    workers = KBD_MUX_MAX_WORKERS;
+  }
+  if (workers > max_sources) {
+    workers = (unsigned int)max_sources;
+  }
+
+  mux->sources = calloc(max_sources, sizeof(*mux->sources));
+  mux->workers = calloc(workers, sizeof(*mux->workers));
+  if (!mux->sources || !mux->workers) {
+    free(mux->sources);
+    free(mux->workers);
+    return -1;
+  }
+  mux->source_count = max_sources;
+  mux->worker_count = workers;
+  for (unsigned int i = 0; i < workers; ++i) {
+    mux->workers[i].epoll_fd = -1;
+    mux->workers[i].wake_fd = -1;
+  }
+
+  unsigned int started = 0;
+  for (; started < workers; ++started) {
+    kbd_mux_worker_t *worker = &mux->workers[started];
+    if (worker_init(worker) != 0 || pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+      break;
+    }
+  }
+  if (started < workers) {
+    stop_workers(mux, started);
+    free(mux->sources);
+    free(mux->workers);
+    memset(mux, 0, sizeof(*mux));
+    return -1;
+  }
+  mux->running = 1;
+  return 0;
+}
+
+int kbd_mux_attach(kbd_mux_t *mux, size_t slot, const kbd_reader_config_t *config) {
+  if (!mux || !mux->running || slot >= mux->source_count || !config) {
+    return -1;
+  }
+  kbd_mux_source_t *source = &mux->sources[slot];
+  int state = __atomic_load_n(&source->state, __ATOMIC_ACQUIRE);
+  if (state == KBD_MUX_ACTIVE) {
+    return -1;
+  }
+  if (state == KBD_MUX_CLOSED) {
+    kbd_reader_stop(&source->reader);
+  }
+  __atomic_store_n(&source->state, KBD_MUX_FREE, __ATOMIC_RELAXED);
+  if (kbd_reader_init(&source->reader, config) != 0) {
+    return -1;
+  }
+
+  /* Published before the worker can see the fd. */
+  __atomic_store_n(&source->state, KBD_MUX_ACTIVE, __ATOMIC_RELEASE);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = source;
+  kbd_mux_worker_t *worker = &mux->workers[slot % mux->worker_count];
+  if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, config->fd, &ev) != 0) {
+    __atomic_store_n(&source->state, KBD_MUX_FREE, __ATOMIC_RELAXED);
+    kbd_reader_stop(&source->reader);
+    return -1;
+  }
+  return 0;
+}
+
+size_t kbd_mux_drain(kbd_mux_t *mux, size_t slot, kbd_reader_batch_t *out, size_t max) {
+  if (!mux || slot >= mux->source_count ||
+      __atomic_load_n(&mux->sources[slot].state, __ATOMIC_ACQUIRE) == KBD_MUX_FREE) {
+    return 0;
+  }
+  return kbd_reader_drain(&mux->sources[slot].reader, out, max);
+}
+
+int kbd_mux_status(const kbd_mux_t *mux, size_t slot, kbd_reader_status_t *out) {
+  if (!mux || !out || slot >= mux->source_count ||
+      __atomic_load_n(&mux->sources[slot].state, __ATOMIC_ACQUIRE) == KBD_MUX_FREE) {
+    return -1;
+  }
+  kbd_reader_status(&mux->sources[slot].reader, out);
+  return 0;
+}
+
+void kbd_mux_stop(kbd_mux_t *mux) {
+  if (!mux || !mux->running) {
+    return;
+  }
+  stop_workers(mux, mux->worker_count);
+  for (size_t i = 0; i < mux->source_count; ++i) {
+    if (mux->sources[i].state != KBD_MUX_FREE) {
+      kbd_reader_stop(&mux->sources[i].reader);
+    }
+  }
+  free(mux->sources);
+  free(mux->workers);
+  memset(mux, 0, sizeof(*mux));
+}
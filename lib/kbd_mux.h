@@ -0,0 +1,89 @@
+#ifndef KBD_MUX_H
+#define KBD_MUX_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "kbd_reader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KBD_MUX_MAX_WORKERS 64
+
+enum {
+  KBD_MUX_FREE = 0, /* never attached */
+  KBD_MUX_ACTIVE,   /* owned by its worker */
+  KBD_MUX_CLOSED,   /* source gone; the worker no longer touches it */
+};
+
+/*
+ * One device: a kbd_reader without a thread, so it keeps its own decoder,
+ * record sequence, display queue and stats flusher.
+ */
+typedef struct {
+  kbd_reader_t reader;
+  int state; /* KBD_MUX_*, handed between threads with atomics */
+} kbd_mux_source_t;
+
+typedef struct {
+  int epoll_fd;
+  int wake_fd;
+  pthread_t thread;
+} kbd_mux_worker_t;
+
+/*
+ * Reads many devices (one per serio port node, say) from a few threads.
+ * Slot i is served by worker i % workers, each with its own epoll set, so
+ * devices on different workers share no lock or reader thread, and more
+ * devices can be spread over more workers instead of loading one loop.
+ *
+ * One control thread attaches sources and drains them; the workers only
+ * pump. A worker detaches a source when it hits EOF or a read error and
+ * marks the slot closed, after which the control thread may attach a
+ * reopened device to it.
+ */
+typedef struct {
+  kbd_mux_source_t *sources;
+  size_t source_count;
+  kbd_mux_worker_t *workers;
+  unsigned int worker_count;
+  int running;
+} kbd_mux_t;
+
+/*
+ * Starts `workers` threads (0 for one per online CPU) for up to
+ * `max_sources` slots; there are never more workers than slots. Returns 0
+ * on success or -1.
+ */
+int kbd_mux_start(kbd_mux_t *mux, size_t max_sources, unsigned int workers);
+
+/*
+ * Attaches a device to a free or closed slot and starts reading it.
+ * `config->backend` is ignored; the workers wait in epoll. The fd must stay
+ * open until the slot is closed or the mux stopped. Returns 0, or -1 if the
+ * slot is active or out of range.
+ */
+int kbd_mux_attach(kbd_mux_t *mux, size_t slot, const kbd_reader_config_t *config);
+
+/*
+ * Moves up to `max` display batches of one slot into `out`.
+ */
+size_t kbd_mux_drain(kbd_mux_t *mux, size_t slot, kbd_reader_batch_t *out, size_t max);
+
+/*
+ * Counters of one slot. Returns 0, or -1 if nothing was ever attached.
+ */
+int kbd_mux_status(const kbd_mux_t *mux, size_t slot, kbd_reader_status_t *out);
+
+/*
+ * Joins the workers and frees every reader. The fds are left to the caller.
+ */
+void kbd_mux_stop(kbd_mux_t *mux);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,339 @@
+#include "kbd_reader.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+/*
+ * Decodes `len` codes captured at `ts_ns` and read at `read_ns` into
+ * batches, straight into the queue's free slots. When the queue is full the
+ * decode still runs (into a scratch batch) so modifier state and counts
+ * stay right.
+ */
+static void emit(kbd_reader_t *reader, const uint8_t *codes, size_t len, uint64_t ts_ns,
+                 uint64_t read_ns, unsigned long *counted) {
+  while (len > 0) {
+    kbd_reader_batch_t scratch;
+    kbd_reader_batch_t *batch = kbd_spsc_reserve(&reader->queue);
+    if (!batch) {
+      batch = &scratch;
+    }
+    size_t take = len < KBD_READER_BATCH_CODES ? len : KBD_READER_BATCH_CODES;
+    size_t consumed = 0;
+    unsigned long n = 0;
+    /* The text buffer exceeds SCANCODE_MAX_OUTPUT, so at least one code goes. */
+    batch->text_len = (uint8_t)scancode_process_batch(&reader->decoder, codes, take, batch->text,
+                                                      sizeof(batch->text), &consumed, &n);
+    batch->code_len = (uint8_t)consumed;
+    memcpy(batch->codes, codes, consumed);
+    batch->ts_ns = ts_ns;
+    batch->read_ns = read_ns;
+    batch->decode_ns = reader->config.trace ? kbd_record_now_ns() : 0;
+    batch->counted = (uint32_t)n;
+    *counted += n;
+
+    if (batch == &scratch) {
+      __atomic_store_n(&reader->dropped, reader->dropped + 1, __ATOMIC_RELAXED);
+    } else {
+      kbd_spsc_commit(&reader->queue);
+    }
+    codes += consumed;
+    len -= consumed;
+  }
+}
+
+/*
+ * Without a queue the text is only needed for its count, so whole reads
+ * are decoded in one pass into a throwaway buffer.
+ */
+static void count_only(kbd_reader_t *reader, const uint8_t *codes, size_t len, unsigned long *counted) {
+  char text[4096];
+  while (len > 0) {
+    size_t consumed = 0;
+    unsigned long n = 0;
+    scancode_process_batch(&reader->decoder, codes, len, text, sizeof(text), &consumed, &n);
+    *counted += n;
+    codes += consumed;
+    len -= consumed;
+  }
+}
+
+static void process(kbd_reader_t *reader, const uint8_t *data, size_t len, unsigned long *counted) {
+  stats_flusher_t *stats = reader->config.stats;
+  if (reader->config.format != KBD_FORMAT_RECORD) {
+    stats_flusher_record_keys(stats, data, len);
+    if (reader->config.no_queue) {
+      count_only(reader, data, len, counted);
+      return;
+    }
+    uint64_t now = kbd_record_now_ns();
+    emit(reader, data, len, now, reader->config.trace ? now : 0, counted);
+    return;
+  }
+
+  uint64_t read_ns = reader->config.trace ? kbd_record_now_ns() : 0;
+  struct kbd_event events[64];
+  uint8_t codes[64];
+  while (len > 0) {
+    size_t consumed = 0;
+    size_t count = kbd_record_reader_feed(&reader->records, data, len, events, 64, &consumed);
+    for (size_t i = 0; i < count; ++i) {
+      codes[i] = events[i].scancode;
+      if (!reader->config.no_queue) {
+        emit(reader, &codes[i], 1, events[i].timestamp_ns, read_ns, counted);
+      }
+    }
+    if (reader->config.no_queue) {
+      count_only(reader, codes, count, counted);
+    }
+    stats_flusher_record_keys(stats, codes, count);
+    data += consumed;
+    len -= consumed;
+  }
+  __atomic_store_n(&reader->events, reader->records.events, __ATOMIC_RELAXED);
+  __atomic_store_n(&reader->lost, reader->records.lost, __ATOMIC_RELAXED);
+}
+
+/*
+ * Consumes everything available. Returns -1 once the source is gone.
+ */
+static int pump(kbd_reader_t *reader) {
+  unsigned long counted = 0;
+  int rc = 0;
+  if (reader->config.ring) {
+    const uint8_t *span = NULL;
+    size_t avail = 0;
+    while ((avail = kbd_ring_peek(reader->config.ring, &span)) > 0) {
+      process(reader, span, avail, &counted);
+      kbd_ring_consume(reader->config.ring, avail);
+    }
+  } else {
+    uint8_t buf[4096];
+    ssize_t n = 0;
+    while ((n = read(reader->config.fd, buf, sizeof(buf))) > 0) {
+      process(reader, buf, (size_t)n, &counted);
+    }
+    /* /dev/kbd never returns 0 for a non-empty read; EOF means a pipe closed. */
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+      rc = -1;
+    }
+  }
+  stats_flusher_record(reader->config.stats, counted);
+  return rc;
+}
+
+#define TAG_WAKE UINT64_MAX
+#define TAG_POLL (UINT64_MAX - 1)
+#define TAG_READ 0
+
+/*
+ * io_uring loop: one read in flight, gated on POLLIN because the fd is
+ * O_NONBLOCK, plus a poll on the wake fd. Returns when stopped or when the
+ * source is gone (-1).
+ */
+static int uring_loop(kbd_reader_t *reader) {
+  kbd_uring_t *uring = &reader->uring;
+  int fd = reader->config.fd;
+  if (kbd_uring_poll(uring, reader->wake_fd, TAG_WAKE) != 0 ||
+      kbd_uring_read(uring, fd, 0, TAG_READ, TAG_POLL) != 0) {
+    return -1;
+  }
+  kbd_uring_cqe_t cqes[8];
+  for (;;) {
+    if (kbd_uring_submit(uring, 1) != 0) {
+      return -1;
+    }
+    size_t n = kbd_uring_reap(uring, cqes, 8);
+    unsigned long counted = 0;
+    int rc = 0;
+    for (size_t i = 0; i < n; ++i) {
+      if (cqes[i].user_data == TAG_WAKE) {
+        /* Stop, but only after the rest: reaped reads already took their bytes. */
+        rc = 1;
+        continue;
+      }
+      if (cqes[i].user_data == TAG_POLL) {
+        continue; /* a failed poll cancels its read, handled below */
+      }
+      int32_t res = cqes[i].res;
+      if (res > 0) {
+        process(reader, kbd_uring_buffer(uring, 0), (size_t)res, &counted);
+      } else if (res == 0 || (res != -EAGAIN && res != -EINTR && res != -ECANCELED)) {
+        rc = -1; /* EOF or a read error, as in pump() */
+        break;
+      }
+      /* The buffer is free again once processed; queue the next read. */
+      if (rc == 0 && kbd_uring_read(uring, fd, 0, TAG_READ, TAG_POLL) != 0) {
+        rc = -1;
+        break;
+      }
+    }
+    stats_flusher_record(reader->config.stats, counted);
+    if (rc != 0) {
+      return rc > 0 ? 0 : -1;
+    }
+  }
+}
+
+static void *reader_main(void *arg) {
+  kbd_reader_t *reader = arg;
+  if (reader->backend == KBD_READER_BACKEND_URING) {
+    if (uring_loop(reader) != 0) {
+      __atomic_store_n(&reader->closed, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+  }
+  struct pollfd fds[2] = {
+      {reader->config.fd, POLLIN, 0},
+      {reader->wake_fd, POLLIN, 0},
+  };
+  for (;;) {
+    if (pump(reader) != 0) {
+      break;
+    }
+    if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+      break;
+    }
+    if (fds[1].revents & POLLIN) {
+      return NULL;
+    }
+  }
+  __atomic_store_n(&reader->closed, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/* Everything but the thread and backend; on failure nothing is left to free. */
+static int reader_setup(kbd_reader_t *reader, const kbd_reader_config_t *config) {
+  if (!reader || !config || config->fd < 0) {
+    return -1;
+  }
+  memset(reader, 0, sizeof(*reader));
+  reader->config = *config;
+  reader->wake_fd = -1;
+  size_t capacity = config->queue_capacity ? config->queue_capacity : KBD_READER_DEFAULT_QUEUE;
+  if (!config->no_queue && kbd_spsc_init(&reader->queue, capacity, sizeof(kbd_reader_batch_t)) != 0) {
+    return -1;
+  }
+  scancode_state_init_layout(&reader->decoder, config->layout);
+  kbd_record_reader_init(&reader->records);
+  reader->backend = KBD_READER_BACKEND_POLL;
+  return 0;
+}
+
+int kbd_reader_init(kbd_reader_t *reader, const kbd_reader_config_t *config) {
+  if (reader_setup(reader, config) != 0) {
+    return -1;
+  }
+  reader->running = 1;
+  return 0;
+}
+
+int kbd_reader_pump(kbd_reader_t *reader) {
+  if (!reader || !reader->running || reader->threaded || reader->closed) {
+    return -1;
+  }
+  if (pump(reader) != 0) {
+    __atomic_store_n(&reader->closed, 1, __ATOMIC_RELEASE);
+    return -1;
+  }
+  return 0;
+}
+
+int kbd_reader_start(kbd_reader_t *reader, const kbd_reader_config_t *config) {
+  if (reader_setup(reader, config) != 0) {
+    return -1;
+  }
+
+  /* A mapped ring is drained in place, so there is nothing to read into. */
+  if (!config->ring && config->backend != KBD_READER_BACKEND_POLL) {
+    if (kbd_uring_init(&reader->uring, 8, 1, KBD_READER_URING_BUFFER) == 0) {
+      reader->backend = KBD_READER_BACKEND_URING;
+    } else if (config->backend == KBD_READER_BACKEND_URING) {
+      kbd_spsc_free(&reader->queue);
+      return -1;
+    }
+  }
+
+  reader->wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (reader->wake_fd < 0 || pthread_create(&reader->thread, NULL, reader_main, reader) != 0) {
+    if (reader->wake_fd >= 0) {
+      close(reader->wake_fd);
+    }
+    if (reader->backend == KBD_READER_BACKEND_URING) {
+      kbd_uring_free(&reader->uring);
+    }
+    kbd_spsc_free(&reader->queue);
+    return -1;
+  }
+  reader->threaded = 1;
+  reader->running = 1;
+  return 0;
+}
+
+size_t kbd_reader_drain(kbd_reader_t *reader, kbd_reader_batch_t *out, size_t max) {
+  if (!reader || !reader->running || reader->config.no_queue || !out) {
+    return 0;
+  }
+  size_t n = 0;
+  while (n < max && kbd_spsc_pop(&reader->queue, &out[n]) == 0) {
+    ++n;
+  }
+  return n;
+}
+
+void kbd_reader_status(const kbd_reader_t *reader, kbd_reader_status_t *out) {
+  if (!reader || !out) {
+    return;
+  }
+  out->events = __atomic_load_n(&reader->events, __ATOMIC_RELAXED);
+  out->lost = __atomic_load_n(&reader->lost, __ATOMIC_RELAXED);
+  out->dropped = __atomic_load_n(&reader->dropped, __ATOMIC_RELAXED);
+  out->closed = __atomic_load_n(&reader->closed, __ATOMIC_ACQUIRE);
+  out->backend = reader->backend;
+}
+
+const char *kbd_reader_backend_name(kbd_reader_backend_t backend) {
+  switch (backend) {
+    case KBD_READER_BACKEND_POLL:
+      return "poll";
+    case KBD_READER_BACKEND_URING:
+      return "io_uring";
+    default:
+      return "auto";
+  }
+}
+
+int kbd_reader_backend_from_name(const char *name) {
+  if (!name || strcmp(name, "auto") == 0) {
+    return KBD_READER_BACKEND_AUTO;
+  }
+  if (strcmp(name, "poll") == 0) {
+    return KBD_READER_BACKEND_POLL;
+  }
+  if (strcmp(name, "uring") == 0 || strcmp(name, "io_uring") == 0) {
+    return KBD_READER_BACKEND_URING;
+  }
+  return -1;
+}
+
+void kbd_reader_stop(kbd_reader_t *reader) {
+  if (!reader || !reader->running) {
+    return;
+  }
+  if (reader->threaded) {
+    uint64_t one = 1;
+    while (write(reader->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+    pthread_join(reader->thread, NULL);
+    close(reader->wake_fd);
+    reader->wake_fd = -1;
+    reader->threaded = 0;
+  }
+  if (reader->backend == KBD_READER_BACKEND_URING) {
+    kbd_uring_free(&reader->uring);
+  }
+  kbd_spsc_free(&reader->queue);
+  reader->running = 0;
+}
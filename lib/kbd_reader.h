@@ -0,0 +1,143 @@
+#ifndef KBD_READER_H
+#define KBD_READER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kbd_record.h"
+#include "kbd_ring.h"
+#include "kbd_spsc.h"
+#include "kbd_uring.h"
+#include "scancode_map.h"
+#include "stats_flusher.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KBD_READER_BATCH_CODES 16
+#define KBD_READER_BATCH_TEXT 48
+#define KBD_READER_DEFAULT_QUEUE 4096
+#define KBD_READER_URING_BUFFER 16384
+
+typedef enum {
+  KBD_READER_BACKEND_AUTO = 0, /* io_uring when the kernel allows it, else poll */
+  KBD_READER_BACKEND_POLL,     /* poll() + read() until EAGAIN */
+  KBD_READER_BACKEND_URING,    /* io_uring only; start fails without it */
+} kbd_reader_backend_t;
+
+/*
+ * Up to KBD_READER_BATCH_CODES scancodes sharing one timestamp and the
+ * UTF-8 text they decoded to. `ts_ns` is the capture time for record-format
+ * devices and the read time for raw streams (CLOCK_MONOTONIC either way).
+ * With `trace` set in the config, `read_ns` and `decode_ns` stamp when the
+ * bytes were read and when the batch was decoded; both are 0 otherwise.
+ */
+typedef struct {
+  uint64_t ts_ns;
+  uint64_t read_ns;
+  uint64_t decode_ns;
+  uint32_t counted;
+  uint8_t code_len;
+  uint8_t text_len;
+  uint8_t codes[KBD_READER_BATCH_CODES];
+  char text[KBD_READER_BATCH_TEXT];
+} kbd_reader_batch_t;
+
+typedef struct {
+  int fd;                 /* O_NONBLOCK; must stay open until kbd_reader_stop() */
+  unsigned int format;    /* KBD_FORMAT_RAW or KBD_FORMAT_RECORD */
+  kbd_ring_t *ring;       /* mapped ring to drain instead of read(), or NULL */
+  scancode_layout_t layout;
+  size_t queue_capacity;  /* batches; 0 for KBD_READER_DEFAULT_QUEUE */
+  stats_flusher_t *stats; /* counts and key matrix are fed here, or NULL */
+  int trace;              /* stamp read_ns/decode_ns on every batch */
+  int no_queue;           /* count into `stats` only; nothing to drain */
+  kbd_reader_backend_t backend; /* ignored with `ring`, which is always polled */
+} kbd_reader_config_t;
+
+/*
+ * Capture thread: polls the device, decodes with its own scancode state and
+ * commits batches to a lock-free SPSC queue that another thread drains.
+ * Counting into `stats` happens on this thread too, so a stalled consumer
+ * only loses display batches (counted in `dropped`), never counts.
+ *
+ * With the io_uring backend each wakeup is a single io_uring_enter(): it
+ * submits a poll-gated read into a registered buffer and waits for it,
+ * where the poll backend needs poll() plus reads until EAGAIN. Only one
+ * read is in flight per device, since concurrent reads of a stream may
+ * complete out of order.
+ */
+typedef struct {
+  kbd_reader_config_t config;
+  kbd_spsc_t queue;
+  scancode_state_t decoder;
+  kbd_record_reader_t records;
+  kbd_reader_backend_t backend; /* POLL or URING, as resolved at start */
+  kbd_uring_t uring;
+  pthread_t thread;
+  int wake_fd;
+  int running;  /* set up; drain and stop are valid */
+  int threaded; /* started with kbd_reader_start() */
+  /* Updated by the reader thread with atomic stores. */
+  uint64_t events;
+  uint64_t lost;
+  uint64_t dropped;
+  int closed; /* EOF or a read error ended the thread */
+} kbd_reader_t;
+
+typedef struct {
+  uint64_t events;  /* records seen (record format only) */
+  uint64_t lost;    /* records missing from the sequence */
+  uint64_t dropped; /* batches discarded because the queue was full */
+  int closed;
+  kbd_reader_backend_t backend;
+} kbd_reader_status_t;
+
+/*
+ * Starts the reader thread. Returns 0 on success or -1.
+ */
+int kbd_reader_start(kbd_reader_t *reader, const kbd_reader_config_t *config);
+
+/*
+ * Sets up the decoder, record reader and queue without a thread, for a
+ * caller that multiplexes many devices (see kbd_mux.h). The caller calls
+ * kbd_reader_pump() whenever the fd is readable; `backend` is ignored and
+ * reported as poll. Returns 0 on success or -1.
+ */
+int kbd_reader_init(kbd_reader_t *reader, const kbd_reader_config_t *config);
+
+/*
+ * Reads and decodes everything available on a reader set up with
+ * kbd_reader_init(), from the single thread that owns it. Returns 0, or
+ * -1 once the source is gone (EOF or a read error; `closed` is then set).
+ */
+int kbd_reader_pump(kbd_reader_t *reader);
+
+/*
+ * Consumer side: moves up to `max` batches into `out` and returns how many.
+ * Only one thread may drain.
+ */
+size_t kbd_reader_drain(kbd_reader_t *reader, kbd_reader_batch_t *out, size_t max);
+
+void kbd_reader_status(const kbd_reader_t *reader, kbd_reader_status_t *out);
+
+const char *kbd_reader_backend_name(kbd_reader_backend_t backend);
+
+/*
+ * Parses "auto", "poll" or "uring". Returns the backend or -1.
+ */
+int kbd_reader_backend_from_name(const char *name);
+
+/*
+ * Wakes and joins the thread, if any, and frees the queue. The fd and ring
+ * are left to the caller.
+ */
+void kbd_reader_stop(kbd_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#include "kbd_record.h"
+
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+void kbd_record_reader_init(kbd_record_reader_t *reader) {
+  if (!reader) {
+    return;
+  }
+  memset(reader, 0, sizeof(*reader));
+}
+
+static void account(kbd_record_reader_t *reader, const struct kbd_event *ev) {
+  if (reader->have_seq) {
+    reader->lost += (uint32_t)(ev->seq - reader->next_seq);
+  }
+  reader->next_seq = ev->seq + 1;
+  reader->have_seq = 1;
+  reader->events++;
+}
+
+size_t kbd_record_reader_feed(kbd_record_reader_t *reader,
+                              const unsigned char *data,
+                              size_t len,
+                              struct kbd_event *out,
+                              size_t out_cap,
+                              size_t *consumed) {
+  size_t used = 0;
+  size_t count = 0;
+
+  if (!reader || (!data && len > 0) || !out) {
+    if (consumed) {
+      *consumed = 0;
+    }
+    return 0;
+  }
+
+  if (reader->pending_len > 0 && out_cap > 0) {
+    size_t need = sizeof(struct kbd_event) - reader->pending_len;
+    size_t take = len < need ? len : need;
+    memcpy(reader->pending + reader->pending_len, data, take);
+    reader->pending_len += take;
+    used += take;
+    if (reader->pending_len == sizeof(struct kbd_event)) {
+      memcpy(&out[count], reader->pending, sizeof(struct kbd_event));
+      account(reader, &out[count]);
+      count++;
+      reader->pending_len = 0;
+    }
+  }
+
+  while (count < out_cap && len - used >= sizeof(struct kbd_event)) {
+    memcpy(&out[count], data + used, sizeof(struct kbd_event));
+    account(reader, &out[count]);
+    used += sizeof(struct kbd_event);
+    count++;
+  }
+
+  if (count < out_cap && reader->pending_len == 0 && used < len) {
+    size_t rest = len - used;
+    memcpy(reader->pending, data + used, rest);
+    reader->pending_len = rest;
+    used = len;
+  }
+
+  if (consumed) {
+    *consumed = used;
+  }
+  return count;
+}
+
+unsigned int kbd_record_device_format(int fd) {
+  __u32 format = KBD_FORMAT_RAW;
+  if (fd < 0 || ioctl(fd, KBD_IOC_GET_FORMAT, &format) != 0) {
+    return KBD_FORMAT_RAW;
+  }
+  return format;
+}
+
+uint64_t kbd_record_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,57 @@
+#ifndef KBD_RECORD_H
+#define KBD_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kbd_sim_uapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Splits a KBD_FORMAT_RECORD byte stream into struct kbd_event records and
+ * tracks loss from gaps in the sequence numbers. Partial records left at
+ * the end of one buffer are carried into the next call.
+ */
+typedef struct {
+  unsigned char pending[sizeof(struct kbd_event)];
+  size_t pending_len;
+  uint32_t next_seq;
+  int have_seq;
+  uint64_t events;
+  uint64_t lost;
+} kbd_record_reader_t;
+
+void kbd_record_reader_init(kbd_record_reader_t *reader);
+
+/*
+ * Consumes `len` bytes from `data` and writes up to `out_cap` records to
+ * `out`. Returns the number of records written and sets `*consumed` to the
+ * number of input bytes used; call again with the remainder when the
+ * output fills up.
+ */
+size_t kbd_record_reader_feed(kbd_record_reader_t *reader,
+                              const unsigned char *data,
+                              size_t len,
+                              struct kbd_event *out,
+                              size_t out_cap,
+                              size_t *consumed);
+
+/*
+ * Queries the stream format of an open device. Returns KBD_FORMAT_RAW for
+ * sources that do not implement the ioctl (pipes, plain files).
+ */
+unsigned int kbd_record_device_format(int fd);
+
+/*
+ * CLOCK_MONOTONIC in nanoseconds, the clock used for kbd_event timestamps.
+ */
+uint64_t kbd_record_now_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,133 @@
+#include "kbd_ring.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int kbd_ring_attach(kbd_ring_t *ring, void *mem, size_t mem_size) {
+  if (!ring || !mem || mem_size < sizeof(struct kbd_ring_header)) {
+    return -1;
+  }
+
+  struct kbd_ring_header *hdr = (struct kbd_ring_header *)mem;
+  uint32_t size = hdr->data_size;
+  if (hdr->magic != KBD_RING_MAGIC || hdr->version != KBD_RING_VERSION) {
+    return -1;
+  }
+  if (size == 0 || (size & (size - 1)) != 0) {
+    return -1;
+  }
+  if (hdr->data_offset < sizeof(*hdr) || (size_t)hdr->data_offset + size > mem_size) {
+    return -1;
+  }
+
+  memset(ring, 0, sizeof(*ring));
+  ring->hdr = hdr;
+  ring->data = (const uint8_t *)mem + hdr->data_offset;
+  ring->mask = size - 1;
+  return 0;
+}
+
+static int read_ring_size(size_t *out) {
+  FILE *fp = fopen(KBD_RING_SIZE_PARAM, "r");
+  if (!fp) {
+    return -1;
+  }
+  unsigned long value = 0;
+  int ok = fscanf(fp, "%lu", &value) == 1 && value > 0;
+  fclose(fp);
+  if (!ok) {
+    return -1;
+  }
+  *out = value;
+  return 0;
+}
+
+int kbd_ring_map_device(kbd_ring_t *ring, int fd) {
+  size_t data_size = 0;
+  if (!ring || fd < 0 || read_ring_size(&data_size) != 0) {
+    return -1;
+  }
+
+  long page = sysconf(_SC_PAGESIZE);
+  if (page <= 0) {
+    return -1;
+  }
+  size_t map_size = (size_t)page + data_size;
+  void *mem = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) {
+    return -1;
+  }
+
+  if (kbd_ring_attach(ring, mem, map_size) != 0) {
+    munmap(mem, map_size);
+    return -1;
+  }
+  ring->map = mem;
+  ring->map_size = map_size;
+  ring->mapped = 1;
+  return 0;
+}
+
+size_t kbd_ring_peek(const kbd_ring_t *ring, const uint8_t **data) {
+  if (!ring || !ring->hdr) {
+    return 0;
+  }
+  uint32_t prod = __atomic_load_n(&ring->hdr->producer, __ATOMIC_ACQUIRE);
+  uint32_t cons = ring->hdr->consumer;
+  uint32_t avail = prod - cons;
+  if (avail == 0) {
+    return 0;
+  }
+
+  uint32_t offset = cons & ring->mask;
+  uint32_t to_end = ring->mask + 1 - offset;
+  if (data) {
+    *data = ring->data + offset;
+  }
+  return avail < to_end ? avail : to_end;
+}
+
+void kbd_ring_consume(kbd_ring_t *ring, size_t count) {
+  if (!ring || !ring->hdr || count == 0) {
+    return;
+  }
+  uint32_t cons = ring->hdr->consumer + (uint32_t)count;
+  __atomic_store_n(&ring->hdr->consumer, cons, __ATOMIC_RELEASE);
+}
+
+size_t kbd_ring_read(kbd_ring_t *ring, uint8_t *out, size_t len) {
+  size_t copied = 0;
+  while (copied < len) {
+    const uint8_t *src = NULL;
+    size_t avail = kbd_ring_peek(ring, &src);
+    if (avail == 0) {
+      break;
+    }
+    if (avail > len - copied) {
+      avail = len - copied;
+    }
+    memcpy(out + copied, src, avail);
+    kbd_ring_consume(ring, avail);
+    copied += avail;
+  }
+  return copied;
+}
+
+uint64_t kbd_ring_dropped(const kbd_ring_t *ring) {
+  if (!ring || !ring->hdr) {
+    return 0;
+  }
+  return __atomic_load_n(&ring->hdr->dropped, __ATOMIC_RELAXED);
+}
+
+void kbd_ring_unmap(kbd_ring_t *ring) {
+  if (!ring) {
+    return;
+  }
+  if (ring->mapped) {
+    munmap(ring->map, ring->map_size);
+  }
+  memset(ring, 0, sizeof(*ring));
+}
@@ -0,0 +1,64 @@
+#ifndef KBD_RING_H
+#define KBD_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "kbd_sim_uapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Read-only module parameter holding the effective ring data size. */
+#define KBD_RING_SIZE_PARAM "/sys/module/kbd_sim/parameters/ring_size"
+
+typedef struct {
+  void *map;
+  size_t map_size;
+  struct kbd_ring_header *hdr;
+  const uint8_t *data;
+  uint32_t mask;
+  int mapped;
+} kbd_ring_t;
+
+/*
+ * Attaches to an already mapped ring (header page + data) of `mem_size`
+ * bytes, validating the header. Returns 0 on success, -1 otherwise.
+ */
+int kbd_ring_attach(kbd_ring_t *ring, void *mem, size_t mem_size);
+
+/*
+ * Maps the ring exported by /dev/kbd. `fd` must be open for read/write.
+ * The data size is taken from KBD_RING_SIZE_PARAM.
+ */
+int kbd_ring_map_device(kbd_ring_t *ring, int fd);
+
+/*
+ * Returns the number of contiguous readable bytes and points `*data` at
+ * them. The bytes stay valid until kbd_ring_consume() releases them.
+ */
+size_t kbd_ring_peek(const kbd_ring_t *ring, const uint8_t **data);
+
+/*
+ * Releases `count` bytes previously returned by kbd_ring_peek().
+ */
+void kbd_ring_consume(kbd_ring_t *ring, size_t count);
+
+/*
+ * Copies up to `len` bytes out of the ring. Returns the number copied.
+ */
+size_t kbd_ring_read(kbd_ring_t *ring, uint8_t *out, size_t len);
+
+/*
+ * Number of bytes the producer dropped because the ring was full.
+ */
+uint64_t kbd_ring_dropped(const kbd_ring_t *ring);
+
+void kbd_ring_unmap(kbd_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
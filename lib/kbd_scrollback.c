@@ -0,0 +1,246 @@
+#define _GNU_SOURCE /* memmem */
+#include "kbd_scrollback.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define LINES_INITIAL 64
+
+static uint8_t *byte_at(const kbd_scrollback_t *sb, uint64_t offset) {
+  return &sb->chunks[(offset / KBD_SCROLLBACK_CHUNK) % sb->chunk_slots][offset % KBD_SCROLLBACK_CHUNK];
+}
+
+static uint64_t *line_slot(const kbd_scrollback_t *sb, size_t index) {
+  return &sb->lines[(sb->line_head + index) & (sb->line_cap - 1)];
+}
+
+int kbd_scrollback_init(kbd_scrollback_t *sb, size_t max_bytes, size_t max_lines) {
+  if (!sb) {
+    return -1;
+  }
+  memset(sb, 0, sizeof(*sb));
+  if (max_bytes == 0) {
+    max_bytes = KBD_SCROLLBACK_DEFAULT_BYTES;
+  }
+  sb->chunk_slots = (max_bytes + KBD_SCROLLBACK_CHUNK - 1) / KBD_SCROLLBACK_CHUNK;
+  if (sb->chunk_slots < 2) {
+    sb->chunk_slots = 2;
+  }
+  sb->max_lines = max_lines ? max_lines : max_bytes / 8;
+  if (sb->max_lines < 2) {
+    sb->max_lines = 2;
+  }
+  sb->chunks = calloc(sb->chunk_slots, sizeof(*sb->chunks));
+  sb->lines = calloc(LINES_INITIAL, sizeof(*sb->lines));
+  if (!sb->chunks || !sb->lines) {
+    kbd_scrollback_free(sb);
+    return -1;
+  }
+  sb->line_cap = LINES_INITIAL;
+  sb->line_count = 1;
+  return 0;
+}
+
+void kbd_scrollback_free(kbd_scrollback_t *sb) {
+  if (!sb) {
+    return;
+  }
+  if (sb->chunks) {
+    for (size_t i = 0; i < sb->chunk_slots; ++i) {
+      free(sb->chunks[i]);
+    }
+  }
+  free(sb->chunks);
+  free(sb->lines);
+  sb->chunks = NULL;
+  sb->lines = NULL;
+}
+
+/*
+ * Drops everything before `offset` (moved forward to a character start)
+ * and the lines that ended before it; the first kept line may be partial.
+ */
+static void evict_to(kbd_scrollback_t *sb, uint64_t offset) {
+  while (offset < sb->end && (*byte_at(sb, offset) & 0xC0) == 0x80) {
+    ++offset;
+  }
+  sb->start = offset;
+  while (sb->line_count > 1 && *line_slot(sb, 1) <= offset) {
+    sb->line_head = (sb->line_head + 1) & (sb->line_cap - 1);
+    sb->line_count--;
+    sb->first_line++;
+  }
+  if (*line_slot(sb, 0) < offset) {
+    *line_slot(sb, 0) = offset;
+  }
+}
+
+static int push_line(kbd_scrollback_t *sb, uint64_t offset) {
+  if (sb->line_count >= sb->max_lines) {
+    evict_to(sb, *line_slot(sb, 1));
+  }
+  if (sb->line_count == sb->line_cap) {
+    uint64_t *lines = malloc(sb->line_cap * 2 * sizeof(*lines));
+    if (!lines) {
+      return -1;
+    }
+    for (size_t i = 0; i < sb->line_count; ++i) {
+      lines[i] = *line_slot(sb, i);
+    }
+    free(sb->lines);
+    sb->lines = lines;
+    sb->line_cap *= 2;
+    sb->line_head = 0;
+  }
+  *line_slot(sb, sb->line_count) = offset;
+  sb->line_count++;
+  return 0;
+}
+
+/* Makes the chunk holding `end` writable, evicting the oldest if needed. */
+static int ensure_chunk(kbd_scrollback_t *sb) {
+  uint64_t chunk = sb->end / KBD_SCROLLBACK_CHUNK;
+  if (chunk - sb->start / KBD_SCROLLBACK_CHUNK >= sb->chunk_slots) {
+    evict_to(sb, (chunk - sb->chunk_slots + 1) * KBD_SCROLLBACK_CHUNK);
+  }
+  uint8_t **slot = &sb->chunks[chunk % sb->chunk_slots];
+  if (!*slot) {
+    *slot = malloc(KBD_SCROLLBACK_CHUNK);
+  }
+  return *slot ? 0 : -1;
+}
+
+static void backspace(kbd_scrollback_t *sb) {
+  if (sb->end == sb->start) {
+    return;
+  }
+  if (sb->line_count > 1 && *line_slot(sb, sb->line_count - 1) == sb->end) {
+    sb->line_count--; /* erase the newline */
+    sb->end--;
+    return;
+  }
+  do {
+    sb->end--;
+  } while (sb->end > sb->start && (*byte_at(sb, sb->end) & 0xC0) == 0x80);
+}
+
+int kbd_scrollback_append(kbd_scrollback_t *sb, const char *text, size_t len) {
+  if (!sb || !sb->chunks || !text) {
+    return -1;
+  }
+  size_t i = 0;
+  while (i < len) {
+    if (text[i] == '\b') {
+      backspace(sb);
+      ++i;
+      continue;
+    }
+    if (ensure_chunk(sb) != 0) {
+      return -1;
+    }
+
+    /* Copy a run up to the next control character or chunk end. */
+    size_t room = KBD_SCROLLBACK_CHUNK - sb->end % KBD_SCROLLBACK_CHUNK;
+    size_t j = i;
+    while (j < len && j - i < room && text[j] != '\b') {
+      if (text[j++] == '\n') {
+        break;
+      }
+    }
+    memcpy(byte_at(sb, sb->end), text + i, j - i);
+    sb->end += j - i;
+    if (text[j - 1] == '\n' && push_line(sb, sb->end) != 0) {
+      return -1;
+    }
+    i = j;
+  }
+  return 0;
+}
+
+size_t kbd_scrollback_line_count(const kbd_scrollback_t *sb) {
+  return sb ? sb->line_count : 0;
+}
+
+int kbd_scrollback_line_range(const kbd_scrollback_t *sb, size_t index, uint64_t *begin, uint64_t *end) {
+  if (!sb || index >= sb->line_count) {
+    return -1;
+  }
+  *begin = *line_slot(sb, index);
+  *end = index + 1 < sb->line_count ? *line_slot(sb, index + 1) - 1 : sb->end;
+  return 0;
+}
+
+size_t kbd_scrollback_line_at(const kbd_scrollback_t *sb, uint64_t offset) {
+  if (!sb || sb->line_count == 0) {
+    return 0;
+  }
+  size_t lo = 0;
+  size_t hi = sb->line_count - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo + 1) / 2;
+    if (*line_slot(sb, mid) <= offset) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return lo;
+}
+
+size_t kbd_scrollback_copy(const kbd_scrollback_t *sb, uint64_t from, uint64_t to, char *out, size_t out_size) {
+  if (!sb || !out) {
+    return 0;
+  }
+  if (from < sb->start) {
+    from = sb->start;
+  }
+  if (to > sb->end) {
+    to = sb->end;
+  }
+  size_t copied = 0;
+  while (from < to && copied < out_size) {
+    size_t n = KBD_SCROLLBACK_CHUNK - from % KBD_SCROLLBACK_CHUNK;
+    if (n > to - from) {
+      n = (size_t)(to - from);
+    }
+    if (n > out_size - copied) {
+      n = out_size - copied;
+    }
+    memcpy(out + copied, byte_at(sb, from), n);
+    copied += n;
+    from += n;
+  }
+  return copied;
+}
+
+int64_t kbd_scrollback_find(const kbd_scrollback_t *sb, const char *needle, size_t len, uint64_t from) {
+  if (!sb || !sb->chunks || !needle || len == 0 || len > KBD_SCROLLBACK_MAX_NEEDLE) {
+    return -1;
+  }
+  uint64_t pos = from < sb->start ? sb->start : from;
+  while (pos + len <= sb->end) {
+    uint64_t chunk_end = (pos / KBD_SCROLLBACK_CHUNK + 1) * KBD_SCROLLBACK_CHUNK;
+    if (chunk_end > sb->end) {
+      chunk_end = sb->end;
+    }
+    const uint8_t *span = byte_at(sb, pos);
+    const uint8_t *hit = memmem(span, (size_t)(chunk_end - pos), needle, len);
+    if (hit) {
+      return (int64_t)(pos + (uint64_t)(hit - span));
+    }
+    if (chunk_end == sb->end) {
+      break;
+    }
+
+    /* Matches that straddle the boundary start in the last len-1 bytes. */
+    char window[2 * KBD_SCROLLBACK_MAX_NEEDLE];
+    uint64_t lo = chunk_end - pos >= len ? chunk_end - len + 1 : pos;
+    size_t n = kbd_scrollback_copy(sb, lo, chunk_end + len - 1, window, sizeof(window));
+    const char *edge = memmem(window, n, needle, len);
+    if (edge) {
+      return (int64_t)(lo + (uint64_t)(edge - window));
+    }
+    pos = chunk_end;
+  }
+  return -1;
+}
@@ -0,0 +1,85 @@
+#ifndef KBD_SCROLLBACK_H
+#define KBD_SCROLLBACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define KBD_SCROLLBACK_CHUNK 65536
+#define KBD_SCROLLBACK_DEFAULT_BYTES (4u << 20)
+#define KBD_SCROLLBACK_MAX_NEEDLE 256
+
+/*
+ * Decoded text history as UTF-8 in fixed-size chunks, plus a ring of line
+ * start offsets. Offsets are absolute byte positions since init, so they
+ * stay valid while old text is evicted: `start` is the oldest retained
+ * byte and `end` is one past the newest.
+ *
+ * Chunks are allocated on first use and reused in place once the history
+ * wraps, so memory never exceeds `chunk_slots` chunks plus the line ring
+ * (at most `max_lines` offsets). Appending is O(1) amortized; backspace
+ * removes the last UTF-8 character, newline included.
+ */
+typedef struct {
+  uint8_t **chunks;
+  size_t chunk_slots;
+  uint64_t start;
+  uint64_t end;
+  uint64_t *lines; /* ring of line start offsets */
+  size_t line_cap;
+  size_t line_head;
+  size_t line_count;
+  size_t max_lines;
+  uint64_t first_line; /* absolute number of line 0, grows as lines evict */
+} kbd_scrollback_t;
+
+/*
+ * Sets up a history of at most `max_bytes` (rounded up to whole chunks, at
+ * least two) and `max_lines` lines; 0 picks KBD_SCROLLBACK_DEFAULT_BYTES
+ * and max_bytes / 8 respectively. Returns 0 on success or -1.
+ */
+int kbd_scrollback_init(kbd_scrollback_t *sb, size_t max_bytes, size_t max_lines);
+void kbd_scrollback_free(kbd_scrollback_t *sb);
+
+/*
+ * Appends decoder output; '\b' erases the previous character and '\n'
+ * starts a line. Returns 0 on success or -1 if a chunk cannot be
+ * allocated (the text up to that point is kept).
+ */
+int kbd_scrollback_append(kbd_scrollback_t *sb, const char *text, size_t len);
+
+size_t kbd_scrollback_line_count(const kbd_scrollback_t *sb);
+
+/*
+ * Byte range of line `index` (0 is the oldest retained line), without its
+ * newline. Returns 0 on success or -1 if the index is out of range.
+ */
+int kbd_scrollback_line_range(const kbd_scrollback_t *sb, size_t index, uint64_t *begin, uint64_t *end);
+
+/*
+ * Index of the line holding byte `offset` (clamped to the retained range).
+ */
+size_t kbd_scrollback_line_at(const kbd_scrollback_t *sb, uint64_t offset);
+
+/*
+ * Copies bytes [from, to) into `out`, up to `out_size`. Returns the number
+ * of bytes copied.
+ */
+size_t kbd_scrollback_copy(const kbd_scrollback_t *sb, uint64_t from, uint64_t to, char *out, size_t out_size);
+
+/*
+ * Offset of the first occurrence of `needle` at or after `from`, or -1.
+ * Each chunk is searched with memmem() and only the few bytes around chunk
+ * boundaries are copied. Needles longer than KBD_SCROLLBACK_MAX_NEEDLE are
+ * not supported.
+ */
+int64_t kbd_scrollback_find(const kbd_scrollback_t *sb, const char *needle, size_t len, uint64_t from);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+#include "kbd_spsc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int kbd_spsc_init(kbd_spsc_t *queue, size_t capacity, size_t elem_size) {
+  if (!queue || elem_size == 0) {
+    return -1;
+  }
+  memset(queue, 0, sizeof(*queue));
+  size_t slots = 2;
+  while (slots < capacity) {
+    slots <<= 1;
+  }
+  queue->slots = calloc(slots, elem_size);
+  if (!queue->slots) {
+    return -1;
+  }
+  queue->elem_size = elem_size;
+  queue->mask = slots - 1;
+  return 0;
+}
+
+void kbd_spsc_free(kbd_spsc_t *queue) {
+  if (!queue) {
+    return;
+  }
+  free(queue->slots);
+  queue->slots = NULL;
+}
+
+void *kbd_spsc_reserve(kbd_spsc_t *queue) {
+  uint64_t head = queue->head;
+  if (head - queue->tail_cache > queue->mask) {
+    queue->tail_cache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (head - queue->tail_cache > queue->mask) {
+      return NULL;
+    }
+  }
+  return queue->slots + (head & queue->mask) * queue->elem_size;
+}
+
+void kbd_spsc_commit(kbd_spsc_t *queue) {
+  __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+}
+
+const void *kbd_spsc_peek(kbd_spsc_t *queue) {
+  uint64_t tail = queue->tail;
+  if (tail == queue->head_cache) {
+    queue->head_cache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (tail == queue->head_cache) {
+      return NULL;
+    }
+  }
+  return queue->slots + (tail & queue->mask) * queue->elem_size;
+}
+
+void kbd_spsc_release(kbd_spsc_t *queue) {
+  __atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+}
+
+int kbd_spsc_push(kbd_spsc_t *queue, const void *elem) {
+  void *slot = kbd_spsc_reserve(queue);
+  if (!slot) {
+    return -1;
+  }
+  memcpy(slot, elem, queue->elem_size);
+  kbd_spsc_commit(queue);
+  return 0;
+}
+
+int kbd_spsc_pop(kbd_spsc_t *queue, void *out) {
+  const void *slot = kbd_spsc_peek(queue);
+  if (!slot) {
+    return -1;
+  }
+  memcpy(out, slot, queue->elem_size);
+  kbd_spsc_release(queue);
+  return 0;
+}
+
+size_t kbd_spsc_count(const kbd_spsc_t *queue) {
+  uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+  uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+  return (size_t)(head - tail);
+}
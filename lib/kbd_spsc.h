@@ -0,0 +1,70 @@
+#ifndef KBD_SPSC_H
+#define KBD_SPSC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free single-producer/single-consumer queue of fixed-size slots.
+ * One thread may reserve/commit and one other thread may peek/release; the
+ * indices are published with release stores like the kernel ring in
+ * kbd_ring.c. Each side keeps a cached copy of the other's index on its own
+ * cache line, so the shared lines are only touched when the cache says the
+ * queue looks full (producer) or empty (consumer).
+ */
+#define KBD_SPSC_CACHELINE 64
+
+typedef struct {
+  uint64_t head;       /* slots committed, written by the producer */
+  uint64_t tail_cache; /* producer's last view of tail */
+  char pad0[KBD_SPSC_CACHELINE - 2 * sizeof(uint64_t)];
+  uint64_t tail;       /* slots released, written by the consumer */
+  uint64_t head_cache; /* consumer's last view of head */
+  char pad1[KBD_SPSC_CACHELINE - 2 * sizeof(uint64_t)];
+  unsigned char *slots;
+  size_t elem_size;
+  uint64_t mask;
+} kbd_spsc_t;
+
+/*
+ * Allocates room for `capacity` slots of `elem_size` bytes; the capacity is
+ * rounded up to a power of two. Returns 0 on success or -1.
+ */
+int kbd_spsc_init(kbd_spsc_t *queue, size_t capacity, size_t elem_size);
+void kbd_spsc_free(kbd_spsc_t *queue);
+
+/*
+ * Producer: returns the next free slot, or NULL if the queue is full. The
+ * slot becomes visible to the consumer on kbd_spsc_commit().
+ */
+void *kbd_spsc_reserve(kbd_spsc_t *queue);
+void kbd_spsc_commit(kbd_spsc_t *queue);
+
+/*
+ * Consumer: returns the oldest committed slot, or NULL if the queue is
+ * empty. The slot stays valid until kbd_spsc_release().
+ */
+const void *kbd_spsc_peek(kbd_spsc_t *queue);
+void kbd_spsc_release(kbd_spsc_t *queue);
+
+/*
+ * Copying wrappers. Return 0 on success, -1 if full/empty.
+ */
+int kbd_spsc_push(kbd_spsc_t *queue, const void *elem);
+int kbd_spsc_pop(kbd_spsc_t *queue, void *out);
+
+/*
+ * Approximate number of queued slots; exact when called from either side
+ * with the other side idle.
+ */
+size_t kbd_spsc_count(const kbd_spsc_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,187 @@
+#include "kbd_timing.h"
+
+#include <string.h>
+
+#define SUB_COUNT (1u << KBD_HIST_SUB_BITS)
+#define MAX_VALUE ((1ull << KBD_HIST_MAX_BITS) - 1)
+
+void kbd_hist_init(kbd_hist_t *hist) {
+  if (hist) {
+    memset(hist, 0, sizeof(*hist));
+  }
+}
+
+/*
+ * Below 2 * SUB_COUNT the index is the value itself; above, it is the
+ * exponent times SUB_COUNT plus the top KBD_HIST_SUB_BITS + 1 bits.
+ */
+static unsigned int bucket_of(uint64_t value) {
+  if (value < 2 * SUB_COUNT) {
+    return (unsigned int)value;
+  }
+  unsigned int shift = 63 - (unsigned int)__builtin_clzll(value) - KBD_HIST_SUB_BITS;
+  return shift * SUB_COUNT + (unsigned int)(value >> shift);
+}
+
+static uint64_t bucket_mid(unsigned int index) {
+  if (index < 2 * SUB_COUNT) {
+    return index;
+  }
+  unsigned int shift = index / SUB_COUNT - 1;
+  uint64_t low = (uint64_t)(index % SUB_COUNT + SUB_COUNT) << shift;
+  return low + ((1ull << shift) >> 1);
+}
+
+void kbd_hist_record(kbd_hist_t *hist, uint64_t value) {
+  if (!hist) {
+    return;
+  }
+  if (value > MAX_VALUE) {
+    value = MAX_VALUE;
+  }
+  hist->counts[bucket_of(value)]++;
+  if (hist->total == 0 || value < hist->min) {
+    hist->min = value;
+  }
+  if (value > hist->max) {
+    hist->max = value;
+  }
+  hist->total++;
+}
+
+uint64_t kbd_hist_percentile(const kbd_hist_t *hist, double p) {
+  if (!hist || hist->total == 0) {
+    return 0;
+  }
+  /* The extremes are tracked exactly, so no need to estimate them. */
+  if (p <= 0.0) {
+    return hist->min;
+  }
+  if (p >= 100.0) {
+    return hist->max;
+  }
+  uint64_t rank = (uint64_t)(p / 100.0 * (double)hist->total + 0.5);
+  if (rank == 0) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < KBD_HIST_BUCKETS; ++i) {
+    seen += hist->counts[i];
+    if (seen >= rank) {
+      uint64_t value = bucket_mid(i);
+      if (value < hist->min) {
+        return hist->min;
+      }
+      return value > hist->max ? hist->max : value;
+    }
+  }
+  return hist->max;
+}
+
+void kbd_rate_init(kbd_rate_t *rate, uint64_t window_ns) {
+  if (!rate) {
+    return;
+  }
+  memset(rate, 0, sizeof(*rate));
+  rate->bin_ns = window_ns / KBD_RATE_BINS;
+  if (rate->bin_ns == 0) {
+    rate->bin_ns = 1;
+  }
+}
+
+/*
+ * Moves the head to `now_ns`, zeroing the bins that fell out of the window.
+ * Each bin is cleared at most once per pass of the window, so the cost is
+ * amortized O(1). Timestamps older than the head count towards the head.
+ */
+static void rate_advance(kbd_rate_t *rate, uint64_t now_ns) {
+  uint64_t bin = now_ns / rate->bin_ns;
+  if (bin <= rate->head_bin) {
+    return;
+  }
+  if (bin - rate->head_bin >= KBD_RATE_BINS) {
+    memset(rate->bins, 0, sizeof(rate->bins));
+    rate->sum = 0;
+  } else {
+    for (uint64_t b = rate->head_bin + 1; b <= bin; ++b) {
+      uint64_t *slot = &rate->bins[b % KBD_RATE_BINS];
+      rate->sum -= *slot;
+      *slot = 0;
+    }
+  }
+  rate->head_bin = bin;
+}
+
+void kbd_rate_add(kbd_rate_t *rate, uint64_t count, uint64_t now_ns) {
+  if (!rate || count == 0) {
+    return;
+  }
+  rate_advance(rate, now_ns);
+  rate->bins[rate->head_bin % KBD_RATE_BINS] += count;
+  rate->sum += count;
+}
+
+double kbd_rate_cpm(kbd_rate_t *rate, uint64_t now_ns) {
+  if (!rate) {
+    return 0.0;
+  }
+  rate_advance(rate, now_ns);
+  return (double)rate->sum * 60e9 / ((double)rate->bin_ns * KBD_RATE_BINS);
+}
+
+void kbd_timing_init(kbd_timing_t *timing, uint64_t window_ns, uint64_t idle_ns) {
+  if (!timing) {
+    return;
+  }
+  memset(timing, 0, sizeof(*timing));
+  kbd_rate_init(&timing->rate, window_ns ? window_ns : KBD_TIMING_DEFAULT_WINDOW_NS);
+  timing->idle_ns = idle_ns ? idle_ns : KBD_TIMING_DEFAULT_IDLE_NS;
+}
+
+void kbd_timing_key(kbd_timing_t *timing, uint8_t code, uint64_t ts_ns) {
+  if (!timing) {
+    return;
+  }
+  unsigned int id = 0;
+  int is_break = 0;
+  if (!scancode_key_id(&timing->prefix, code, &id, &is_break)) {
+    return;
+  }
+
+  /* 0 marks "up" / "no press yet", so time zero is nudged forward. */
+  if (ts_ns == 0) {
+    ts_ns = 1;
+  }
+  if (is_break) {
+    if (timing->down_ns[id] && ts_ns >= timing->down_ns[id]) {
+      kbd_hist_record(&timing->dwell, ts_ns - timing->down_ns[id]);
+    }
+    timing->down_ns[id] = 0;
+    return;
+  }
+  if (timing->down_ns[id]) {
+    return; /* autorepeat */
+  }
+  timing->down_ns[id] = ts_ns;
+  if (timing->last_press_ns && ts_ns >= timing->last_press_ns &&
+      ts_ns - timing->last_press_ns <= timing->idle_ns) {
+    kbd_hist_record(&timing->interkey, ts_ns - timing->last_press_ns);
+  }
+  timing->last_press_ns = ts_ns;
+}
+
+void kbd_timing_feed(kbd_timing_t *timing, const uint8_t *codes, size_t len, uint64_t ts_ns) {
+  if (!timing || !codes) {
+    return;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    kbd_timing_key(timing, codes[i], ts_ns);
+  }
+}
+
+void kbd_timing_count(kbd_timing_t *timing, unsigned long count, uint64_t ts_ns) {
+  if (timing) {
+    kbd_rate_add(&timing->rate, count, ts_ns);
+  }
+}
@@ -0,0 +1,102 @@
+#ifndef KBD_TIMING_H
+#define KBD_TIMING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scancode_map.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Log-bucketed histogram in the style of HdrHistogram: values below 32 ns
+ * are exact and above that every power of two is split into 16 linear
+ * sub-buckets, so any recorded value is within ~6% of its bucket. Values
+ * are clamped at 2^KBD_HIST_MAX_BITS - 1 ns (about 36 minutes).
+ */
+#define KBD_HIST_SUB_BITS 4
+#define KBD_HIST_MAX_BITS 41
+#define KBD_HIST_BUCKETS ((KBD_HIST_MAX_BITS - KBD_HIST_SUB_BITS + 1) << KBD_HIST_SUB_BITS)
+
+typedef struct {
+  uint64_t counts[KBD_HIST_BUCKETS];
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+} kbd_hist_t;
+
+void kbd_hist_init(kbd_hist_t *hist);
+void kbd_hist_record(kbd_hist_t *hist, uint64_t value);
+
+/*
+ * Value at percentile `p` (0-100), reported as the midpoint of its bucket
+ * and clamped to the recorded min/max; p0 and p100 are the exact min and
+ * max. Returns 0 for an empty histogram.
+ */
+uint64_t kbd_hist_percentile(const kbd_hist_t *hist, double p);
+
+/*
+ * Sliding-window typing rate: characters are summed into KBD_RATE_BINS bins
+ * spanning the window, so adding and querying are O(1) amortized and the
+ * memory is fixed.
+ */
+#define KBD_RATE_BINS 64
+
+typedef struct {
+  uint64_t bins[KBD_RATE_BINS];
+  uint64_t sum;
+  uint64_t bin_ns;
+  uint64_t head_bin; /* absolute index (time / bin_ns) of the newest bin */
+} kbd_rate_t;
+
+void kbd_rate_init(kbd_rate_t *rate, uint64_t window_ns);
+void kbd_rate_add(kbd_rate_t *rate, uint64_t count, uint64_t now_ns);
+
+/*
+ * Characters per minute over the window ending at `now_ns`. WPM is CPM / 5.
+ */
+double kbd_rate_cpm(kbd_rate_t *rate, uint64_t now_ns);
+
+/*
+ * Per-stream timing: intervals between key presses and how long each key
+ * is held (make to break). Autorepeat makes of a held key do not count as
+ * presses. Gaps longer than `idle_ns` are pauses, not typing, and are left
+ * out of the inter-key histogram.
+ */
+typedef struct {
+  kbd_hist_t interkey;
+  kbd_hist_t dwell;
+  kbd_rate_t rate;
+  uint64_t down_ns[256]; /* make time per key id, 0 while up */
+  uint64_t last_press_ns;
+  uint64_t idle_ns;
+  scancode_key_state_t prefix;
+} kbd_timing_t;
+
+#define KBD_TIMING_DEFAULT_IDLE_NS 2000000000ull
+#define KBD_TIMING_DEFAULT_WINDOW_NS 10000000000ull
+
+void kbd_timing_init(kbd_timing_t *timing, uint64_t window_ns, uint64_t idle_ns);
+
+/*
+ * Feeds one raw scancode byte observed at `ts_ns`.
+ */
+void kbd_timing_key(kbd_timing_t *timing, uint8_t scancode, uint64_t ts_ns);
+
+/*
+ * Feeds `len` bytes that share one timestamp (e.g. a raw read).
+ */
+void kbd_timing_feed(kbd_timing_t *timing, const uint8_t *codes, size_t len, uint64_t ts_ns);
+
+/*
+ * Adds decoded characters to the typing-rate window.
+ */
+void kbd_timing_count(kbd_timing_t *timing, unsigned long count, uint64_t ts_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
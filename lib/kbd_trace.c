@@ -0,0 +1,165 @@
+#include "kbd_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kbd_sim_uapi.h"
+
+static const uint8_t sequence_codes[] = {
+    0x23, 0x12, 0x26, 0x26, 0x18, 0x39,
+    0x11, 0x18, 0x13, 0x26, 0x20, 0x39,
+    0x02, 0x03, 0x04, 0x1C
+};
+
+static const uint8_t random_keys[] = {
+    0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B,
+    0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29,
+    0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x39,
+};
+
+static int read_file(const char *path, unsigned char **data, size_t *len) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    return -1;
+  }
+
+  unsigned char *buf = NULL;
+  size_t size = 0;
+  size_t cap = 0;
+  for (;;) {
+    if (size == cap) {
+      size_t next = cap ? cap * 2 : 65536;
+      unsigned char *tmp = realloc(buf, next);
+      if (!tmp) {
+        free(buf);
+        fclose(fp);
+        return -1;
+      }
+      buf = tmp;
+      cap = next;
+    }
+    size_t n = fread(buf + size, 1, cap - size, fp);
+    size += n;
+    if (n == 0) {
+      break;
+    }
+  }
+
+  int failed = ferror(fp);
+  fclose(fp);
+  if (failed) {
+    free(buf);
+    return -1;
+  }
+  *data = buf;
+  *len = size;
+  return 0;
+}
+
+int kbd_trace_load_raw(kbd_trace_t *trace, const char *path) {
+  if (!trace || !path) {
+    return -1;
+  }
+  memset(trace, 0, sizeof(*trace));
+
+  unsigned char *data = NULL;
+  size_t len = 0;
+  if (read_file(path, &data, &len) != 0) {
+    return -1;
+  }
+  trace->codes = data;
+  trace->count = len;
+  return 0;
+}
+
+int kbd_trace_load_records(kbd_trace_t *trace, const char *path) {
+  if (!trace || !path) {
+    return -1;
+  }
+  memset(trace, 0, sizeof(*trace));
+
+  unsigned char *data = NULL;
+  size_t len = 0;
+  if (read_file(path, &data, &len) != 0) {
+    return -1;
+  }
+
+  size_t count = len / sizeof(struct kbd_event);
+  trace->codes = malloc(count ? count : 1);
+  trace->offsets_ns = malloc(sizeof(uint64_t) * (count ? count : 1));
+  if (!trace->codes || !trace->offsets_ns) {
+    free(data);
+    kbd_trace_free(trace);
+    return -1;
+  }
+
+  uint64_t first = 0;
+  uint64_t last = 0;
+  for (size_t i = 0; i < count; ++i) {
+    struct kbd_event ev;
+    memcpy(&ev, data + i * sizeof(ev), sizeof(ev));
+    if (i == 0) {
+      first = ev.timestamp_ns;
+    }
+    /* Merged per-CPU streams can step back slightly; keep time monotonic. */
+    uint64_t offset = ev.timestamp_ns > first ? ev.timestamp_ns - first : 0;
+    if (offset < last) {
+      offset = last;
+    }
+    trace->codes[i] = ev.scancode;
+    trace->offsets_ns[i] = offset;
+    last = offset;
+  }
+  trace->count = count;
+  free(data);
+  return 0;
+}
+
+int kbd_trace_generate(kbd_trace_t *trace, kbd_trace_pattern_t pattern, size_t count, uint32_t seed) {
+  if (!trace) {
+    return -1;
+  }
+  memset(trace, 0, sizeof(*trace));
+  trace->codes = malloc(count ? count : 1);
+  if (!trace->codes) {
+    return -1;
+  }
+
+  uint32_t state = seed ? seed : 1;
+  for (size_t i = 0; i < count; ++i) {
+    if (pattern == KBD_TRACE_SEQUENCE) {
+      trace->codes[i] = sequence_codes[i % sizeof(sequence_codes)];
+    } else if (i % 2 == 1) {
+      trace->codes[i] = (uint8_t)(trace->codes[i - 1] | 0x80);
+    } else {
+      /* xorshift32: cheap and repeatable for a given seed. */
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      trace->codes[i] = random_keys[state % sizeof(random_keys)];
+    }
+  }
+  trace->count = count;
+  return 0;
+}
+
+uint64_t kbd_trace_due_ns(const kbd_trace_t *trace, size_t index, double rate, double speed) {
+  if (rate > 0.0) {
+    return (uint64_t)((double)index * 1e9 / rate);
+  }
+  if (trace && trace->offsets_ns && index < trace->count && speed > 0.0) {
+    return (uint64_t)((double)trace->offsets_ns[index] / speed);
+  }
+  return 0;
+}
+
+void kbd_trace_free(kbd_trace_t *trace) {
+  if (!trace) {
+    return;
+  }
+  free(trace->codes);
+  free(trace->offsets_ns);
+  memset(trace, 0, sizeof(*trace));
+}
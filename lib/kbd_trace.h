@@ -0,0 +1,56 @@
+#ifndef KBD_TRACE_H
+#define KBD_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An in-memory scancode trace. `offsets_ns` holds each event's time since
+ * the first event for traces loaded from kbd_event records, and is NULL for
+ * raw byte traces, which have no timing of their own.
+ */
+typedef struct {
+  uint8_t *codes;
+  uint64_t *offsets_ns;
+  size_t count;
+} kbd_trace_t;
+
+typedef enum {
+  KBD_TRACE_SEQUENCE = 0, /* the kernel module's built-in scancodes[] */
+  KBD_TRACE_RANDOM = 1,   /* random printable make/break pairs */
+} kbd_trace_pattern_t;
+
+/*
+ * Loads a file of raw scancode bytes. Returns 0 on success, -1 otherwise.
+ */
+int kbd_trace_load_raw(kbd_trace_t *trace, const char *path);
+
+/*
+ * Loads a file of struct kbd_event records (e.g. `cat /dev/kbd` with
+ * record_format=1), keeping their relative timing.
+ */
+int kbd_trace_load_records(kbd_trace_t *trace, const char *path);
+
+/*
+ * Synthesizes `count` scancodes. `seed` makes KBD_TRACE_RANDOM repeatable.
+ */
+int kbd_trace_generate(kbd_trace_t *trace, kbd_trace_pattern_t pattern, size_t count, uint32_t seed);
+
+/*
+ * Time at which event `index` is due, relative to the start of a replay.
+ * A positive `rate` (events/s) paces evenly; otherwise recorded offsets are
+ * scaled by 1/`speed`. Returns 0 (as fast as possible) when neither applies.
+ */
+uint64_t kbd_trace_due_ns(const kbd_trace_t *trace, size_t index, double rate, double speed);
+
+void kbd_trace_free(kbd_trace_t *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,225 @@
+#include "kbd_uring.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static int uring_setup(unsigned int entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned int opcode, const void *arg, unsigned int nr_args) {
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+void kbd_uring_free(kbd_uring_t *uring) {
+  if (!uring) {
+    return;
+  }
+  if (uring->sqes) {
+    munmap(uring->sqes, uring->sqes_size);
+  }
+  if (uring->cq_ring && uring->cq_ring != uring->sq_ring) {
+    munmap(uring->cq_ring, uring->cq_ring_size);
+  }
+  if (uring->sq_ring) {
+    munmap(uring->sq_ring, uring->sq_ring_size);
+  }
+  if (uring->fd >= 0) {
+    close(uring->fd); /* also unregisters the buffers */
+  }
+  free(uring->buffers);
+  memset(uring, 0, sizeof(*uring));
+  uring->fd = -1;
+}
+
+int kbd_uring_init(kbd_uring_t *uring, unsigned int entries, unsigned int buf_count, size_t buf_size) {
+  if (!uring || entries == 0 || buf_count == 0 || buf_size == 0) {
+    return -1;
+  }
+  memset(uring, 0, sizeof(*uring));
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  uring->fd = uring_setup(entries, &params);
+  if (uring->fd < 0) {
+    uring->fd = -1;
+    return -1;
+  }
+  /* Reads with offset -1 need the file position support from 5.6. */
+  if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+    kbd_uring_free(uring);
+    return -1;
+  }
+
+  uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  int single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single && uring->cq_ring_size > uring->sq_ring_size) {
+    uring->sq_ring_size = uring->cq_ring_size;
+  }
+  uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        uring->fd, IORING_OFF_SQ_RING);
+  if (uring->sq_ring == MAP_FAILED) {
+    uring->sq_ring = NULL;
+    kbd_uring_free(uring);
+    return -1;
+  }
+  uring->cq_ring = single ? uring->sq_ring
+                          : mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+  uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd,
+                     IORING_OFF_SQES);
+  if (uring->cq_ring == MAP_FAILED || uring->sqes == MAP_FAILED) {
+    if (uring->cq_ring == MAP_FAILED) {
+      uring->cq_ring = NULL;
+    }
+    if (uring->sqes == MAP_FAILED) {
+      uring->sqes = NULL;
+    }
+    kbd_uring_free(uring);
+    return -1;
+  }
+
+  uint8_t *sq = uring->sq_ring;
+  uint8_t *cq = uring->cq_ring;
+  uring->sq_head = (unsigned int *)(sq + params.sq_off.head);
+  uring->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+  uring->sq_array = (unsigned int *)(sq + params.sq_off.array);
+  uring->sq_mask = *(unsigned int *)(sq + params.sq_off.ring_mask);
+  uring->sq_entries = params.sq_entries;
+  uring->cq_head = (unsigned int *)(cq + params.cq_off.head);
+  uring->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+  uring->cq_mask = *(unsigned int *)(cq + params.cq_off.ring_mask);
+  uring->cqes = cq + params.cq_off.cqes;
+
+  /* Registered once, so the kernel does not pin the pages on every read. */
+  uring->buffers = aligned_alloc(4096, ((buf_count * buf_size + 4095) / 4096) * 4096);
+  struct iovec *iov = calloc(buf_count, sizeof(*iov));
+  if (!uring->buffers || !iov) {
+    free(iov);
+    kbd_uring_free(uring);
+    return -1;
+  }
+  for (unsigned int i = 0; i < buf_count; ++i) {
+    iov[i].iov_base = uring->buffers + i * buf_size;
+    iov[i].iov_len = buf_size;
+  }
+  int rc = uring_register(uring->fd, IORING_REGISTER_BUFFERS, iov, buf_count);
+  free(iov);
+  if (rc != 0) {
+    kbd_uring_free(uring);
+    return -1;
+  }
+  uring->buf_size = buf_size;
+  uring->buf_count = buf_count;
+  return 0;
+}
+
+uint8_t *kbd_uring_buffer(kbd_uring_t *uring, unsigned int index) {
+  return uring && index < uring->buf_count ? uring->buffers + (size_t)index * uring->buf_size : NULL;
+}
+
+/* Next free submission slot, or NULL when the queue is full. */
+static struct io_uring_sqe *next_sqe(kbd_uring_t *uring) {
+  unsigned int head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+  unsigned int tail = *uring->sq_tail + uring->pending;
+  if (tail - head >= uring->sq_entries) {
+    return NULL;
+  }
+  unsigned int index = tail & uring->sq_mask;
+  struct io_uring_sqe *sqe = (struct io_uring_sqe *)uring->sqes + index;
+  memset(sqe, 0, sizeof(*sqe));
+  uring->sq_array[index] = index;
+  uring->pending++;
+  return sqe;
+}
+
+static unsigned int sq_space(kbd_uring_t *uring) {
+  unsigned int head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+  return uring->sq_entries - (*uring->sq_tail + uring->pending - head);
+}
+
+static void prep_poll(struct io_uring_sqe *sqe, int fd, uint64_t user_data) {
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = htole32(POLLIN);
+  sqe->user_data = user_data;
+}
+
+int kbd_uring_read(kbd_uring_t *uring, int fd, unsigned int index, uint64_t user_data, uint64_t poll_data) {
+  if (!uring || index >= uring->buf_count || sq_space(uring) < 2) {
+    return -1;
+  }
+  struct io_uring_sqe *poll_sqe = next_sqe(uring);
+  prep_poll(poll_sqe, fd, poll_data);
+  poll_sqe->flags = IOSQE_IO_LINK;
+
+  struct io_uring_sqe *sqe = next_sqe(uring);
+  sqe->opcode = IORING_OP_READ_FIXED;
+  sqe->fd = fd;
+  sqe->off = (uint64_t)-1; /* current position; required for pipes */
+  sqe->addr = (uint64_t)(uintptr_t)kbd_uring_buffer(uring, index);
+  sqe->len = (uint32_t)uring->buf_size;
+  sqe->buf_index = (uint16_t)index;
+  sqe->user_data = user_data;
+  return 0;
+}
+
+int kbd_uring_poll(kbd_uring_t *uring, int fd, uint64_t user_data) {
+  if (!uring) {
+    return -1;
+  }
+  struct io_uring_sqe *sqe = next_sqe(uring);
+  if (!sqe) {
+    return -1;
+  }
+  prep_poll(sqe, fd, user_data);
+  return 0;
+}
+
+int kbd_uring_submit(kbd_uring_t *uring, unsigned int wait_nr) {
+  if (!uring) {
+    return -1;
+  }
+  /* Publish the prepared entries before the kernel reads the tail. */
+  unsigned int tail = *uring->sq_tail + uring->pending;
+  __atomic_store_n(uring->sq_tail, tail, __ATOMIC_RELEASE);
+  uring->pending = 0;
+  /* Includes anything an earlier, partially successful enter left behind. */
+  unsigned int to_submit = tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+  int rc = uring_enter(uring->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+  if (rc < 0 && errno != EINTR) {
+    return -1;
+  }
+  return 0;
+}
+
+size_t kbd_uring_reap(kbd_uring_t *uring, kbd_uring_cqe_t *out, size_t max) {
+  if (!uring || !out) {
+    return 0;
+  }
+  unsigned int head = *uring->cq_head;
+  unsigned int tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+  size_t n = 0;
+  while (head != tail && n < max) {
+    const struct io_uring_cqe *cqe = (const struct io_uring_cqe *)uring->cqes + (head & uring->cq_mask);
+    out[n].user_data = cqe->user_data;
+    out[n].res = cqe->res;
+    ++n;
+    ++head;
+  }
+  __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+  return n;
+}
@@ -0,0 +1,89 @@
+#ifndef KBD_URING_H
+#define KBD_URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Minimal io_uring over the raw syscalls (no liburing), just enough to read
+ * character devices and pipes: a set of registered buffers filled with
+ * READ_FIXED at the file's current position, and POLL_ADD for readiness.
+ * Any number of fds can share one ring; completions are told apart by the
+ * caller's `user_data`.
+ *
+ * Reads of an O_NONBLOCK fd complete with -EAGAIN instead of waiting, so
+ * kbd_uring_read() links a POLL_ADD in front of each read: the read is
+ * issued once the fd is readable and both complete in the same batch.
+ */
+typedef struct {
+  int fd;
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  void *sqes;
+  size_t sqes_size;
+  unsigned int *sq_head;
+  unsigned int *sq_tail;
+  unsigned int *sq_array;
+  unsigned int sq_mask;
+  unsigned int sq_entries;
+  unsigned int *cq_head;
+  unsigned int *cq_tail;
+  unsigned int cq_mask;
+  void *cqes;
+  unsigned int pending; /* prepared but not yet submitted */
+  uint8_t *buffers;
+  size_t buf_size;
+  unsigned int buf_count;
+} kbd_uring_t;
+
+typedef struct {
+  uint64_t user_data;
+  int32_t res; /* bytes read, poll mask, or -errno */
+} kbd_uring_cqe_t;
+
+/*
+ * Sets up a ring of `entries` submissions and registers `buf_count`
+ * buffers of `buf_size` bytes. Returns 0 on success or -1 when io_uring is
+ * unavailable (old kernel, seccomp, RLIMIT_MEMLOCK), so callers can fall
+ * back to poll() and read().
+ */
+int kbd_uring_init(kbd_uring_t *uring, unsigned int entries, unsigned int buf_count, size_t buf_size);
+void kbd_uring_free(kbd_uring_t *uring);
+
+uint8_t *kbd_uring_buffer(kbd_uring_t *uring, unsigned int index);
+
+/*
+ * Queues a poll-gated read of up to buf_size bytes from `fd` into buffer
+ * `index`. The poll completion carries `poll_data` and the read carries
+ * `user_data`. Returns 0 or -1 when the submission queue is full.
+ */
+int kbd_uring_read(kbd_uring_t *uring, int fd, unsigned int index, uint64_t user_data, uint64_t poll_data);
+
+/*
+ * Queues a one-shot POLLIN on `fd`. Returns 0 or -1 when the queue is full.
+ */
+int kbd_uring_poll(kbd_uring_t *uring, int fd, uint64_t user_data);
+
+/*
+ * Submits everything queued and waits until at least `wait_nr` completions
+ * are ready, in one io_uring_enter(). Returns 0, or -1 on error (EINTR
+ * counts as success with nothing to reap).
+ */
+int kbd_uring_submit(kbd_uring_t *uring, unsigned int wait_nr);
+
+/*
+ * Moves up to `max` completions into `out` and returns how many.
+ */
+size_t kbd_uring_reap(kbd_uring_t *uring, kbd_uring_cqe_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
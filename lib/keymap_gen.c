@@ -0,0 +1,204 @@
+/*
+ * Build-time generator for keymap_tables.c. Layouts are described as the
+ * US layout plus per-layout overrides; the generator resolves shift, caps
+ * and layout into one fused table so the decoder needs a single load per
+ * key. Usage: keymap_gen OUTPUT.c
+ */
+#include "keymap_tables.h"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+  uint8_t code;
+  const char *base;
+  const char *shifted;
+  int caps; /* caps lock swaps base/shifted (letters) */
+  const char *altgr; /* AltGr output; NULL falls back to base/shifted */
+} key_def_t;
+
+typedef struct {
+  scancode_layout_t layout;
+  const key_def_t *overrides;
+  size_t override_count;
+} layout_def_t;
+
+static const key_def_t us_keys[] = {
+    {0x02, "1", "!", 0, NULL},   {0x03, "2", "@", 0, NULL},   {0x04, "3", "#", 0, NULL},
+    {0x05, "4", "$", 0, NULL},   {0x06, "5", "%", 0, NULL},   {0x07, "6", "^", 0, NULL},
+    {0x08, "7", "&", 0, NULL},   {0x09, "8", "*", 0, NULL},   {0x0A, "9", "(", 0, NULL},
+    {0x0B, "0", ")", 0, NULL},   {0x0C, "-", "_", 0, NULL},   {0x0D, "=", "+", 0, NULL},
+    {0x0E, "\b", "\b", 0, NULL}, {0x0F, "\t", "\t", 0, NULL},
+    {0x10, "q", "Q", 1, NULL},   {0x11, "w", "W", 1, NULL},   {0x12, "e", "E", 1, NULL},
+    {0x13, "r", "R", 1, NULL},   {0x14, "t", "T", 1, NULL},   {0x15, "y", "Y", 1, NULL},
+    {0x16, "u", "U", 1, NULL},   {0x17, "i", "I", 1, NULL},   {0x18, "o", "O", 1, NULL},
+    {0x19, "p", "P", 1, NULL},   {0x1A, "[", "{", 0, NULL},   {0x1B, "]", "}", 0, NULL},
+    {0x1C, "\n", "\n", 0, NULL},
+    {0x1E, "a", "A", 1, NULL},   {0x1F, "s", "S", 1, NULL},   {0x20, "d", "D", 1, NULL},
+    {0x21, "f", "F", 1, NULL},   {0x22, "g", "G", 1, NULL},   {0x23, "h", "H", 1, NULL},
+    {0x24, "j", "J", 1, NULL},   {0x25, "k", "K", 1, NULL},   {0x26, "l", "L", 1, NULL},
+    {0x27, ";", ":", 0, NULL},   {0x28, "'", "\"", 0, NULL},  {0x29, "`", "~", 0, NULL},
+    {0x2B, "\\", "|", 0, NULL},
+    {0x2C, "z", "Z", 1, NULL},   {0x2D, "x", "X", 1, NULL},   {0x2E, "c", "C", 1, NULL},
+    {0x2F, "v", "V", 1, NULL},   {0x30, "b", "B", 1, NULL},   {0x31, "n", "N", 1, NULL},
+    {0x32, "m", "M", 1, NULL},   {0x33, ",", "<", 0, NULL},   {0x34, ".", ">", 0, NULL},
+    {0x35, "/", "?", 0, NULL},   {0x39, " ", " ", 0, NULL},
+};
+
+static const key_def_t uk_keys[] = {
+    {0x03, "2", "\"", 0, NULL},
+    {0x04, "3", "\xC2\xA3", 0, NULL},            /* £ */
+    {0x05, "4", "$", 0, "\xE2\x82\xAC"},         /* € */
+    {0x28, "'", "@", 0, NULL},
+    {0x29, "`", "\xC2\xAC", 0, "\xC2\xA6"},     /* ¬ ¦ */
+    {0x2B, "#", "~", 0, NULL},
+    {0x56, "\\", "|", 0, NULL},
+};
+
+static const key_def_t de_keys[] = {
+    {0x03, "2", "\"", 0, "\xC2\xB2"},           /* ² */
+    {0x04, "3", "\xC2\xA7", 0, "\xC2\xB3"},     /* § ³ */
+    {0x07, "6", "&", 0, NULL},
+    {0x08, "7", "/", 0, "{"},
+    {0x09, "8", "(", 0, "["},
+    {0x0A, "9", ")", 0, "]"},
+    {0x0B, "0", "=", 0, "}"},
+    {0x0C, "\xC3\x9F", "?", 0, "\\"},          /* ß */
+    {0x0D, "\xC2\xB4", "`", 0, NULL},            /* ´ */
+    {0x10, "q", "Q", 1, "@"},
+    {0x12, "e", "E", 1, "\xE2\x82\xAC"},         /* € */
+    {0x15, "z", "Z", 1, NULL},
+    {0x1A, "\xC3\xBC", "\xC3\x9C", 1, NULL},    /* ü Ü */
+    {0x1B, "+", "*", 0, "~"},
+    {0x27, "\xC3\xB6", "\xC3\x96", 1, NULL},    /* ö Ö */
+    {0x28, "\xC3\xA4", "\xC3\x84", 1, NULL},    /* ä Ä */
+    {0x29, "^", "\xC2\xB0", 0, NULL},            /* ° */
+    {0x2B, "#", "'", 0, NULL},
+    {0x2C, "y", "Y", 1, NULL},
+    {0x32, "m", "M", 1, "\xC2\xB5"},             /* µ */
+    {0x33, ",", ";", 0, NULL},
+    {0x34, ".", ":", 0, NULL},
+    {0x35, "-", "_", 0, NULL},
+    {0x56, "<", ">", 0, "|"},
+};
+
+static const key_def_t dvorak_keys[] = {
+    {0x0C, "[", "{", 0, NULL}, {0x0D, "]", "}", 0, NULL},
+    {0x10, "'", "\"", 0, NULL}, {0x11, ",", "<", 0, NULL}, {0x12, ".", ">", 0, NULL},
+    {0x13, "p", "P", 1, NULL}, {0x14, "y", "Y", 1, NULL}, {0x15, "f", "F", 1, NULL},
+    {0x16, "g", "G", 1, NULL}, {0x17, "c", "C", 1, NULL}, {0x18, "r", "R", 1, NULL},
+    {0x19, "l", "L", 1, NULL}, {0x1A, "/", "?", 0, NULL}, {0x1B, "=", "+", 0, NULL},
+    {0x1E, "a", "A", 1, NULL}, {0x1F, "o", "O", 1, NULL}, {0x20, "e", "E", 1, NULL},
+    {0x21, "u", "U", 1, NULL}, {0x22, "i", "I", 1, NULL}, {0x23, "d", "D", 1, NULL},
+    {0x24, "h", "H", 1, NULL}, {0x25, "t", "T", 1, NULL}, {0x26, "n", "N", 1, NULL},
+    {0x27, "s", "S", 1, NULL}, {0x28, "-", "_", 0, NULL},
+    {0x2C, ";", ":", 0, NULL}, {0x2D, "q", "Q", 1, NULL}, {0x2E, "j", "J", 1, NULL},
+    {0x2F, "k", "K", 1, NULL}, {0x30, "x", "X", 1, NULL}, {0x31, "b", "B", 1, NULL},
+    {0x32, "m", "M", 1, NULL}, {0x33, "w", "W", 1, NULL}, {0x34, "v", "V", 1, NULL},
+    {0x35, "z", "Z", 1, NULL},
+};
+
+#define ARRAY_LEN(a) (sizeof(a) / sizeof((a)[0]))
+
+static const layout_def_t layouts[SCANCODE_LAYOUT_COUNT] = {
+    {SCANCODE_LAYOUT_US, NULL, 0},
+    {SCANCODE_LAYOUT_UK, uk_keys, ARRAY_LEN(uk_keys)},
+    {SCANCODE_LAYOUT_DE, de_keys, ARRAY_LEN(de_keys)},
+    {SCANCODE_LAYOUT_DVORAK, dvorak_keys, ARRAY_LEN(dvorak_keys)},
+};
+
+static int make_entry(const char *text, keymap_entry_t *out) {
+  size_t len = strlen(text);
+  memset(out, 0, sizeof(*out));
+  if (len > sizeof(out->text)) {
+    return -1;
+  }
+  memcpy(out->text, text, len);
+  out->meta = (uint8_t)(len | ((len > 0 && text[0] != '\b') ? 4u : 0u));
+  return 0;
+}
+
+static int build_layout(const layout_def_t *def, keymap_entry_t table[KEYMAP_MODS][256]) {
+  const key_def_t *keys[128] = {0};
+  for (size_t i = 0; i < ARRAY_LEN(us_keys); ++i) {
+    keys[us_keys[i].code] = &us_keys[i];
+  }
+  for (size_t i = 0; i < def->override_count; ++i) {
+    keys[def->overrides[i].code] = &def->overrides[i];
+  }
+
+  memset(table, 0, sizeof(keymap_entry_t) * KEYMAP_MODS * 256);
+  for (int mods = 0; mods < KEYMAP_MODS; ++mods) {
+    int shift = mods & 1;
+    int caps = (mods >> 1) & 1;
+    int altgr = (mods >> 2) & 1;
+    for (int code = 0; code < 128; ++code) {
+      const key_def_t *key = keys[code];
+      if (!key) {
+        continue;
+      }
+      int use_shift = shift ^ (caps && key->caps);
+      const char *text = use_shift ? key->shifted : key->base;
+      if (altgr && key->altgr) {
+        text = key->altgr;
+      }
+      if (make_entry(text, &table[mods][code]) != 0) {
+        fprintf(stderr, "keymap_gen: key 0x%02X output too long\n", code);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void emit_layout(FILE *fp, const char *name, keymap_entry_t table[KEYMAP_MODS][256]) {
+  fprintf(fp, "    /* %s */\n    {\n", name);
+  for (int mods = 0; mods < KEYMAP_MODS; ++mods) {
+    fprintf(fp, "        {\n");
+    for (int code = 0; code < 256; code += 4) {
+      fprintf(fp, "            ");
+      for (int k = 0; k < 4; ++k) {
+        const keymap_entry_t *e = &table[mods][code + k];
+        fprintf(fp, "{{0x%02X, 0x%02X, 0x%02X}, 0x%02X},%s", e->text[0], e->text[1], e->text[2],
+                e->meta, k == 3 ? "\n" : " ");
+      }
+    }
+    fprintf(fp, "        },\n");
+  }
+  fprintf(fp, "    },\n");
+}
+
+int main(int argc, char **argv) {
+  static const char *names[SCANCODE_LAYOUT_COUNT] = {"us", "uk", "de", "dvorak"};
+  static keymap_entry_t table[KEYMAP_MODS][256];
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s OUTPUT.c\n", argv[0]);
+    return 2;
+  }
+
+  FILE *fp = fopen(argv[1], "w");
+  if (!fp) {
+    perror("keymap_gen");
+    return 1;
+  }
+
+  fprintf(fp, "/* Generated by keymap_gen. Do not edit. */\n");
+  fprintf(fp, "#include \"keymap_tables.h\"\n\n");
+  fprintf(fp, "const keymap_entry_t keymap_fused[SCANCODE_LAYOUT_COUNT][KEYMAP_MODS][256] = {\n");
+  for (int i = 0; i < SCANCODE_LAYOUT_COUNT; ++i) {
+    if (layouts[i].layout != (scancode_layout_t)i || build_layout(&layouts[i], table) != 0) {
+      fclose(fp);
+      remove(argv[1]);
+      return 1;
+    }
+    emit_layout(fp, names[i], table);
+  }
+  fprintf(fp, "};\n");
+
+  if (fclose(fp) != 0) {
+    remove(argv[1]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef KEYMAP_TABLES_H
+#define KEYMAP_TABLES_H
+
+#include <stdint.h>
+
+#include "scancode_map.h"
+
+/*
+ * Modifier index into the fused table: shift | caps << 1 | altgr << 2.
+ */
+#define KEYMAP_MODS 8
+
+/*
+ * Output of one key in one modifier state: up to 3 UTF-8 bytes in `text`
+ * and `meta` = length (bits 0-1) | printable flag (bit 2). A zero entry
+ * emits nothing. Entries are 4 bytes so decoders copy them whole.
+ */
+typedef struct {
+  unsigned char text[3];
+  uint8_t meta;
+} keymap_entry_t;
+
+#define KEYMAP_LEN(e) ((e).meta & 3u)
+#define KEYMAP_COUNTED(e) (((e).meta >> 2) & 1u)
+
+/*
+ * Generated by keymap_gen at build time. Indexed by layout, modifier index
+ * and the full scancode byte; break codes (>= 0x80) and keys without a
+ * character (modifiers, function and keypad keys) are zero and handled by
+ * the decoder itself.
+ */
+extern const keymap_entry_t keymap_fused[SCANCODE_LAYOUT_COUNT][KEYMAP_MODS][256];
+
+#endif
@@ -1,85 +1,15 @@
 #include "scancode_map.h"
 
+#include <pthread.h>
 #include <string.h>
+#include <strings.h>
 
-static const char normal_map[128] = {
-    [0x01] = 0,
-    [0x02] = '1',
-    [0x03] = '2',
-    [0x04] = '3',
-    [0x05] = '4',
-    [0x06] = '5',
-    [0x07] = '6',
-    [0x08] = '7',
-    [0x09] = '8',
-    [0x0A] = '9',
-    [0x0B] = '0',
-    [0x0C] = '-',
-    [0x0D] = '=',
-    [0x0E] = '\b',
-    [0x0F] = '\t',
-    [0x10] = 'q',
-    [0x11] = 'w',
-    [0x12] = 'e',
-    [0x13] = 'r',
-    [0x14] = 't',
-    [0x15] = 'y',
-    [0x16] = 'u',
-    [0x17] = 'i',
-    [0x18] = 'o',
-    [0x19] = 'p',
-    [0x1A] = '[',
-    [0x1B] = ']',
-    [0x1C] = '\n',
-    [0x1E] = 'a',
-    [0x1F] = 's',
-    [0x20] = 'd',
-    [0x21] = 'f',
-    [0x22] = 'g',
-    [0x23] = 'h',
-    [0x24] = 'j',
-    [0x25] = 'k',
-    [0x26] = 'l',
-    [0x27] = ';',
-    [0x28] = '\'',
-    [0x29] = '`',
-    [0x2B] = '\\',
-    [0x2C] = 'z',
-    [0x2D] = 'x',
-    [0x2E] = 'c',
-    [0x2F] = 'v',
-    [0x30] = 'b',
-    [0x31] = 'n',
-    [0x32] = 'm',
-    [0x33] = ',',
-    [0x34] = '.',
-    [0x35] = '/',
-    [0x39] = ' ',
-};
+#include "keymap_tables.h"
 
-static const char shifted_map[128] = {
-    [0x02] = '!',
-    [0x03] = '@',
-    [0x04] = '#',
-    [0x05] = '$',
-    [0x06] = '%',
-    [0x07] = '^',
-    [0x08] = '&',
-    [0x09] = '*',
-    [0x0A] = '(',
-    [0x0B] = ')',
-    [0x0C] = '_',
-    [0x0D] = '+',
-    [0x1A] = '{',
-    [0x1B] = '}',
-    [0x27] = ':',
-    [0x28] = '\"',
-    [0x29] = '~',
-    [0x2B] = '|',
-    [0x33] = '<',
-    [0x34] = '>',
-    [0x35] = '?',
-};
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCANCODE_X86 1
+#endif
 
 void scancode_state_init(scancode_state_t *state) {
   if (!state) {
@@ -88,6 +18,28 @@ void scancode_state_init(scancode_state_t *state) {
   memset(state, 0, sizeof(*state));
 }
 
+int scancode_state_init_layout(scancode_state_t *state, scancode_layout_t layout) {
+  scancode_state_init(state);
+  if (!state || (unsigned int)layout >= SCANCODE_LAYOUT_COUNT) {
+    return -1;
+  }
+  state->layout = (unsigned int)layout;
+  return 0;
+}
+
+int scancode_layout_from_name(const char *name) {
+  static const char *const names[SCANCODE_LAYOUT_COUNT] = {"us", "uk", "de", "dvorak"};
+  if (!name) {
+    return -1;
+  }
+  for (int i = 0; i < SCANCODE_LAYOUT_COUNT; ++i) {
+    if (strcasecmp(name, names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 static int write_token(const char *token, char *out, size_t out_size, unsigned long *counted_out) {
   if (!out || out_size == 0) {
     return 0;
@@ -104,8 +56,244 @@ static int write_token(const char *token, char *out, size_t out_size, unsigned l
   return (int)len;
 }
 
-static int is_letter(char ch) {
-  return ch >= 'a' && ch <= 'z';
+static const keymap_entry_t *keymap_row(const scancode_state_t *state) {
+  return keymap_fused[state->layout][state->shift | (state->caps << 1) | (state->altgr << 2)];
+}
+
+static size_t write_entry(keymap_entry_t entry, char *out, size_t out_size,
+                          unsigned long *counted_out) {
+  size_t len = KEYMAP_LEN(entry);
+  if (len >= out_size) {
+    len = out_size - 1;
+  }
+  memcpy(out, entry.text, len);
+  out[len] = '\0';
+  if (counted_out) {
+    *counted_out = KEYMAP_COUNTED(entry);
+  }
+  return len;
+}
+
+static size_t write_char(char ch, char *out, size_t out_size, unsigned long *counted_out) {
+  if (out_size < 2) {
+    out[0] = '\0';
+    return 0;
+  }
+  out[0] = ch;
+  out[1] = '\0';
+  if (counted_out) {
+    *counted_out = 1;
+  }
+  return 1;
+}
+
+/*
+ * Set-1 decoding is a DFA over raw bytes. The state is the pending prefix
+ * (0xE0, or how far into the 0xE1 Pause sequence we are); each edge names
+ * an action and the next state. Missing edges are all-zero, which consumes
+ * the byte silently and returns to DFA_BASE, so unknown sequences resync on
+ * the next byte.
+ */
+enum {
+  DFA_BASE = 0,
+  DFA_E0,
+  DFA_E1,
+  DFA_E1_MAKE,
+  DFA_E1_BREAK,
+  DFA_STATES
+};
+
+enum {
+  ACT_NONE = 0,
+  ACT_KEY,    /* fused keymap entry for the byte */
+  ACT_CHAR,   /* arg is a printable character */
+  ACT_TOKEN,  /* arg indexes token_text */
+  ACT_KEYPAD, /* arg is the keypad code: digit with NumLock, else a token */
+  ACT_SHIFT,  /* arg 1 = press, 0 = release */
+  ACT_CTRL,
+  ACT_ALT,
+  ACT_ALTGR,
+  ACT_CAPS,
+  ACT_NUM
+};
+
+enum {
+  TOK_ESC,
+  TOK_F1,
+  TOK_F2,
+  TOK_F3,
+  TOK_F4,
+  TOK_F5,
+  TOK_F6,
+  TOK_F7,
+  TOK_F8,
+  TOK_F9,
+  TOK_F10,
+  TOK_F11,
+  TOK_F12,
+  TOK_SCROLL,
+  TOK_UP,
+  TOK_DOWN,
+  TOK_LEFT,
+  TOK_RIGHT,
+  TOK_HOME,
+  TOK_END,
+  TOK_PGUP,
+  TOK_PGDN,
+  TOK_INS,
+  TOK_DEL,
+  TOK_PRTSC,
+  TOK_PAUSE,
+  TOK_BREAK,
+  TOK_SUPER,
+  TOK_MENU,
+  TOK_NONE
+};
+
+static const char *const token_text[] = {
+    [TOK_ESC] = "<ESC>",     [TOK_F1] = "<F1>",       [TOK_F2] = "<F2>",
+    [TOK_F3] = "<F3>",       [TOK_F4] = "<F4>",       [TOK_F5] = "<F5>",
+    [TOK_F6] = "<F6>",       [TOK_F7] = "<F7>",       [TOK_F8] = "<F8>",
+    [TOK_F9] = "<F9>",       [TOK_F10] = "<F10>",     [TOK_F11] = "<F11>",
+    [TOK_F12] = "<F12>",     [TOK_SCROLL] = "<SCROLL>", [TOK_UP] = "<UP>",
+    [TOK_DOWN] = "<DOWN>",   [TOK_LEFT] = "<LEFT>",   [TOK_RIGHT] = "<RIGHT>",
+    [TOK_HOME] = "<HOME>",   [TOK_END] = "<END>",     [TOK_PGUP] = "<PGUP>",
+    [TOK_PGDN] = "<PGDN>",   [TOK_INS] = "<INS>",     [TOK_DEL] = "<DEL>",
+    [TOK_PRTSC] = "<PRTSC>", [TOK_PAUSE] = "<PAUSE>", [TOK_BREAK] = "<BREAK>",
+    [TOK_SUPER] = "<SUPER>", [TOK_MENU] = "<MENU>",   [TOK_NONE] = "",
+};
+
+/* Keypad 0x47-0x53 with NumLock on (character) and off (token). */
+static const char keypad_digit[13] = "789-456+1230.";
+static const uint8_t keypad_nav[13] = {
+    TOK_HOME, TOK_UP, TOK_PGUP, TOK_NONE, TOK_LEFT, TOK_NONE, TOK_RIGHT,
+    TOK_NONE, TOK_END, TOK_DOWN, TOK_PGDN, TOK_INS, TOK_DEL,
+};
+
+typedef struct {
+  uint8_t action;
+  uint8_t arg;
+  uint8_t next;
+} dfa_edge_t;
+
+#define EDGE(act, a) {(act), (a), DFA_BASE}
+#define GOTO(state) {ACT_NONE, 0, (state)}
+
+/* Only special bytes (see special_code) consult the DFA in DFA_BASE. */
+static const dfa_edge_t dfa[DFA_STATES][256] = {
+    [DFA_BASE] = {
+        [0x01] = EDGE(ACT_TOKEN, TOK_ESC),
+        [0x1D] = EDGE(ACT_CTRL, 1), [0x9D] = EDGE(ACT_CTRL, 0),
+        [0x2A] = EDGE(ACT_SHIFT, 1), [0xAA] = EDGE(ACT_SHIFT, 0),
+        [0x36] = EDGE(ACT_SHIFT, 1), [0xB6] = EDGE(ACT_SHIFT, 0),
+        [0x37] = EDGE(ACT_CHAR, '*'),
+        [0x38] = EDGE(ACT_ALT, 1), [0xB8] = EDGE(ACT_ALT, 0),
+        [0x3A] = EDGE(ACT_CAPS, 0),
+        [0x3B] = EDGE(ACT_TOKEN, TOK_F1), [0x3C] = EDGE(ACT_TOKEN, TOK_F2),
+        [0x3D] = EDGE(ACT_TOKEN, TOK_F3), [0x3E] = EDGE(ACT_TOKEN, TOK_F4),
+        [0x3F] = EDGE(ACT_TOKEN, TOK_F5), [0x40] = EDGE(ACT_TOKEN, TOK_F6),
+        [0x41] = EDGE(ACT_TOKEN, TOK_F7), [0x42] = EDGE(ACT_TOKEN, TOK_F8),
+        [0x43] = EDGE(ACT_TOKEN, TOK_F9), [0x44] = EDGE(ACT_TOKEN, TOK_F10),
+        [0x45] = EDGE(ACT_NUM, 0),
+        [0x46] = EDGE(ACT_TOKEN, TOK_SCROLL),
+        [0x47] = EDGE(ACT_KEYPAD, 0x47), [0x48] = EDGE(ACT_KEYPAD, 0x48),
+        [0x49] = EDGE(ACT_KEYPAD, 0x49), [0x4A] = EDGE(ACT_CHAR, '-'),
+        [0x4B] = EDGE(ACT_KEYPAD, 0x4B), [0x4C] = EDGE(ACT_KEYPAD, 0x4C),
+        [0x4D] = EDGE(ACT_KEYPAD, 0x4D), [0x4E] = EDGE(ACT_CHAR, '+'),
+        [0x4F] = EDGE(ACT_KEYPAD, 0x4F), [0x50] = EDGE(ACT_KEYPAD, 0x50),
+        [0x51] = EDGE(ACT_KEYPAD, 0x51), [0x52] = EDGE(ACT_KEYPAD, 0x52),
+        [0x53] = EDGE(ACT_KEYPAD, 0x53),
+        [0x54] = EDGE(ACT_TOKEN, TOK_PRTSC), /* Alt+SysRq */
+        [0x56] = EDGE(ACT_KEY, 0),
+        [0x57] = EDGE(ACT_TOKEN, TOK_F11), [0x58] = EDGE(ACT_TOKEN, TOK_F12),
+        [0xE0] = GOTO(DFA_E0),
+        [0xE1] = GOTO(DFA_E1),
+    },
+    /* Fake shifts (E0 2A, E0 AA, E0 36, E0 B6) have no edge and are dropped. */
+    [DFA_E0] = {
+        [0x1C] = EDGE(ACT_CHAR, '\n'),
+        [0x1D] = EDGE(ACT_CTRL, 1), [0x9D] = EDGE(ACT_CTRL, 0),
+        [0x35] = EDGE(ACT_CHAR, '/'),
+        [0x37] = EDGE(ACT_TOKEN, TOK_PRTSC),
+        [0x38] = EDGE(ACT_ALTGR, 1), [0xB8] = EDGE(ACT_ALTGR, 0),
+        [0x46] = EDGE(ACT_TOKEN, TOK_BREAK),
+        [0x47] = EDGE(ACT_TOKEN, TOK_HOME), [0x48] = EDGE(ACT_TOKEN, TOK_UP),
+        [0x49] = EDGE(ACT_TOKEN, TOK_PGUP), [0x4B] = EDGE(ACT_TOKEN, TOK_LEFT),
+        [0x4D] = EDGE(ACT_TOKEN, TOK_RIGHT), [0x4F] = EDGE(ACT_TOKEN, TOK_END),
+        [0x50] = EDGE(ACT_TOKEN, TOK_DOWN), [0x51] = EDGE(ACT_TOKEN, TOK_PGDN),
+        [0x52] = EDGE(ACT_TOKEN, TOK_INS), [0x53] = EDGE(ACT_TOKEN, TOK_DEL),
+        [0x5B] = EDGE(ACT_TOKEN, TOK_SUPER), [0x5C] = EDGE(ACT_TOKEN, TOK_SUPER),
+        [0x5D] = EDGE(ACT_TOKEN, TOK_MENU),
+    },
+    /* Pause: E1 1D 45 on press, E1 9D C5 on release. */
+    [DFA_E1] = {
+        [0x1D] = GOTO(DFA_E1_MAKE),
+        [0x9D] = GOTO(DFA_E1_BREAK),
+    },
+    [DFA_E1_MAKE] = {
+        [0x45] = EDGE(ACT_TOKEN, TOK_PAUSE),
+    },
+    /* DFA_E1_BREAK swallows the final byte of the release sequence. */
+};
+
+#undef EDGE
+#undef GOTO
+
+/*
+ * Bytes (by low 7 bits) that consult the DFA. Everything else is "plain":
+ * its make code emits the fused table entry for the current layout and
+ * modifiers, and its break code emits nothing. The set is 0x01, 0x1D,
+ * 0x2A, 0x36-0x38 and 0x3A-0x7F (which covers the 0xE0/0xE1 prefixes), so
+ * the SIMD classifiers below need only a few compares.
+ */
+static const uint8_t special_code[128] = {
+    [0x01] = 1, [0x1D] = 1, [0x2A] = 1, [0x36] = 1, [0x37] = 1, [0x38] = 1,
+    [0x3A ... 0x7F] = 1,
+};
+
+int scancode_key_id(scancode_key_state_t *state, uint8_t code, unsigned int *id_out, int *is_break_out) {
+  if (!state) {
+    return 0;
+  }
+  if (state->skip) {
+    state->skip--;
+    return 0;
+  }
+  if (code == 0xE0) {
+    state->ext = 0x80;
+    return 0;
+  }
+  if (code == 0xE1) {
+    state->skip = 2; /* E1 1D 45 / E1 9D C5 */
+    return 0;
+  }
+
+  unsigned int ext = state->ext;
+  state->ext = 0;
+  unsigned int make = code & 0x7F;
+  /* The fake shifts (E0 2A, E0 36 and their breaks) around Print Screen. */
+  if (ext && (make == 0x2A || make == 0x36)) {
+    return 0;
+  }
+  if (id_out) {
+    *id_out = make | ext;
+  }
+  if (is_break_out) {
+    *is_break_out = (code & 0x80) != 0;
+  }
+  return 1;
+}
+
+int scancode_key_counted(scancode_layout_t layout, unsigned int key) {
+  if ((unsigned int)layout >= SCANCODE_LAYOUT_COUNT || key >= 256) {
+    return 0;
+  }
+  uint8_t code = (uint8_t)(key & 0x7F);
+  dfa_edge_t edge = dfa[key & 0x80 ? DFA_E0 : DFA_BASE][code];
+  if (!(key & 0x80) && (!special_code[code] || edge.action == ACT_KEY)) {
+    return (int)KEYMAP_COUNTED(keymap_fused[layout][0][code]);
+  }
+  return edge.action == ACT_CHAR;
 }
 
 size_t scancode_process(scancode_state_t *state,
@@ -124,67 +312,171 @@ size_t scancode_process(scancode_state_t *state,
     *counted_out = 0;
   }
 
-  int release = (scancode & 0x80) != 0;
-  uint8_t code = scancode & 0x7F;
+  if (state->prefix == DFA_BASE && !special_code[scancode & 0x7F]) {
+    return write_entry(keymap_row(state)[scancode], out, out_size, counted_out);
+  }
 
-  switch (code) {
-    case 0x2A:
-    case 0x36:
-      state->shift = release ? 0 : 1;
-      if (!release) {
-        return (size_t)write_token("<SHIFT>", out, out_size, counted_out);
-      }
-      return 0;
-    case 0x1D:
-      state->ctrl = release ? 0 : 1;
-      if (!release) {
-        return (size_t)write_token("<CTRL>", out, out_size, counted_out);
-      }
-      return 0;
-    case 0x38:
-      state->alt = release ? 0 : 1;
-      if (!release) {
-        return (size_t)write_token("<ALT>", out, out_size, counted_out);
-      }
-      return 0;
-    case 0x3A:
-      if (!release) {
-        state->caps = !state->caps;
-        return (size_t)write_token(state->caps ? "<CAPS_ON>" : "<CAPS_OFF>",
-                                   out, out_size, counted_out);
+  dfa_edge_t edge = dfa[state->prefix][scancode];
+  state->prefix = edge.next;
+
+  switch (edge.action) {
+    case ACT_KEY:
+      return write_entry(keymap_row(state)[scancode], out, out_size, counted_out);
+    case ACT_CHAR:
+      return write_char((char)edge.arg, out, out_size, counted_out);
+    case ACT_TOKEN:
+      return (size_t)write_token(token_text[edge.arg], out, out_size, counted_out);
+    case ACT_KEYPAD: {
+      unsigned int idx = edge.arg - 0x47u;
+      if (state->num) {
+        return write_char(keypad_digit[idx], out, out_size, counted_out);
       }
-      return 0;
+      return (size_t)write_token(token_text[keypad_nav[idx]], out, out_size, counted_out);
+    }
+    case ACT_SHIFT:
+      state->shift = edge.arg;
+      return edge.arg ? (size_t)write_token("<SHIFT>", out, out_size, counted_out) : 0;
+    case ACT_CTRL:
+      state->ctrl = edge.arg;
+      return edge.arg ? (size_t)write_token("<CTRL>", out, out_size, counted_out) : 0;
+    case ACT_ALT:
+      state->alt = edge.arg;
+      return edge.arg ? (size_t)write_token("<ALT>", out, out_size, counted_out) : 0;
+    case ACT_ALTGR:
+      state->altgr = edge.arg;
+      return edge.arg ? (size_t)write_token("<ALTGR>", out, out_size, counted_out) : 0;
+    case ACT_CAPS:
+      state->caps = !state->caps;
+      return (size_t)write_token(state->caps ? "<CAPS_ON>" : "<CAPS_OFF>", out, out_size,
+                                 counted_out);
+    case ACT_NUM:
+      state->num = !state->num;
+      return (size_t)write_token(state->num ? "<NUM_ON>" : "<NUM_OFF>", out, out_size,
+                                 counted_out);
     default:
-      break;
+      return 0;
   }
+}
 
-  if (release) {
-    return 0;
+static pthread_once_t batch_once = PTHREAD_ONCE_INIT;
+
+static size_t plain_run_scalar(const uint8_t *in, size_t len) {
+  size_t i = 0;
+  while (i < len && !special_code[in[i] & 0x7F]) {
+    ++i;
   }
+  return i;
+}
 
-  if (code == 0x01) {
-    return (size_t)write_token("<ESC>", out, out_size, counted_out);
+#ifdef SCANCODE_X86
+static size_t plain_run_sse2(const uint8_t *in, size_t len) {
+  const __m128i low7 = _mm_set1_epi8(0x7F);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(in + i)), low7);
+    /* v > 0x35 && v != 0x39 (space), plus the three low singletons. */
+    __m128i hit = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(0x39)),
+                                   _mm_cmpgt_epi8(v, _mm_set1_epi8(0x35)));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x01)));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x1D)));
+    hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x2A)));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+    if (mask != 0) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
   }
+  return i + plain_run_scalar(in + i, len - i);
+}
 
-  char ch = 0;
-  if (state->shift && shifted_map[code]) {
-    ch = shifted_map[code];
-  } else {
-    ch = normal_map[code];
+__attribute__((target("avx2"))) static size_t plain_run_avx2(const uint8_t *in, size_t len) {
+  const __m256i low7 = _mm256_set1_epi8(0x7F);
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(in + i)), low7);
+    __m256i hit = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x39)),
+                                      _mm256_cmpgt_epi8(v, _mm256_set1_epi8(0x35)));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x01)));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x1D)));
+    hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x2A)));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+    if (mask != 0) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
   }
+  return i + plain_run_sse2(in + i, len - i);
+}
+#endif
 
-  if (ch == 0) {
-    return 0;
+typedef size_t (*plain_run_fn)(const uint8_t *in, size_t len);
+static plain_run_fn plain_run = plain_run_scalar;
+
+static void batch_init(void) {
+#ifdef SCANCODE_X86
+  __builtin_cpu_init();
+  plain_run = __builtin_cpu_supports("avx2") ? plain_run_avx2 : plain_run_sse2;
+#endif
+}
+
+/*
+ * Decodes a run of plain codes without branching per byte: every entry's
+ * text is stored and the write position only advances by its length.
+ * `out` needs room for 3 * `len` bytes.
+ */
+static size_t decode_plain(const keymap_entry_t *row, const uint8_t *in, size_t len, char *out,
+                           unsigned long *counted) {
+  size_t n = 0;
+  unsigned long c = 0;
+  for (size_t i = 0; i < len; ++i) {
+    const keymap_entry_t *e = &row[in[i]];
+    memcpy(out + n, e->text, sizeof(e->text));
+    n += KEYMAP_LEN(*e);
+    c += KEYMAP_COUNTED(*e);
   }
+  *counted += c;
+  return n;
+}
+
+size_t scancode_process_batch(scancode_state_t *state,
+                              const uint8_t *in,
+                              size_t in_len,
+                              char *out,
+                              size_t out_size,
+                              size_t *consumed_out,
+                              unsigned long *counted_out) {
+  size_t i = 0;
+  size_t n = 0;
+  unsigned long counted = 0;
+
+  if (state && in && out) {
+    pthread_once(&batch_once, batch_init);
+
+    while (i < in_len && out_size - n >= SCANCODE_MAX_OUTPUT) {
+      size_t room = out_size - n;
+      /*
+       * A pending prefix sends the next byte through the DFA. The scan is
+       * bounded by what fits in `out`, or a long plain input would be
+       * rescanned to its end on every call.
+       */
+      size_t limit = in_len - i < room / 3 ? in_len - i : room / 3;
+      size_t run = state->prefix == DFA_BASE ? plain_run(in + i, limit) : 0;
+      if (run > 0) {
+        n += decode_plain(keymap_row(state), in + i, run, out + n, &counted);
+        i += run;
+        continue;
+      }
 
-  if (is_letter(ch) && (state->shift ^ state->caps)) {
-    ch = (char)(ch - 'a' + 'A');
+      unsigned long c = 0;
+      n += scancode_process(state, in[i], out + n, room, &c);
+      counted += c;
+      ++i;
+    }
   }
 
-  out[0] = ch;
-  out[1] = '\0';
+  if (consumed_out) {
+    *consumed_out = i;
+  }
   if (counted_out) {
-    *counted_out = (ch == '\b') ? 0 : 1;
+    *counted_out = counted;
   }
-  return 1;
+  return n;
 }
@@ -8,22 +8,62 @@
 extern "C" {
 #endif
 
+/*
+ * Keyboard layouts with compiled-in tables (see keymap_gen.c).
+ */
+typedef enum {
+  SCANCODE_LAYOUT_US = 0,
+  SCANCODE_LAYOUT_UK,
+  SCANCODE_LAYOUT_DE,
+  SCANCODE_LAYOUT_DVORAK,
+  SCANCODE_LAYOUT_COUNT
+} scancode_layout_t;
+
 typedef struct {
   unsigned int shift : 1;
   unsigned int ctrl : 1;
   unsigned int alt : 1;
   unsigned int caps : 1;
+  unsigned int layout : 3;
+  unsigned int altgr : 1;
+  unsigned int num : 1;
+  unsigned int prefix : 3; /* pending 0xE0/0xE1 sequence state */
 } scancode_state_t;
 
 /*
- * Initializes the scancode parser state.
+ * Prefix state for scancode_key_id(); zero-initialize it.
+ */
+typedef struct {
+  uint8_t ext;  /* 0x80 after an 0xE0 prefix */
+  uint8_t skip; /* bytes left of a Pause sequence */
+} scancode_key_state_t;
+
+/*
+ * Initializes the scancode parser state with the US layout.
  */
 void scancode_state_init(scancode_state_t *state);
 
+/*
+ * Initializes the scancode parser state with `layout`. Returns 0 on success,
+ * -1 if the layout is unknown (the state is then initialized as US).
+ */
+int scancode_state_init_layout(scancode_state_t *state, scancode_layout_t layout);
+
+/*
+ * Maps "us", "uk", "de" or "dvorak" (case-insensitive) to a layout.
+ * Returns -1 for NULL or unknown names.
+ */
+int scancode_layout_from_name(const char *name);
+
 /*
  * Processes a set-1 PC/AT scancode, updating modifier state and optionally
  * emitting output into `out`. Returns the number of bytes written to `out`.
  * `counted_out` is incremented for printable output (not backspace/tokens).
+ * Multi-byte 0xE0/0xE1 sequences are fed one byte at a time; prefix bytes
+ * emit nothing and the final byte emits the key (arrows and navigation keys
+ * as tokens such as "<UP>", keypad Enter and '/' as characters, right Alt
+ * as AltGr, Pause as "<PAUSE>"). The keypad emits digits while NumLock is
+ * on and navigation tokens otherwise.
  */
 size_t scancode_process(scancode_state_t *state,
                         uint8_t scancode,
@@ -31,6 +71,50 @@ size_t scancode_process(scancode_state_t *state,
                         size_t out_size,
                         unsigned long *counted_out);
 
+/*
+ * Upper bound on the bytes scancode_process() emits for one scancode,
+ * including its NUL terminator. Layout characters are UTF-8 and take up
+ * to 3 bytes.
+ */
+#define SCANCODE_MAX_OUTPUT 16
+
+/*
+ * Decodes `in_len` scancodes into `out` with the same results as calling
+ * scancode_process() for each byte and concatenating the outputs (without
+ * NUL terminators). Returns the number of bytes written; `counted_out` gets
+ * the total printable count. Decoding stops early when fewer than
+ * SCANCODE_MAX_OUTPUT bytes of `out` remain, and `consumed_out` reports how
+ * many input bytes were processed, so callers can loop over the remainder.
+ * Runs of plain make/break codes are classified 16 or 32 bytes at a time
+ * with SSE2/AVX2 where available and decoded straight from the fused
+ * layout table.
+ */
+size_t scancode_process_batch(scancode_state_t *state,
+                              const uint8_t *in,
+                              size_t in_len,
+                              char *out,
+                              size_t out_size,
+                              size_t *consumed_out,
+                              unsigned long *counted_out);
+
+/*
+ * Tracks key identity without decoding: feeds one set-1 byte and returns 1
+ * with the key id (make code, 0x80 set for 0xE0-prefixed keys) and whether
+ * it is a release once the byte completes a key event, or 0 for prefixes,
+ * Pause (E1 ...) and the fake shifts around Print Screen. Used wherever
+ * keys are counted or timed rather than typed.
+ */
+int scancode_key_id(scancode_key_state_t *state, uint8_t code, unsigned int *id_out, int *is_break_out);
+
+/*
+ * Whether pressing `key` with no modifiers emits a counted character on
+ * `layout`. Key ids are make codes with 0x80 set for 0xE0-prefixed keys,
+ * as in stats_keys.h. Keypad digits report 0: they count only while
+ * NumLock is on, which a press count cannot tell. Used to turn the
+ * kernel's per-key counts (KBD_IOC_GET_KEY_COUNTS) into typed characters.
+ */
+int scancode_key_counted(scancode_layout_t layout, unsigned int key);
+
 #ifdef __cplusplus
 }
 #endif
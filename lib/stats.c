@@ -1,9 +1,13 @@
 #include "stats.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static int parse_line(const char *line, char *key, size_t key_size, unsigned long *value) {
   const char *eq = strchr(line, '=');
@@ -30,12 +34,149 @@ static int parse_line(const char *line, char *key, size_t key_size, unsigned lon
   return 1;
 }
 
+static char *path_with_suffix(const char *path, const char *suffix) {
+  size_t len = strlen(path);
+  size_t suffix_len = strlen(suffix);
+  char *out = malloc(len + suffix_len + 1);
+  if (!out) {
+    return NULL;
+  }
+  memcpy(out, path, len);
+  memcpy(out + len, suffix, suffix_len + 1);
+  return out;
+}
+
+static uint32_t record_check(const stats_journal_record_t *rec) {
+  uint32_t h = 2166136261u;
+  const unsigned char *p = (const unsigned char *)rec->day;
+  for (size_t i = 0; i < sizeof(rec->day); ++i) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  p = (const unsigned char *)&rec->delta;
+  for (size_t i = 0; i < sizeof(rec->delta); ++i) {
+    h = (h ^ p[i]) * 16777619u;
+  }
+  return h;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static int journal_reset(int fd, uint64_t generation) {
+  stats_journal_header_t header = {STATS_JOURNAL_MAGIC, STATS_JOURNAL_VERSION, generation};
+  if (ftruncate(fd, 0) != 0) {
+    return -1;
+  }
+  return write_all(fd, &header, sizeof(header));
+}
+
+typedef void (*journal_visit_fn)(void *ctx, const stats_journal_record_t *rec);
+
+/*
+ * Calls `visit` for each intact record of a journal written for
+ * `generation` and returns how many there were. Returns -1 if the journal
+ * is missing, foreign or from another generation. `valid_end` receives the
+ * offset just past the last intact record.
+ */
+static long journal_scan(int fd, uint64_t generation, journal_visit_fn visit, void *ctx,
+                         off_t *valid_end) {
+  stats_journal_header_t header;
+  if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      header.magic != STATS_JOURNAL_MAGIC || header.version != STATS_JOURNAL_VERSION ||
+      header.generation != generation) {
+    return -1;
+  }
+
+  stats_journal_record_t buf[256];
+  off_t off = (off_t)sizeof(header);
+  long count = 0;
+  for (;;) {
+    ssize_t n = pread(fd, buf, sizeof(buf), off);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    size_t whole = (size_t)n / sizeof(buf[0]);
+    size_t i = 0;
+    for (; i < whole; ++i) {
+      if (buf[i].magic != STATS_JOURNAL_MAGIC || buf[i].check != record_check(&buf[i])) {
+        break;
+      }
+      visit(ctx, &buf[i]);
+    }
+    count += (long)i;
+    off += (off_t)(i * sizeof(buf[0]));
+    if (i < whole || (size_t)n < sizeof(buf)) {
+      break;
+    }
+  }
+  *valid_end = off;
+  return count;
+}
+
+static void replay_into_stats(void *ctx, const stats_journal_record_t *rec) {
+  stats_t *stats = ctx;
+  stats->total += (unsigned long)rec->delta;
+  if (strncmp(rec->day, stats->day, sizeof(rec->day)) == 0) {
+    stats->day_count += (unsigned long)rec->delta;
+  }
+}
+
+static int journal_open(stats_t *stats) {
+  char *jpath = path_with_suffix(stats->path, ".journal");
+  if (!jpath) {
+    return -1;
+  }
+  int fd = open(jpath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  free(jpath);
+  if (fd < 0) {
+    return -1;
+  }
+
+  off_t valid_end = 0;
+  long count = journal_scan(fd, stats->generation, replay_into_stats, stats, &valid_end);
+  if (count < 0) {
+    /* New, foreign, or already folded into the snapshot. */
+    if (journal_reset(fd, stats->generation) != 0) {
+      close(fd);
+      return -1;
+    }
+    count = 0;
+  } else {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size != valid_end && ftruncate(fd, valid_end) != 0) {
+      close(fd);
+      return -1;
+    }
+  }
+
+  stats->journal_fd = fd;
+  stats->journal_records = (unsigned long)count;
+  return 0;
+}
+
 int stats_init(stats_t *stats, const char *path, const char *day) {
   if (!stats || !path || !day || strlen(day) != 10) {
     return -1;
   }
 
   memset(stats, 0, sizeof(*stats));
+  stats->journal_fd = -1;
   memcpy(stats->day, day, 10);
   stats->day[10] = '\0';
   stats->path = strdup(path);
@@ -44,29 +185,35 @@ int stats_init(stats_t *stats, const char *path, const char *day) {
   }
 
   FILE *fp = fopen(path, "r");
-  if (!fp) {
-    if (errno == ENOENT) {
-      return 0;
-    }
+  if (!fp && errno != ENOENT) {
+    stats_free(stats);
     return -1;
   }
 
-  char line[256];
-  while (fgets(line, sizeof(line), fp)) {
-    char key[32];
-    unsigned long value = 0;
-    if (!parse_line(line, key, sizeof(key), &value)) {
-      continue;
-    }
+  if (fp) {
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+      char key[32];
+      unsigned long value = 0;
+      if (!parse_line(line, key, sizeof(key), &value)) {
+        continue;
+      }
 
-    if (strcmp(key, "total") == 0) {
-      stats->total = value;
-    } else if (strcmp(key, stats->day) == 0) {
-      stats->day_count = value;
+      if (strcmp(key, "total") == 0) {
+        stats->total = value;
+      } else if (strcmp(key, "journal") == 0) {
+        stats->generation = value;
+      } else if (strcmp(key, stats->day) == 0) {
+        stats->day_count = value;
+      }
     }
+    fclose(fp);
   }
 
-  fclose(fp);
+  if (journal_open(stats) != 0) {
+    stats_free(stats);
+    return -1;
+  }
   return 0;
 }
 
@@ -76,69 +223,253 @@ void stats_record(stats_t *stats, unsigned long count) {
   }
   stats->total += count;
   stats->day_count += count;
+  stats->pending += count;
+}
+
+static int journal_append(stats_t *stats) {
+  if (stats->pending == 0) {
+    return 0;
+  }
+
+  stats_journal_record_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = STATS_JOURNAL_MAGIC;
+  rec.delta = stats->pending;
+  memcpy(rec.day, stats->day, 10);
+  rec.check = record_check(&rec);
+
+  if (write_all(stats->journal_fd, &rec, sizeof(rec)) != 0) {
+    /* Drop a partial record so later appends stay aligned. */
+    off_t end = (off_t)(sizeof(stats_journal_header_t) +
+                        stats->journal_records * sizeof(stats_journal_record_t));
+    int rc = ftruncate(stats->journal_fd, end);
+    (void)rc;
+    return -1;
+  }
+
+  stats->pending = 0;
+  stats->journal_records++;
+  return 0;
 }
 
 int stats_save(stats_t *stats) {
-  if (!stats || !stats->path) {
+  if (!stats || !stats->path || stats->journal_fd < 0) {
     return -1;
   }
 
-  FILE *fp = fopen(stats->path, "r");
-  char **other_lines = NULL;
-  size_t other_count = 0;
+  if (journal_append(stats) != 0) {
+    return -1;
+  }
+  if (stats->journal_records >= STATS_JOURNAL_COMPACT_RECORDS) {
+    return stats_compact(stats);
+  }
+  return 0;
+}
+
+typedef struct {
+  char key[32];
+  unsigned long value;
+  char *raw; /* unparsed line kept verbatim, or NULL */
+} snapshot_line_t;
+
+typedef struct {
+  snapshot_line_t *lines;
+  size_t count;
+  size_t cap;
+  size_t file_count; /* lines read from the snapshot; the rest are new days */
+  size_t last; /* line the previous journal record matched */
+  unsigned long total;
+  int failed;
+} snapshot_t;
+
+static snapshot_line_t *snapshot_add(snapshot_t *snap) {
+  if (snap->count == snap->cap) {
+    size_t cap = snap->cap ? snap->cap * 2 : 64;
+    snapshot_line_t *tmp = realloc(snap->lines, cap * sizeof(*tmp));
+    if (!tmp) {
+      return NULL;
+    }
+    snap->lines = tmp;
+    snap->cap = cap;
+  }
+  snapshot_line_t *line = &snap->lines[snap->count++];
+  memset(line, 0, sizeof(*line));
+  return line;
+}
+
+static void snapshot_free(snapshot_t *snap) {
+  for (size_t i = 0; i < snap->count; ++i) {
+    free(snap->lines[i].raw);
+  }
+  free(snap->lines);
+}
+
+/* Adds a journal record to the matching day line, creating it if needed. */
+static void fold_record(void *ctx, const stats_journal_record_t *rec) {
+  snapshot_t *snap = ctx;
+  char day[sizeof(rec->day) + 1];
+  memcpy(day, rec->day, sizeof(rec->day));
+  day[sizeof(rec->day)] = '\0';
+
+  snap->total += (unsigned long)rec->delta;
+  /* Consecutive records are almost always for the same day. */
+  if (snap->last < snap->count && !snap->lines[snap->last].raw &&
+      strcmp(snap->lines[snap->last].key, day) == 0) {
+    snap->lines[snap->last].value += (unsigned long)rec->delta;
+    return;
+  }
+  for (size_t i = 0; i < snap->count; ++i) {
+    snapshot_line_t *line = &snap->lines[i];
+    if (!line->raw && strcmp(line->key, day) == 0) {
+      line->value += (unsigned long)rec->delta;
+      snap->last = i;
+      return;
+    }
+  }
+  snapshot_line_t *line = snapshot_add(snap);
+  if (!line) {
+    snap->failed = 1;
+    return;
+  }
+  snprintf(line->key, sizeof(line->key), "%s", day);
+  line->value = (unsigned long)rec->delta;
+  snap->last = snap->count - 1;
+}
 
+static int fsync_parent_dir(const char *path) {
+  char *copy = strdup(path);
+  if (!copy) {
+    return -1;
+  }
+  int fd = open(dirname(copy), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  free(copy);
+  if (fd < 0) {
+    return -1;
+  }
+  int rc = fsync(fd);
+  close(fd);
+  return rc;
+}
+
+static int snapshot_write(const snapshot_t *snap, const char *path, uint64_t generation) {
+  char *tmp_path = path_with_suffix(path, ".tmp");
+  if (!tmp_path) {
+    return -1;
+  }
+  FILE *fp = fopen(tmp_path, "w");
+  if (!fp) {
+    free(tmp_path);
+    return -1;
+  }
+
+  fprintf(fp, "total=%lu\n", snap->total);
+  fprintf(fp, "journal=%llu\n", (unsigned long long)generation);
+  /* Days first seen in the journal are the newest; keep them on top. */
+  for (size_t i = snap->count; i > snap->file_count; --i) {
+    const snapshot_line_t *line = &snap->lines[i - 1];
+    fprintf(fp, "%s=%lu\n", line->key, line->value);
+  }
+  for (size_t i = 0; i < snap->file_count; ++i) {
+    const snapshot_line_t *line = &snap->lines[i];
+    if (line->raw) {
+      fputs(line->raw, fp);
+    } else {
+      fprintf(fp, "%s=%lu\n", line->key, line->value);
+    }
+  }
+
+  int rc = fflush(fp) == 0 && fsync(fileno(fp)) == 0 ? 0 : -1;
+  if (fclose(fp) != 0) {
+    rc = -1;
+  }
+  if (rc == 0 && rename(tmp_path, path) != 0) {
+    rc = -1;
+  }
+  if (rc != 0) {
+    unlink(tmp_path);
+  }
+  free(tmp_path);
+  return rc;
+}
+
+int stats_compact(stats_t *stats) {
+  if (!stats || !stats->path || stats->journal_fd < 0) {
+    return -1;
+  }
+  if (journal_append(stats) != 0) {
+    return -1;
+  }
+
+  snapshot_t snap;
+  memset(&snap, 0, sizeof(snap));
+
+  FILE *fp = fopen(stats->path, "r");
+  if (!fp && errno != ENOENT) {
+    return -1;
+  }
   if (fp) {
     char line[256];
     while (fgets(line, sizeof(line), fp)) {
       char key[32];
       unsigned long value = 0;
-      if (parse_line(line, key, sizeof(key), &value)) {
-        if (strcmp(key, "total") == 0 || strcmp(key, stats->day) == 0) {
-          continue;
-        }
+      int parsed = parse_line(line, key, sizeof(key), &value);
+      if (parsed && strcmp(key, "total") == 0) {
+        snap.total = value;
+        continue;
       }
-
-      char *copy = strdup(line);
-      if (!copy) {
-        fclose(fp);
-        return -1;
+      if (parsed && strcmp(key, "journal") == 0) {
+        continue;
       }
-      char **tmp = realloc(other_lines, sizeof(char *) * (other_count + 1));
-      if (!tmp) {
-        free(copy);
+      snapshot_line_t *entry = snapshot_add(&snap);
+      if (!entry || (!parsed && !(entry->raw = strdup(line)))) {
         fclose(fp);
+        snapshot_free(&snap);
         return -1;
       }
-      other_lines = tmp;
-      other_lines[other_count++] = copy;
+      if (parsed) {
+        memcpy(entry->key, key, sizeof(entry->key));
+        entry->value = value;
+      }
     }
     fclose(fp);
   }
+  snap.file_count = snap.count;
 
-  fp = fopen(stats->path, "w");
-  if (!fp) {
-    for (size_t i = 0; i < other_count; ++i) {
-      free(other_lines[i]);
-    }
-    free(other_lines);
+  off_t valid_end = 0;
+  if (journal_scan(stats->journal_fd, stats->generation, fold_record, &snap, &valid_end) < 0 ||
+      snap.failed) {
+    snapshot_free(&snap);
     return -1;
   }
 
-  fprintf(fp, "total=%lu\n", stats->total);
-  fprintf(fp, "%s=%lu\n", stats->day, stats->day_count);
-  for (size_t i = 0; i < other_count; ++i) {
-    fputs(other_lines[i], fp);
-    free(other_lines[i]);
+  uint64_t next = stats->generation + 1;
+  int rc = snapshot_write(&snap, stats->path, next);
+  snapshot_free(&snap);
+  if (rc != 0 || fsync_parent_dir(stats->path) != 0) {
+    return -1;
   }
-  free(other_lines);
-  fclose(fp);
-  return 0;
+
+  /* The new snapshot is durable; the old journal is now stale either way. */
+  stats->generation = next;
+  stats->journal_records = 0;
+  return journal_reset(stats->journal_fd, next);
+}
+
+int stats_sync(stats_t *stats) {
+  if (!stats || stats->journal_fd < 0) {
+    return -1;
+  }
+  return fdatasync(stats->journal_fd);
 }
 
 void stats_free(stats_t *stats) {
   if (!stats) {
     return;
   }
+  if (stats->journal_fd >= 0) {
+    close(stats->journal_fd);
+  }
+  stats->journal_fd = -1;
   free(stats->path);
   stats->path = NULL;
 }
@@ -2,21 +2,75 @@
 #define STATS_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * Persistent counters are a text snapshot at `path` ("total=N", "journal=G"
+ * and one "YYYY-MM-DD=N" line per day) plus an append-only binary journal
+ * of deltas at "<path>.journal". The journal header carries the snapshot
+ * generation G it applies to, so a crash between writing a compacted
+ * snapshot and resetting the journal never double-counts.
+ */
+#define STATS_JOURNAL_MAGIC 0x6b62646au /* "kbdj" */
+#define STATS_JOURNAL_VERSION 1
+
+/* Journal records appended before stats_save() compacts automatically. */
+#define STATS_JOURNAL_COMPACT_RECORDS 4096
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t generation;
+} stats_journal_header_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t check; /* FNV-1a over day and delta; detects torn appends */
+  uint64_t delta;
+  char day[16];   /* NUL-padded YYYY-MM-DD */
+} stats_journal_record_t;
+
 typedef struct {
   char day[11];
   char *path;
   unsigned long total;
   unsigned long day_count;
+  unsigned long pending;         /* recorded but not yet journaled */
+  int journal_fd;
+  uint64_t generation;
+  unsigned long journal_records;
 } stats_t;
 
+/*
+ * Loads the snapshot and replays its journal. A torn record at the end of
+ * the journal (from a crash mid-append) is discarded. Returns 0 on success
+ * (a missing snapshot starts from zero) or -1.
+ */
 int stats_init(stats_t *stats, const char *path, const char *day);
 void stats_record(stats_t *stats, unsigned long count);
+
+/*
+ * Appends the counts recorded since the last save as one fixed-size journal
+ * record; compacts once the journal reaches STATS_JOURNAL_COMPACT_RECORDS.
+ * Returns 0 on success or -1.
+ */
 int stats_save(stats_t *stats);
+
+/*
+ * Folds the journal into a new snapshot (written to a temp file, fsynced and
+ * renamed over `path`) and starts an empty journal for the next generation.
+ * Returns 0 on success or -1.
+ */
+int stats_compact(stats_t *stats);
+
+/*
+ * Forces journaled records to stable storage. Returns 0 on success or -1.
+ */
+int stats_sync(stats_t *stats);
 void stats_free(stats_t *stats);
 
 #ifdef __cplusplus
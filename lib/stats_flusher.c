@@ -0,0 +1,400 @@
+#include "stats_flusher.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void stats_flusher_default_config(stats_flusher_config_t *config) {
+  if (!config) {
+    return;
+  }
+  config->interval_ms = STATS_FLUSHER_DEFAULT_INTERVAL_MS;
+  config->max_pending = STATS_FLUSHER_DEFAULT_MAX_PENDING;
+  config->keys_interval_ms = STATS_FLUSHER_DEFAULT_KEYS_INTERVAL_MS;
+  config->fsync_policy = STATS_FSYNC_NONE;
+}
+
+/*
+ * Writes the key matrix if it changed (and, unless `force`, if the interval
+ * has passed). The copy is taken under keys_lock so feeding never waits on
+ * the write. Caller holds io_lock.
+ */
+static int save_keys(stats_flusher_t *flusher, int force) {
+  if (!flusher->keys) {
+    return 0;
+  }
+  uint64_t now = now_ns();
+  pthread_mutex_lock(&flusher->keys_lock);
+  if (!flusher->keys_dirty ||
+      (!force && now - flusher->keys_saved_ns < (uint64_t)flusher->config.keys_interval_ms * 1000000ull)) {
+    pthread_mutex_unlock(&flusher->keys_lock);
+    return 0;
+  }
+  memcpy(flusher->keys_scratch, flusher->keys, sizeof(*flusher->keys));
+  flusher->keys_dirty = 0;
+  pthread_mutex_unlock(&flusher->keys_lock);
+
+  int rc = stats_keys_save(flusher->keys_scratch, flusher->keys_path,
+                           flusher->config.fsync_policy == STATS_FSYNC_FLUSH);
+  pthread_mutex_lock(&flusher->keys_lock);
+  if (rc == 0) {
+    flusher->keys_saved_ns = now;
+  } else {
+    flusher->keys_dirty = 1;
+  }
+  pthread_mutex_unlock(&flusher->keys_lock);
+  return rc;
+}
+
+/*
+ * Indexes whatever has left stats.pending since the last call: those counts
+ * are in the journal even if the compaction that followed failed. Caller
+ * holds io_lock.
+ */
+static void index_journaled(stats_flusher_t *flusher) {
+  unsigned long journaled = flusher->index_pending - flusher->stats.pending;
+  if (journaled == 0) {
+    return;
+  }
+  if (!flusher->index_ready || stats_index_add(&flusher->index, flusher->day_number, journaled) == 0) {
+    flusher->index_pending -= journaled;
+  }
+}
+
+/*
+ * Moves the coalesced delta into the stats and journals it. Caller holds
+ * io_lock. A failed save keeps the delta in stats.pending for the next try.
+ */
+static int flush_io(stats_flusher_t *flusher) {
+  pthread_mutex_lock(&flusher->lock);
+  unsigned long delta = flusher->pending;
+  flusher->pending = 0;
+  pthread_mutex_unlock(&flusher->lock);
+
+  if (delta > 0) {
+    stats_record(&flusher->stats, delta);
+    flusher->index_pending += delta;
+  }
+  int rc = stats_save(&flusher->stats);
+  index_journaled(flusher);
+  if (rc == 0 && delta > 0 && flusher->config.fsync_policy == STATS_FSYNC_FLUSH) {
+    rc = stats_sync(&flusher->stats);
+    if (rc == 0 && flusher->index_ready) {
+      rc = stats_index_sync(&flusher->index);
+    }
+  }
+  if (rc == 0) {
+    rc = save_keys(flusher, 0);
+  }
+
+  pthread_mutex_lock(&flusher->lock);
+  if (rc == 0) {
+    flusher->flushes++;
+  } else {
+    flusher->errors++;
+  }
+  pthread_mutex_unlock(&flusher->lock);
+  return rc;
+}
+
+static char *path_with_suffix(const char *path, const char *suffix) {
+  size_t len = strlen(path);
+  size_t suffix_len = strlen(suffix);
+  char *out = malloc(len + suffix_len + 1);
+  if (out) {
+    memcpy(out, path, len);
+    memcpy(out + len, suffix, suffix_len + 1);
+  }
+  return out;
+}
+
+/*
+ * Opens the day index, importing the snapshot if the index is new. The
+ * index is derived data: a damaged one is replaced, and other failures only
+ * disable it.
+ */
+static void open_index(stats_flusher_t *flusher) {
+  char *index_path = path_with_suffix(flusher->stats.path, ".index");
+  if (!index_path) {
+    return;
+  }
+
+  int fresh = access(index_path, F_OK) != 0;
+  int rc = stats_index_open(&flusher->index, index_path, flusher->day_number);
+  if (rc != 0 && errno == EINVAL) {
+    fresh = unlink(index_path) == 0;
+    rc = fresh ? stats_index_open(&flusher->index, index_path, flusher->day_number) : -1;
+  }
+  if (rc == 0) {
+    flusher->index_ready = 1;
+    /* Fold the journal first so the snapshot holds every day's count. */
+    if (fresh && (stats_compact(&flusher->stats) != 0 ||
+                  stats_index_import_text(&flusher->index, flusher->stats.path) < 0)) {
+      stats_index_close(&flusher->index);
+      unlink(index_path);
+      flusher->index_ready = 0;
+    }
+  }
+  free(index_path);
+}
+
+static void close_keys(stats_flusher_t *flusher) {
+  free(flusher->keys_path);
+  free(flusher->keys);
+  free(flusher->keys_scratch);
+  flusher->keys_path = NULL;
+  flusher->keys = NULL;
+  flusher->keys_scratch = NULL;
+}
+
+/*
+ * Loads "<path>.keys". Like the day index it is derived data, so a damaged
+ * file is replaced by zeroed counters; other failures leave key counting off.
+ */
+static void open_keys(stats_flusher_t *flusher) {
+  flusher->keys_path = path_with_suffix(flusher->stats.path, ".keys");
+  flusher->keys = malloc(sizeof(*flusher->keys));
+  flusher->keys_scratch = malloc(sizeof(*flusher->keys_scratch));
+  if (!flusher->keys_path || !flusher->keys || !flusher->keys_scratch) {
+    close_keys(flusher);
+    return;
+  }
+  if (stats_keys_load(flusher->keys, flusher->keys_path) != 0) {
+    if (errno != EINVAL) {
+      close_keys(flusher);
+      return;
+    }
+    /* Overwrite it now; if that fails the next save tries again. */
+    flusher->keys_dirty = stats_keys_save(flusher->keys, flusher->keys_path, 0) != 0;
+  }
+  flusher->keys_saved_ns = now_ns();
+}
+
+static void *flusher_main(void *arg) {
+  stats_flusher_t *flusher = arg;
+
+  pthread_mutex_lock(&flusher->lock);
+  while (flusher->running) {
+    if (flusher->pending == 0) {
+      pthread_cond_wait(&flusher->cond, &flusher->lock);
+      continue;
+    }
+
+    uint64_t deadline = flusher->pending_since_ns + (uint64_t)flusher->config.interval_ms * 1000000ull;
+    if (flusher->pending < flusher->config.max_pending && now_ns() < deadline) {
+      struct timespec ts = {(time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull)};
+      pthread_cond_timedwait(&flusher->cond, &flusher->lock, &ts);
+      continue;
+    }
+
+    pthread_mutex_unlock(&flusher->lock);
+    pthread_mutex_lock(&flusher->io_lock);
+    flush_io(flusher);
+    pthread_mutex_unlock(&flusher->io_lock);
+    pthread_mutex_lock(&flusher->lock);
+  }
+  pthread_mutex_unlock(&flusher->lock);
+  return NULL;
+}
+
+int stats_flusher_start(stats_flusher_t *flusher,
+                        const char *path,
+                        const char *day,
+                        const stats_flusher_config_t *config) {
+  if (!flusher) {
+    return -1;
+  }
+  memset(flusher, 0, sizeof(*flusher));
+  if (config) {
+    flusher->config = *config;
+  } else {
+    stats_flusher_default_config(&flusher->config);
+  }
+
+  if (stats_day_from_string(day, &flusher->day_number) != 0 ||
+      stats_init(&flusher->stats, path, day) != 0) {
+    return -1;
+  }
+  open_index(flusher);
+  open_keys(flusher);
+  flusher->total = flusher->stats.total;
+  flusher->day_count = flusher->stats.day_count;
+
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&flusher->cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&flusher->lock, NULL);
+  pthread_mutex_init(&flusher->io_lock, NULL);
+  pthread_mutex_init(&flusher->keys_lock, NULL);
+
+  flusher->running = 1;
+  if (pthread_create(&flusher->thread, NULL, flusher_main, flusher) != 0) {
+    pthread_cond_destroy(&flusher->cond);
+    pthread_mutex_destroy(&flusher->lock);
+    pthread_mutex_destroy(&flusher->io_lock);
+    pthread_mutex_destroy(&flusher->keys_lock);
+    stats_free(&flusher->stats);
+    if (flusher->index_ready) {
+      stats_index_close(&flusher->index);
+    }
+    close_keys(flusher);
+    flusher->running = 0;
+    return -1;
+  }
+  return 0;
+}
+
+void stats_flusher_record(stats_flusher_t *flusher, unsigned long count) {
+  if (!flusher || count == 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&flusher->lock);
+  int first = flusher->pending == 0;
+  if (first) {
+    flusher->pending_since_ns = now_ns();
+  }
+  flusher->pending += count;
+  flusher->total += count;
+  flusher->day_count += count;
+  int wake = first || flusher->pending >= flusher->config.max_pending;
+  pthread_mutex_unlock(&flusher->lock);
+
+  if (wake) {
+    pthread_cond_signal(&flusher->cond);
+  }
+}
+
+void stats_flusher_record_keys(stats_flusher_t *flusher, const uint8_t *codes, size_t len) {
+  if (!flusher || !flusher->keys || len == 0) {
+    return;
+  }
+  pthread_mutex_lock(&flusher->keys_lock);
+  stats_keys_feed(flusher->keys, codes, len);
+  flusher->keys_dirty = 1;
+  pthread_mutex_unlock(&flusher->keys_lock);
+}
+
+void stats_flusher_record_presses(stats_flusher_t *flusher, const uint64_t presses[STATS_KEYS_COUNT]) {
+  if (!flusher || !flusher->keys || !presses) {
+    return;
+  }
+  pthread_mutex_lock(&flusher->keys_lock);
+  for (size_t i = 0; i < STATS_KEYS_COUNT; ++i) {
+    flusher->keys->presses[i] += presses[i];
+    flusher->keys->total += presses[i];
+  }
+  flusher->keys_dirty = 1;
+  pthread_mutex_unlock(&flusher->keys_lock);
+}
+
+int stats_flusher_keys(stats_flusher_t *flusher, stats_keys_t *out) {
+  if (!flusher || !flusher->keys || !out) {
+    return -1;
+  }
+  pthread_mutex_lock(&flusher->keys_lock);
+  memcpy(out, flusher->keys, sizeof(*out));
+  pthread_mutex_unlock(&flusher->keys_lock);
+  return 0;
+}
+
+void stats_flusher_counts(stats_flusher_t *flusher,
+                          unsigned long *total_out,
+                          unsigned long *day_count_out) {
+  if (!flusher) {
+    return;
+  }
+  pthread_mutex_lock(&flusher->lock);
+  if (total_out) {
+    *total_out = flusher->total;
+  }
+  if (day_count_out) {
+    *day_count_out = flusher->day_count;
+  }
+  pthread_mutex_unlock(&flusher->lock);
+}
+
+int stats_flusher_flush(stats_flusher_t *flusher) {
+  if (!flusher) {
+    return -1;
+  }
+  pthread_mutex_lock(&flusher->io_lock);
+  int rc = flush_io(flusher);
+  pthread_mutex_unlock(&flusher->io_lock);
+  return rc;
+}
+
+int stats_flusher_set_day(stats_flusher_t *flusher, const char *day) {
+  if (!flusher || !day) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&flusher->io_lock);
+  if (flush_io(flusher) != 0 || save_keys(flusher, 1) != 0 ||
+      stats_compact(&flusher->stats) != 0) {
+    pthread_mutex_unlock(&flusher->io_lock);
+    return -1;
+  }
+
+  stats_t next;
+  int32_t day_number = 0;
+  if (stats_day_from_string(day, &day_number) != 0 ||
+      stats_init(&next, flusher->stats.path, day) != 0) {
+    pthread_mutex_unlock(&flusher->io_lock);
+    return -1;
+  }
+  stats_free(&flusher->stats);
+  flusher->stats = next;
+  flusher->day_number = day_number;
+
+  pthread_mutex_lock(&flusher->lock);
+  /* Counts recorded while switching stay pending and land on the new day. */
+  flusher->total = next.total + flusher->pending;
+  flusher->day_count = next.day_count + flusher->pending;
+  pthread_mutex_unlock(&flusher->lock);
+  pthread_mutex_unlock(&flusher->io_lock);
+  return 0;
+}
+
+int stats_flusher_stop(stats_flusher_t *flusher) {
+  if (!flusher || !flusher->running) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&flusher->lock);
+  flusher->running = 0;
+  pthread_mutex_unlock(&flusher->lock);
+  pthread_cond_signal(&flusher->cond);
+  pthread_join(flusher->thread, NULL);
+
+  int rc = flush_io(flusher);
+  if (save_keys(flusher, 1) != 0 || stats_compact(&flusher->stats) != 0) {
+    rc = -1;
+  }
+  index_journaled(flusher);
+  close_keys(flusher);
+  stats_free(&flusher->stats);
+  if (flusher->index_ready) {
+    if (stats_index_sync(&flusher->index) != 0) {
+      rc = -1;
+    }
+    stats_index_close(&flusher->index);
+    flusher->index_ready = 0;
+  }
+
+  pthread_cond_destroy(&flusher->cond);
+  pthread_mutex_destroy(&flusher->lock);
+  pthread_mutex_destroy(&flusher->io_lock);
+  pthread_mutex_destroy(&flusher->keys_lock);
+  return rc;
+}
@@ -0,0 +1,134 @@
+#ifndef STATS_FLUSHER_H
+#define STATS_FLUSHER_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "stats.h"
+#include "stats_index.h"
+#include "stats_keys.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  STATS_FSYNC_NONE = 0, /* rely on the kernel; compaction still fsyncs */
+  STATS_FSYNC_FLUSH     /* fdatasync the journal after every flush */
+} stats_fsync_policy_t;
+
+typedef struct {
+  unsigned int interval_ms;  /* flush pending counts at least this often */
+  unsigned long max_pending; /* flush early once this many are pending */
+  unsigned int keys_interval_ms; /* rewrite the key matrix at most this often */
+  stats_fsync_policy_t fsync_policy;
+} stats_flusher_config_t;
+
+#define STATS_FLUSHER_DEFAULT_INTERVAL_MS 2000
+#define STATS_FLUSHER_DEFAULT_MAX_PENDING 4096
+#define STATS_FLUSHER_DEFAULT_KEYS_INTERVAL_MS 60000
+
+/*
+ * Write-behind owner of a stats_t. stats_flusher_record() only adds to an
+ * in-memory delta under a short lock; a background thread folds coalesced
+ * deltas into the journal when the interval elapses or `max_pending` is
+ * reached, so callers never wait on disk I/O. `io_lock` serializes the
+ * thread with the synchronous calls below.
+ */
+typedef struct {
+  stats_t stats;
+  stats_index_t index; /* "<path>.index"; valid when index_ready */
+  int index_ready;
+  unsigned long index_pending; /* recorded into stats but not yet indexed */
+  int32_t day_number;
+  stats_keys_t *keys;         /* "<path>.keys"; NULL if unavailable */
+  stats_keys_t *keys_scratch; /* copy written by the flusher thread */
+  char *keys_path;
+  pthread_mutex_t keys_lock;
+  int keys_dirty;
+  uint64_t keys_saved_ns;
+  stats_flusher_config_t config;
+  pthread_mutex_t lock;
+  pthread_mutex_t io_lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  unsigned long pending;
+  uint64_t pending_since_ns; /* CLOCK_MONOTONIC time of the oldest delta */
+  unsigned long total;
+  unsigned long day_count;
+  unsigned long flushes;
+  unsigned long errors;
+  int running;
+} stats_flusher_t;
+
+/*
+ * Fills `config` with the defaults above and no fsync.
+ */
+void stats_flusher_default_config(stats_flusher_config_t *config);
+
+/*
+ * Loads stats for `path`/`day` and starts the flusher thread. `config` may
+ * be NULL for defaults. Flushed deltas also go to the day index at
+ * "<path>.index", which is built from the snapshot when missing or damaged
+ * (delete it to rebuild), and key counters persist in "<path>.keys", which
+ * starts over from zero if damaged.
+ * Returns 0 on success or -1.
+ */
+int stats_flusher_start(stats_flusher_t *flusher,
+                        const char *path,
+                        const char *day,
+                        const stats_flusher_config_t *config);
+
+/*
+ * Adds `count` keystrokes to the current day without blocking on I/O.
+ */
+void stats_flusher_record(stats_flusher_t *flusher, unsigned long count);
+
+/*
+ * Feeds raw scancodes to the per-key and bigram counters. Only takes the
+ * counters' lock; the matrix is written out every `keys_interval_ms` and on
+ * day rotation and stop.
+ */
+void stats_flusher_record_keys(stats_flusher_t *flusher, const uint8_t *codes, size_t len);
+
+/*
+ * Adds per-key press counts (indexed by key id) without bigrams, for
+ * sources that only report totals such as the kernel's aggregate counters.
+ */
+void stats_flusher_record_presses(stats_flusher_t *flusher, const uint64_t presses[STATS_KEYS_COUNT]);
+
+/*
+ * Copies the current key counters into `out`. Returns 0, or -1 if key
+ * counting is unavailable.
+ */
+int stats_flusher_keys(stats_flusher_t *flusher, stats_keys_t *out);
+
+/*
+ * Current totals including unflushed counts.
+ */
+void stats_flusher_counts(stats_flusher_t *flusher,
+                          unsigned long *total_out,
+                          unsigned long *day_count_out);
+
+/*
+ * Synchronously writes pending counts. Returns 0 on success or -1.
+ */
+int stats_flusher_flush(stats_flusher_t *flusher);
+
+/*
+ * Flushes the current day, compacts, and switches to `day`. Returns 0 on
+ * success or -1 (the previous day stays active on failure).
+ */
+int stats_flusher_set_day(stats_flusher_t *flusher, const char *day);
+
+/*
+ * Stops the thread, then does a final flush and compaction. Returns 0 if
+ * everything reached disk, -1 otherwise.
+ */
+int stats_flusher_stop(stats_flusher_t *flusher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
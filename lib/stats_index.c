@@ -0,0 +1,372 @@
+#include "stats_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Proleptic Gregorian conversions after Howard Hinnant's days_from_civil. */
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int64_t *y_out, unsigned *m_out, unsigned *d_out) {
+  z += 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  unsigned doe = (unsigned)(z - era * 146097);
+  unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  unsigned mp = (5 * doy + 2) / 153;
+  unsigned d = doy - (153 * mp + 2) / 5 + 1;
+  unsigned m = mp < 10 ? mp + 3 : mp - 9;
+  *y_out = (int64_t)yoe + era * 400 + (m <= 2);
+  *m_out = m;
+  *d_out = d;
+}
+
+int stats_day_from_string(const char *text, int32_t *day_out) {
+  if (!text || !day_out) {
+    return -1;
+  }
+  for (int i = 0; i < 10; ++i) {
+    int want_dash = i == 4 || i == 7;
+    if (want_dash ? text[i] != '-' : (text[i] < '0' || text[i] > '9')) {
+      return -1;
+    }
+  }
+  if (text[10] != '\0' && text[10] != '\n' && text[10] != '=') {
+    return -1;
+  }
+
+  int64_t y = (text[0] - '0') * 1000 + (text[1] - '0') * 100 + (text[2] - '0') * 10 + (text[3] - '0');
+  unsigned m = (unsigned)((text[5] - '0') * 10 + (text[6] - '0'));
+  unsigned d = (unsigned)((text[8] - '0') * 10 + (text[9] - '0'));
+  if (m < 1 || m > 12 || d < 1 || d > 31) {
+    return -1;
+  }
+
+  int64_t day = days_from_civil(y, m, d);
+  int64_t ry = 0;
+  unsigned rm = 0;
+  unsigned rd = 0;
+  civil_from_days(day, &ry, &rm, &rd);
+  if (ry != y || rm != m || rd != d) {
+    return -1; /* e.g. 2025-02-30 */
+  }
+  *day_out = (int32_t)day;
+  return 0;
+}
+
+void stats_day_to_string(int32_t day, char *out) {
+  int64_t y = 0;
+  unsigned m = 0;
+  unsigned d = 0;
+  civil_from_days(day, &y, &m, &d);
+  snprintf(out, 11, "%04d-%02u-%02u", (int)y, m, d);
+}
+
+static size_t index_file_size(uint32_t capacity) {
+  return sizeof(stats_index_header_t) + (size_t)capacity * sizeof(uint64_t) +
+         ((size_t)capacity / STATS_INDEX_BLOCK_DAYS + 1) * sizeof(uint64_t);
+}
+
+static int index_map(stats_index_t *index, size_t size) {
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, index->fd, 0);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  index->map = map;
+  index->map_size = size;
+  index->header = map;
+  index->slots = (uint64_t *)((char *)map + sizeof(stats_index_header_t));
+  index->block_prefix = index->slots + index->header->capacity;
+  return 0;
+}
+
+static void index_rebuild_prefix(stats_index_t *index) {
+  uint32_t blocks = index->header->capacity / STATS_INDEX_BLOCK_DAYS;
+  uint64_t sum = 0;
+  for (uint32_t b = 0; b < blocks; ++b) {
+    index->block_prefix[b] = sum;
+    for (uint32_t i = 0; i < STATS_INDEX_BLOCK_DAYS; ++i) {
+      sum += index->slots[b * STATS_INDEX_BLOCK_DAYS + i];
+    }
+  }
+  index->block_prefix[blocks] = sum;
+}
+
+/*
+ * Re-lays the file out for [base_day, base_day + capacity). Slots are
+ * copied aside first, since the slot array moves when the base does.
+ */
+static int index_resize(stats_index_t *index, int32_t base_day, uint32_t capacity) {
+  int32_t old_base = index->header->base_day;
+  uint32_t old_capacity = index->header->capacity;
+  uint64_t *old_slots = malloc((size_t)old_capacity * sizeof(uint64_t));
+  if (!old_slots) {
+    return -1;
+  }
+  memcpy(old_slots, index->slots, (size_t)old_capacity * sizeof(uint64_t));
+
+  size_t size = index_file_size(capacity);
+  munmap(index->map, index->map_size);
+  index->map = NULL;
+  if (ftruncate(index->fd, (off_t)size) != 0) {
+    free(old_slots);
+    return -1;
+  }
+
+  stats_index_header_t header;
+  if (pread(index->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+    free(old_slots);
+    return -1;
+  }
+  header.base_day = base_day;
+  header.capacity = capacity;
+  if (pwrite(index->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+      index_map(index, size) != 0) {
+    free(old_slots);
+    return -1;
+  }
+
+  memset(index->slots, 0, (size_t)capacity * sizeof(uint64_t));
+  memcpy(index->slots + (old_base - base_day), old_slots, (size_t)old_capacity * sizeof(uint64_t));
+  free(old_slots);
+  index_rebuild_prefix(index);
+  return 0;
+}
+
+static uint32_t round_up_grow(int64_t days) {
+  return (uint32_t)((days + STATS_INDEX_GROW_DAYS - 1) / STATS_INDEX_GROW_DAYS * STATS_INDEX_GROW_DAYS);
+}
+
+/* Returns the slot for `day`, growing the index to cover it. */
+static int64_t index_slot(stats_index_t *index, int32_t day) {
+  int64_t base = index->header->base_day;
+  int64_t capacity = index->header->capacity;
+  if (day >= base && day < base + capacity) {
+    return day - base;
+  }
+
+  if (day < base) {
+    uint32_t shift = round_up_grow(base - day);
+    base -= shift;
+    capacity += shift;
+  }
+  if (day >= base + capacity) {
+    capacity = round_up_grow(day - base + 1);
+  }
+  if (capacity > (int64_t)UINT32_MAX - STATS_INDEX_GROW_DAYS ||
+      index_resize(index, (int32_t)base, (uint32_t)capacity) != 0) {
+    return -1;
+  }
+  return day - base;
+}
+
+int stats_index_open(stats_index_t *index, const char *path, int32_t base_day) {
+  if (!index || !path) {
+    return -1;
+  }
+  memset(index, 0, sizeof(*index));
+  index->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (index->fd < 0) {
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(index->fd, &st) != 0) {
+    stats_index_close(index);
+    return -1;
+  }
+
+  stats_index_header_t header;
+  if (st.st_size == 0) {
+    memset(&header, 0, sizeof(header));
+    header.magic = STATS_INDEX_MAGIC;
+    header.version = STATS_INDEX_VERSION;
+    /* Block-align the base so blocks line up with day numbers. */
+    header.base_day = base_day - (int32_t)(((base_day % STATS_INDEX_BLOCK_DAYS) + STATS_INDEX_BLOCK_DAYS) %
+                                           STATS_INDEX_BLOCK_DAYS);
+    header.capacity = STATS_INDEX_GROW_DAYS;
+    header.block_days = STATS_INDEX_BLOCK_DAYS;
+    if (ftruncate(index->fd, (off_t)index_file_size(header.capacity)) != 0 ||
+        pwrite(index->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+      stats_index_close(index);
+      return -1;
+    }
+  } else if (pread(index->fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+             header.magic != STATS_INDEX_MAGIC || header.version != STATS_INDEX_VERSION ||
+             header.block_days != STATS_INDEX_BLOCK_DAYS ||
+             header.capacity % STATS_INDEX_BLOCK_DAYS != 0 ||
+             (size_t)st.st_size != index_file_size(header.capacity)) {
+    stats_index_close(index);
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (index_map(index, index_file_size(header.capacity)) != 0) {
+    stats_index_close(index);
+    return -1;
+  }
+  index_rebuild_prefix(index);
+  return 0;
+}
+
+/* Adds `delta` (mod 2^64, so set() can pass a negative difference). */
+static void index_apply(stats_index_t *index, int64_t slot, uint64_t delta) {
+  uint32_t blocks = index->header->capacity / STATS_INDEX_BLOCK_DAYS;
+  index->slots[slot] += delta;
+  /* Only blocks after this one change; for today that is a handful. */
+  for (uint32_t b = (uint32_t)(slot / STATS_INDEX_BLOCK_DAYS) + 1; b <= blocks; ++b) {
+    index->block_prefix[b] += delta;
+  }
+}
+
+int stats_index_add(stats_index_t *index, int32_t day, uint64_t delta) {
+  if (!index || !index->map) {
+    return -1;
+  }
+  int64_t slot = index_slot(index, day);
+  if (slot < 0) {
+    return -1;
+  }
+  index_apply(index, slot, delta);
+  return 0;
+}
+
+int stats_index_set(stats_index_t *index, int32_t day, uint64_t value) {
+  if (!index || !index->map) {
+    return -1;
+  }
+  int64_t slot = index_slot(index, day);
+  if (slot < 0) {
+    return -1;
+  }
+  index_apply(index, slot, value - index->slots[slot]);
+  return 0;
+}
+
+uint64_t stats_index_get(const stats_index_t *index, int32_t day) {
+  if (!index || !index->map) {
+    return 0;
+  }
+  int64_t slot = (int64_t)day - index->header->base_day;
+  if (slot < 0 || slot >= index->header->capacity) {
+    return 0;
+  }
+  return index->slots[slot];
+}
+
+/* Sum of slots [0, end). */
+static uint64_t index_cumulative(const stats_index_t *index, int64_t end) {
+  int64_t block = end / STATS_INDEX_BLOCK_DAYS;
+  uint64_t sum = index->block_prefix[block];
+  for (int64_t i = block * STATS_INDEX_BLOCK_DAYS; i < end; ++i) {
+    sum += index->slots[i];
+  }
+  return sum;
+}
+
+uint64_t stats_index_range(const stats_index_t *index, int32_t first, int32_t last) {
+  if (!index || !index->map) {
+    return 0;
+  }
+  int64_t base = index->header->base_day;
+  int64_t lo = (int64_t)first - base;
+  int64_t hi = (int64_t)last - base + 1;
+  if (lo < 0) {
+    lo = 0;
+  }
+  if (hi > index->header->capacity) {
+    hi = index->header->capacity;
+  }
+  if (lo >= hi) {
+    return 0;
+  }
+  return index_cumulative(index, hi) - index_cumulative(index, lo);
+}
+
+uint64_t stats_index_week(const stats_index_t *index, int32_t day) {
+  int32_t weekday = (int32_t)((((int64_t)day + 3) % 7 + 7) % 7); /* 0 = Monday */
+  return stats_index_range(index, day - weekday, day - weekday + 6);
+}
+
+uint64_t stats_index_month(const stats_index_t *index, int32_t day) {
+  int64_t y = 0;
+  unsigned m = 0;
+  unsigned d = 0;
+  civil_from_days(day, &y, &m, &d);
+  int64_t first = days_from_civil(y, m, 1);
+  int64_t next = m == 12 ? days_from_civil(y + 1, 1, 1) : days_from_civil(y, m + 1, 1);
+  return stats_index_range(index, (int32_t)first, (int32_t)(next - 1));
+}
+
+uint64_t stats_index_year(const stats_index_t *index, int32_t day) {
+  int64_t y = 0;
+  unsigned m = 0;
+  unsigned d = 0;
+  civil_from_days(day, &y, &m, &d);
+  return stats_index_range(index, (int32_t)days_from_civil(y, 1, 1),
+                           (int32_t)(days_from_civil(y + 1, 1, 1) - 1));
+}
+
+long stats_index_import_text(stats_index_t *index, const char *text_path) {
+  if (!index || !index->map || !text_path) {
+    return -1;
+  }
+  FILE *fp = fopen(text_path, "r");
+  if (!fp) {
+    return -1;
+  }
+
+  long imported = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), fp)) {
+    int32_t day = 0;
+    if (stats_day_from_string(line, &day) != 0 || line[10] != '=') {
+      continue; /* total=, journal= and anything else */
+    }
+    char *end = NULL;
+    unsigned long long value = strtoull(line + 11, &end, 10);
+    if (end == line + 11) {
+      continue;
+    }
+    if (stats_index_set(index, day, value) != 0) {
+      fclose(fp);
+      return -1;
+    }
+    ++imported;
+  }
+  fclose(fp);
+  return imported;
+}
+
+int stats_index_sync(stats_index_t *index) {
+  if (!index || !index->map) {
+    return -1;
+  }
+  return msync(index->map, index->map_size, MS_SYNC);
+}
+
+void stats_index_close(stats_index_t *index) {
+  if (!index) {
+    return;
+  }
+  if (index->map) {
+    munmap(index->map, index->map_size);
+  }
+  if (index->fd >= 0) {
+    close(index->fd);
+  }
+  memset(index, 0, sizeof(*index));
+  index->fd = -1;
+}
@@ -0,0 +1,105 @@
+#ifndef STATS_INDEX_H
+#define STATS_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Memory-mapped per-day counters. Days are numbered from 1970-01-01 and
+ * stored in fixed 8-byte slots starting at `base_day`, so any date is one
+ * load. Slots are grouped in blocks of STATS_INDEX_BLOCK_DAYS, and each block
+ * keeps the sum of all slots before it. A range sum is then two block
+ * prefixes plus at most two partial blocks, whatever the span.
+ *
+ * File layout: header, `capacity` slots, then `capacity / BLOCK + 1` block
+ * prefixes (the last one is the grand total).
+ */
+#define STATS_INDEX_MAGIC 0x6b626469u /* "kbdi" */
+#define STATS_INDEX_VERSION 1
+#define STATS_INDEX_BLOCK_DAYS 32
+/* Capacity grows in steps of this many days (about 2.8 years). */
+#define STATS_INDEX_GROW_DAYS 1024
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  int32_t base_day;
+  uint32_t capacity;
+  uint32_t block_days;
+  uint32_t reserved[11];
+} stats_index_header_t;
+
+typedef struct {
+  int fd;
+  void *map;
+  size_t map_size;
+  stats_index_header_t *header;
+  uint64_t *slots;
+  uint64_t *block_prefix;
+} stats_index_t;
+
+/*
+ * Converts "YYYY-MM-DD" to a day number. Returns 0 on success or -1.
+ */
+int stats_day_from_string(const char *text, int32_t *day_out);
+
+/*
+ * Writes `day` as "YYYY-MM-DD" into `out` (at least 11 bytes).
+ */
+void stats_day_to_string(int32_t day, char *out);
+
+/*
+ * Opens or creates the index at `path`. `base_day` only seeds a new file;
+ * the index grows in either direction as days are added. Block prefixes are
+ * rebuilt on open, so a crash between a slot update and its prefixes is
+ * harmless. Returns 0 on success or -1.
+ */
+int stats_index_open(stats_index_t *index, const char *path, int32_t base_day);
+
+/*
+ * Adds `delta` to `day` (O(1) for recent days) or overwrites it. Returns 0
+ * on success or -1.
+ */
+int stats_index_add(stats_index_t *index, int32_t day, uint64_t delta);
+int stats_index_set(stats_index_t *index, int32_t day, uint64_t value);
+
+/*
+ * Count for one day; 0 outside the stored range.
+ */
+uint64_t stats_index_get(const stats_index_t *index, int32_t day);
+
+/*
+ * Sum over the inclusive range [first, last].
+ */
+uint64_t stats_index_range(const stats_index_t *index, int32_t first, int32_t last);
+
+/*
+ * Sums for the Monday-to-Sunday week, calendar month and calendar year that
+ * contain `day`.
+ */
+uint64_t stats_index_week(const stats_index_t *index, int32_t day);
+uint64_t stats_index_month(const stats_index_t *index, int32_t day);
+uint64_t stats_index_year(const stats_index_t *index, int32_t day);
+
+/*
+ * Copies every "YYYY-MM-DD=N" line of a stats.txt snapshot into the index,
+ * overwriting those days, so importing twice is harmless. Returns the
+ * number of days imported, or -1.
+ */
+long stats_index_import_text(stats_index_t *index, const char *text_path);
+
+/*
+ * Flushes the mapping to disk. Returns 0 on success or -1.
+ */
+int stats_index_sync(stats_index_t *index);
+void stats_index_close(stats_index_t *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,135 @@
+#include "stats_keys.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t total;
+} stats_keys_header_t;
+
+void stats_keys_init(stats_keys_t *keys) {
+  if (!keys) {
+    return;
+  }
+  memset(keys, 0, sizeof(*keys));
+  keys->prev = -1;
+}
+
+static void count_bigram(uint32_t *counter) {
+  *counter += *counter != UINT32_MAX;
+}
+
+void stats_keys_feed(stats_keys_t *keys, const uint8_t *codes, size_t len) {
+  if (!keys || !codes) {
+    return;
+  }
+  for (size_t i = 0; i < len; ++i) {
+    unsigned int id = 0;
+    int is_break = 0;
+    if (!scancode_key_id(&keys->prefix, codes[i], &id, &is_break) || is_break) {
+      continue;
+    }
+
+    keys->presses[id]++;
+    keys->total++;
+    if (keys->prev >= 0) {
+      count_bigram(&keys->bigrams[keys->prev][id]);
+    }
+    keys->prev = (int)id;
+  }
+}
+
+int stats_keys_load(stats_keys_t *keys, const char *path) {
+  if (!keys || !path) {
+    return -1;
+  }
+  stats_keys_init(keys);
+
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    return errno == ENOENT ? 0 : -1;
+  }
+
+  stats_keys_header_t header;
+  int ok = fread(&header, sizeof(header), 1, fp) == 1 && header.magic == STATS_KEYS_MAGIC &&
+           header.version == STATS_KEYS_VERSION &&
+           fread(keys->presses, sizeof(keys->presses), 1, fp) == 1 &&
+           fread(keys->bigrams, sizeof(keys->bigrams), 1, fp) == 1;
+  fclose(fp);
+  if (!ok) {
+    stats_keys_init(keys);
+    errno = EINVAL;
+    return -1;
+  }
+  keys->total = header.total;
+  return 0;
+}
+
+int stats_keys_save(const stats_keys_t *keys, const char *path, int sync) {
+  if (!keys || !path) {
+    return -1;
+  }
+  size_t len = strlen(path);
+  char *tmp_path = malloc(len + sizeof(".tmp"));
+  if (!tmp_path) {
+    return -1;
+  }
+  memcpy(tmp_path, path, len);
+  memcpy(tmp_path + len, ".tmp", sizeof(".tmp"));
+
+  FILE *fp = fopen(tmp_path, "wb");
+  if (!fp) {
+    free(tmp_path);
+    return -1;
+  }
+  stats_keys_header_t header = {STATS_KEYS_MAGIC, STATS_KEYS_VERSION, keys->total};
+  int rc = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                   fwrite(keys->presses, sizeof(keys->presses), 1, fp) == 1 &&
+                   fwrite(keys->bigrams, sizeof(keys->bigrams), 1, fp) == 1 && fflush(fp) == 0
+               ? 0
+               : -1;
+  if (rc == 0 && sync && fsync(fileno(fp)) != 0) {
+    rc = -1;
+  }
+  if (fclose(fp) != 0) {
+    rc = -1;
+  }
+  if (rc == 0 && rename(tmp_path, path) != 0) {
+    rc = -1;
+  }
+  if (rc != 0) {
+    unlink(tmp_path);
+  }
+  free(tmp_path);
+  return rc;
+}
+
+size_t stats_keys_top_bigrams(const stats_keys_t *keys, stats_bigram_t *out, size_t max) {
+  if (!keys || !out || max == 0) {
+    return 0;
+  }
+  size_t n = 0;
+  for (unsigned int i = 0; i < STATS_KEYS_COUNT; ++i) {
+    for (unsigned int j = 0; j < STATS_KEYS_COUNT; ++j) {
+      uint32_t count = keys->bigrams[i][j];
+      if (count == 0 || (n == max && count <= out[n - 1].count)) {
+        continue;
+      }
+      /* Insertion into the short sorted list. */
+      size_t pos = n < max ? n++ : n - 1;
+      while (pos > 0 && out[pos - 1].count < count) {
+        out[pos] = out[pos - 1];
+        --pos;
+      }
+      out[pos].first = (uint8_t)i;
+      out[pos].second = (uint8_t)j;
+      out[pos].count = count;
+    }
+  }
+  return n;
+}
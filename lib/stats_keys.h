@@ -0,0 +1,73 @@
+#ifndef STATS_KEYS_H
+#define STATS_KEYS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scancode_map.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Key ids are set-1 make codes with 0x80 set for 0xE0-prefixed keys, so
+ * e.g. 0x1E is A and 0xC8 is the Up arrow. Pause (0xE1 ...) and the fake
+ * shifts around Print Screen are not counted.
+ */
+#define STATS_KEYS_COUNT 256
+
+#define STATS_KEYS_MAGIC 0x6b62646bu /* "kbdk" */
+#define STATS_KEYS_VERSION 1
+
+/*
+ * Press counts per key and a dense bigram matrix (previous key, key) of
+ * saturating 32-bit counters: 256 KiB, updated with two stores per key.
+ * The on-disk format is this struct's counters behind a small header.
+ */
+typedef struct {
+  uint64_t presses[STATS_KEYS_COUNT];
+  uint32_t bigrams[STATS_KEYS_COUNT][STATS_KEYS_COUNT];
+  uint64_t total;
+  int prev; /* previous key id, or -1 */
+  scancode_key_state_t prefix;
+} stats_keys_t;
+
+typedef struct {
+  uint8_t first;
+  uint8_t second;
+  uint32_t count;
+} stats_bigram_t;
+
+void stats_keys_init(stats_keys_t *keys);
+
+/*
+ * Counts the key presses in a raw scancode stream. Sequences may span
+ * calls.
+ */
+void stats_keys_feed(stats_keys_t *keys, const uint8_t *codes, size_t len);
+
+/*
+ * Loads counters from `path`; a missing file leaves them zeroed. Returns 0
+ * on success or -1 for I/O errors and foreign or truncated files (errno
+ * EINVAL; the counters are then zeroed too).
+ */
+int stats_keys_load(stats_keys_t *keys, const char *path);
+
+/*
+ * Writes the counters to a temp file and renames it over `path`, with an
+ * fsync first if `sync` is set. Returns 0 on success or -1.
+ */
+int stats_keys_save(const stats_keys_t *keys, const char *path, int sync);
+
+/*
+ * Fills `out` with up to `max` most frequent bigrams, most frequent first.
+ * Returns how many were written.
+ */
+size_t stats_keys_top_bigrams(const stats_keys_t *keys, stats_bigram_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#include "kbd_device.h"
+#include "test_util.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static void press(struct kbd_key_counts *counts, unsigned int key, uint64_t n) {
+  counts->presses[key] += n;
+  counts->total += n;
+}
+
+int main(void) {
+  int failures = 0;
+  static struct kbd_key_counts prev;
+  static struct kbd_key_counts cur;
+  uint64_t presses[KBD_KEY_COUNT];
+
+  /* A delta counts only what happened between the snapshots. */
+  press(&prev, 0x1E, 5);
+  cur = prev;
+  press(&cur, 0x1E, 2);
+  press(&cur, 0x0E, 1);        /* backspace types nothing */
+  press(&cur, 0x80 | 0x35, 1); /* keypad '/' */
+  failures += check(kbd_device_key_delta(&prev, &cur, SCANCODE_LAYOUT_US, presses) == 3, "delta counted");
+  failures += check(presses[0x1E] == 2 && presses[0x0E] == 1 && presses[0x80 | 0x35] == 1, "delta presses");
+  failures += check(kbd_device_key_delta(&cur, &cur, SCANCODE_LAYOUT_US, presses) == 0, "empty delta");
+
+  /* The extra ISO key only types on layouts that have it. */
+  memset(&cur, 0, sizeof(cur));
+  press(&cur, 0x56, 4);
+  failures += check(kbd_device_key_delta(NULL, &cur, SCANCODE_LAYOUT_US, presses) == 0, "no 0x56 on US");
+  failures += check(kbd_device_key_delta(NULL, &cur, SCANCODE_LAYOUT_UK, presses) == 4, "0x56 on UK");
+
+  /* A reload starts the counters over: the new snapshot is the delta. */
+  failures += check(kbd_device_key_delta(&prev, &cur, SCANCODE_LAYOUT_UK, presses) == 4, "reset counted");
+  failures += check(presses[0x56] == 4 && presses[0x1E] == 0, "reset presses");
+
+  /* Not a kbd_sim node. */
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return 1;
+  }
+  errno = 0;
+  failures += check(kbd_device_key_counts(fds[0], &cur) == -1 && errno == ENOTTY, "pipe has no counters");
+  close(fds[0]);
+  close(fds[1]);
+  return failures ? 1 : 0;
+}
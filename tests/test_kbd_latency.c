@@ -0,0 +1,121 @@
+#include "kbd_latency.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Pushes one key through a traced or untraced raw reader; returns its batch. */
+static int read_one(int trace, kbd_reader_batch_t *out) {
+  int fds[2];
+  if (open_pipe(fds) != 0) {
+    return -1;
+  }
+  kbd_reader_config_t config = {0};
+  config.fd = fds[0];
+  config.format = KBD_FORMAT_RAW;
+  config.layout = SCANCODE_LAYOUT_US;
+  config.trace = trace;
+  kbd_reader_t reader;
+  if (kbd_reader_start(&reader, &config) != 0) {
+    return -1;
+  }
+  static const uint8_t a[] = {0x1E, 0x9E};
+  size_t n = 0;
+  if (write(fds[1], a, sizeof(a)) == (ssize_t)sizeof(a)) {
+    for (int tries = 0; tries < 200 && n == 0; ++tries) {
+      n = kbd_reader_drain(&reader, out, 1);
+      if (n == 0) {
+        sleep_ms(10);
+      }
+    }
+  }
+  kbd_reader_stop(&reader);
+  close(fds[0]);
+  close(fds[1]);
+  return n == 1 ? 0 : -1;
+}
+
+int main(void) {
+  int failures = 0;
+  kbd_latency_t *lat = malloc(sizeof(*lat));
+  if (!lat) {
+    return 1;
+  }
+
+  /* Stamps from the reader thread. */
+  kbd_reader_batch_t batch;
+  failures += check(read_one(1, &batch) == 0, "traced batch");
+  failures += check(batch.read_ns != 0 && batch.read_ns == batch.ts_ns, "raw read stamp is the read time");
+  failures += check(batch.decode_ns >= batch.read_ns, "decode after read");
+  failures += check(read_one(0, &batch) == 0, "untraced batch");
+  failures += check(batch.read_ns == 0 && batch.decode_ns == 0, "no stamps without trace");
+
+  /* Untraced batches are ignored. */
+  kbd_latency_init(lat);
+  kbd_latency_drained(lat, &batch, 0, 5000);
+  failures += check(lat->pending == 0 && lat->stages[KBD_LAT_QUEUE].total == 0, "untraced ignored");
+
+  /* Record format: capture 1000, read 3000, decoded 3500, drained 10000, painted 26000. */
+  memset(&batch, 0, sizeof(batch));
+  batch.ts_ns = 1000;
+  batch.read_ns = 3000;
+  batch.decode_ns = 3500;
+  kbd_latency_drained(lat, &batch, 1, 10000);
+  batch.ts_ns = 2000;
+  kbd_latency_drained(lat, &batch, 1, 10000);
+  failures += check(lat->pending == 2, "pending until painted");
+  failures += check(lat->stages[KBD_LAT_TOTAL].total == 0, "total waits for paint");
+  kbd_latency_painted(lat, 26000);
+  failures += check(lat->pending == 0, "paint clears pending");
+  failures += check(lat->stages[KBD_LAT_READ].min == 1000 && lat->stages[KBD_LAT_READ].max == 2000, "read stage");
+  failures += check(lat->stages[KBD_LAT_DECODE].max == 500, "decode stage");
+  failures += check(lat->stages[KBD_LAT_QUEUE].max == 6500, "queue stage");
+  failures += check(lat->stages[KBD_LAT_PAINT].total == 2 && lat->stages[KBD_LAT_PAINT].max == 16000, "paint stage");
+  failures += check(lat->stages[KBD_LAT_TOTAL].min == 24000 && lat->stages[KBD_LAT_TOTAL].max == 25000, "total stage");
+
+  /* Raw streams have no capture stamp: total starts at the read. */
+  kbd_latency_init(lat);
+  kbd_latency_drained(lat, &batch, 0, 10000);
+  kbd_latency_painted(lat, 13000);
+  failures += check(lat->stages[KBD_LAT_READ].total == 0, "no read stage for raw");
+  failures += check(lat->stages[KBD_LAT_TOTAL].max == 10000, "raw total from read");
+
+  /* A stalled paint bounds the pending list instead of growing it. */
+  kbd_latency_init(lat);
+  for (int i = 0; i < KBD_LATENCY_PENDING + 10; ++i) {
+    kbd_latency_drained(lat, &batch, 1, 10000);
+  }
+  failures += check(lat->pending == KBD_LATENCY_PENDING && lat->unsampled == 10, "pending capped");
+  failures += check(lat->stages[KBD_LAT_QUEUE].total == KBD_LATENCY_PENDING + 10, "queue stage still sampled");
+  kbd_latency_painted(lat, 20000);
+
+  char path[] = "/tmp/test_kbd_latency_XXXXXX";
+  int fd = mkstemp(path);
+  failures += check(fd >= 0, "mkstemp");
+  if (fd >= 0) {
+    close(fd);
+    failures += check(kbd_latency_write_csv(lat, path) == 0, "write csv");
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    int lines = 0;
+    int saw_total = 0;
+    while (fp && fgets(line, sizeof(line), fp)) {
+      ++lines;
+      if (strncmp(line, "total,4096,18000,", 17) == 0) {
+        saw_total = 1;
+      }
+    }
+    if (fp) {
+      fclose(fp);
+    }
+    failures += check(lines == 1 + KBD_LAT_STAGES, "one row per stage");
+    failures += check(saw_total, "total row");
+    unlink(path);
+  }
+  failures += check(strcmp(kbd_latency_stage_name(KBD_LAT_PAINT), "paint") == 0, "stage name");
+
+  free(lat);
+  return failures ? 1 : 0;
+}
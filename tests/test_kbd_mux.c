@@ -0,0 +1,137 @@
+#include "kbd_mux.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SLOTS 4
+
+/* Drains one slot until `want` bytes of text arrived or about two seconds passed. */
+static size_t drain_text(kbd_mux_t *mux, size_t slot, char *text, size_t want) {
+  size_t len = 0;
+  kbd_reader_batch_t batches[8];
+  for (int tries = 0; tries < 200 && len < want; ++tries) {
+    size_t n = kbd_mux_drain(mux, slot, batches, 8);
+    for (size_t i = 0; i < n; ++i) {
+      memcpy(text + len, batches[i].text, batches[i].text_len);
+      len += batches[i].text_len;
+    }
+    if (n == 0) {
+      sleep_ms(10);
+    }
+  }
+  text[len] = '\0';
+  return len;
+}
+
+static unsigned long wait_total(stats_flusher_t *flusher, unsigned long want) {
+  unsigned long total = 0;
+  unsigned long day_count = 0;
+  for (int tries = 0; tries < 200; ++tries) {
+    stats_flusher_counts(flusher, &total, &day_count);
+    if (total >= want) {
+      break;
+    }
+    sleep_ms(10);
+  }
+  return total;
+}
+
+static void remove_stats(const char *path) {
+  static const char *const suffixes[] = {"", ".journal", ".index", ".keys"};
+  for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%s", path, suffixes[i]);
+    unlink(name);
+  }
+}
+
+int main(void) {
+  int failures = 0;
+  kbd_mux_t mux;
+  int fds[SLOTS][2];
+  char text[64];
+  kbd_reader_config_t config = {0};
+  config.format = KBD_FORMAT_RAW;
+  config.layout = SCANCODE_LAYOUT_US;
+
+  /* Slots 2 and 3 each count into their own stats files. */
+  char stats_path[2][32];
+  stats_flusher_t flushers[2];
+  for (int i = 0; i < 2; ++i) {
+    snprintf(stats_path[i], sizeof(stats_path[i]), "/tmp/test_kbd_mux_XXXXXX");
+    int fd = mkstemp(stats_path[i]);
+    if (fd < 0) {
+      return 1;
+    }
+    close(fd);
+    unlink(stats_path[i]);
+    failures += check(stats_flusher_start(&flushers[i], stats_path[i], "2025-01-01", NULL) == 0, "start flusher");
+  }
+
+  failures += check(kbd_mux_start(&mux, SLOTS, 2) == 0, "start");
+  failures += check(mux.worker_count == 2, "two workers");
+  for (size_t slot = 0; slot < SLOTS; ++slot) {
+    if (open_pipe(fds[slot]) != 0) {
+      return 1;
+    }
+    config.fd = fds[slot][0];
+    config.stats = slot >= 2 ? &flushers[slot - 2] : NULL;
+    failures += check(kbd_mux_attach(&mux, slot, &config) == 0, "attach");
+  }
+  failures += check(kbd_mux_attach(&mux, 0, &config) == -1, "active slot refused");
+  failures += check(kbd_mux_attach(&mux, SLOTS, &config) == -1, "slot out of range");
+
+  /* Shift is held on slot 0 only: decoder state is per device. */
+  static const uint8_t shift[] = {0x2A};
+  static const uint8_t a[] = {0x1E, 0x9E};
+  failures += check(write(fds[0][1], shift, sizeof(shift)) == 1, "write shift");
+  for (size_t slot = 0; slot < SLOTS; ++slot) {
+    failures += check(write(fds[slot][1], a, sizeof(a)) == 2, "write a");
+  }
+  failures += check(drain_text(&mux, 0, text, 8) == 8 && strcmp(text, "<SHIFT>A") == 0, "slot 0 shifted");
+  for (size_t slot = 1; slot < SLOTS; ++slot) {
+    failures += check(drain_text(&mux, slot, text, 1) == 1 && strcmp(text, "a") == 0, "other slots not shifted");
+  }
+
+  /* Separate stats streams. */
+  static const uint8_t more[] = {0x1E, 0x9E, 0x1E, 0x9E};
+  failures += check(write(fds[3][1], more, sizeof(more)) == (ssize_t)sizeof(more), "write more");
+  failures += check(wait_total(&flushers[1], 3) == 3, "slot 3 counts its own keys");
+  failures += check(wait_total(&flushers[0], 1) == 1, "slot 2 unaffected");
+
+  /* EOF closes one slot; a reopened device can take it over. */
+  close(fds[1][1]);
+  for (int tries = 0; tries < 200 && __atomic_load_n(&mux.sources[1].state, __ATOMIC_ACQUIRE) != KBD_MUX_CLOSED;
+       ++tries) {
+    sleep_ms(10);
+  }
+  kbd_reader_status_t status = {0};
+  failures += check(kbd_mux_status(&mux, 1, &status) == 0 && status.closed, "slot 1 closed");
+  close(fds[1][0]);
+  if (open_pipe(fds[1]) != 0) {
+    return 1;
+  }
+  config.fd = fds[1][0];
+  config.stats = NULL;
+  failures += check(kbd_mux_attach(&mux, 1, &config) == 0, "reattach");
+  static const uint8_t b[] = {0x30, 0xB0};
+  failures += check(write(fds[1][1], b, sizeof(b)) == 2, "write b");
+  failures += check(drain_text(&mux, 1, text, 1) == 1 && strcmp(text, "b") == 0, "reattached slot reads");
+  kbd_mux_status(&mux, 1, &status);
+  failures += check(!status.closed && status.backend == KBD_READER_BACKEND_POLL, "fresh status");
+
+  kbd_mux_stop(&mux);
+  failures += check(kbd_mux_status(&mux, 0, &status) == -1, "stopped");
+  for (size_t slot = 0; slot < SLOTS; ++slot) {
+    close(fds[slot][0]);
+    close(fds[slot][1]);
+  }
+  for (int i = 0; i < 2; ++i) {
+    stats_flusher_stop(&flushers[i]);
+    remove_stats(stats_path[i]);
+  }
+  return failures ? 1 : 0;
+}
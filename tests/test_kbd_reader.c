@@ -0,0 +1,166 @@
+#include "kbd_reader.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Drains until `want` bytes of text arrived or about two seconds passed. */
+static size_t drain_text(kbd_reader_t *reader, char *text, size_t want, uint64_t *last_ts) {
+  size_t len = 0;
+  kbd_reader_batch_t batches[8];
+  for (int tries = 0; tries < 200 && len < want; ++tries) {
+    size_t n = kbd_reader_drain(reader, batches, 8);
+    for (size_t i = 0; i < n; ++i) {
+      memcpy(text + len, batches[i].text, batches[i].text_len);
+      len += batches[i].text_len;
+      *last_ts = batches[i].ts_ns;
+    }
+    if (n == 0) {
+      sleep_ms(10);
+    }
+  }
+  return len;
+}
+
+static int wait_closed(kbd_reader_t *reader) {
+  kbd_reader_status_t status;
+  for (int tries = 0; tries < 200; ++tries) {
+    kbd_reader_status(reader, &status);
+    if (status.closed) {
+      return 1;
+    }
+    sleep_ms(10);
+  }
+  return 0;
+}
+
+int main(void) {
+  int failures = 0;
+  int fds[2];
+  char text[256];
+  uint64_t ts = 0;
+  kbd_reader_t reader;
+  kbd_reader_config_t config = {0};
+
+  /* Raw stream: "Hi" with shift, decoded on the reader thread, per backend. */
+  static const kbd_reader_backend_t backends[] = {KBD_READER_BACKEND_POLL, KBD_READER_BACKEND_AUTO};
+  size_t len = 0;
+  for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); ++b) {
+    if (open_pipe(fds) != 0) {
+      return 1;
+    }
+    config.fd = fds[0];
+    config.format = KBD_FORMAT_RAW;
+    config.layout = SCANCODE_LAYOUT_US;
+    config.backend = backends[b];
+    failures += check(kbd_reader_start(&reader, &config) == 0, "start raw");
+    kbd_reader_status_t started;
+    kbd_reader_status(&reader, &started);
+    /* AUTO resolves to whichever backend this kernel allows. */
+    failures += check(started.backend != KBD_READER_BACKEND_AUTO, "backend resolved");
+    failures += check(backends[b] != KBD_READER_BACKEND_POLL || started.backend == KBD_READER_BACKEND_POLL,
+                      "poll backend honoured");
+    static const uint8_t hi[] = {0x2A, 0x23, 0xA3, 0xAA, 0x17, 0x97};
+    failures += check(write(fds[1], hi, sizeof(hi)) == (ssize_t)sizeof(hi), "write raw");
+    len = drain_text(&reader, text, 9, &ts);
+    failures += check(len == 9 && memcmp(text, "<SHIFT>Hi", 9) == 0, "raw text");
+    /* A second burst after the reader went idle, to cover re-arming. */
+    sleep_ms(20);
+    failures += check(write(fds[1], hi + 1, 2) == 2, "write raw again");
+    len = drain_text(&reader, text, 1, &ts);
+    failures += check(len == 1 && text[0] == 'h', "raw text after idle");
+    close(fds[1]);
+    failures += check(wait_closed(&reader), "EOF closes the reader");
+    kbd_reader_stop(&reader);
+    close(fds[0]);
+  }
+  config.backend = KBD_READER_BACKEND_AUTO;
+
+  /* Records carry their own timestamps and sequence numbers. */
+  if (open_pipe(fds) != 0) {
+    return 1;
+  }
+  config.fd = fds[0];
+  config.format = KBD_FORMAT_RECORD;
+  failures += check(kbd_reader_start(&reader, &config) == 0, "start record");
+  struct kbd_event events[3];
+  memset(events, 0, sizeof(events));
+  const uint8_t codes[3] = {0x1E, 0x9E, 0x30};
+  const uint32_t seqs[3] = {0, 1, 3}; /* seq 2 lost */
+  for (int i = 0; i < 3; ++i) {
+    events[i].timestamp_ns = 1000 + (uint64_t)i;
+    events[i].seq = seqs[i];
+    events[i].scancode = codes[i];
+  }
+  failures += check(write(fds[1], events, sizeof(events)) == (ssize_t)sizeof(events), "write records");
+  len = drain_text(&reader, text, 2, &ts);
+  failures += check(len == 2 && memcmp(text, "ab", 2) == 0, "record text");
+  failures += check(ts == 1002, "record timestamp");
+  kbd_reader_status_t status;
+  kbd_reader_status(&reader, &status);
+  failures += check(status.events == 3 && status.lost == 1, "record counters");
+  kbd_reader_stop(&reader);
+  close(fds[1]);
+  close(fds[0]);
+
+  /* A consumer that never drains costs display batches, not the decode. */
+  if (open_pipe(fds) != 0) {
+    return 1;
+  }
+  config.fd = fds[0];
+  config.format = KBD_FORMAT_RAW;
+  config.queue_capacity = 2;
+  failures += check(kbd_reader_start(&reader, &config) == 0, "start small queue");
+  uint8_t burst[96];
+  for (size_t i = 0; i < sizeof(burst); i += 2) {
+    burst[i] = 0x1E;
+    burst[i + 1] = 0x9E;
+  }
+  failures += check(write(fds[1], burst, sizeof(burst)) == (ssize_t)sizeof(burst), "write burst");
+  close(fds[1]);
+  failures += check(wait_closed(&reader), "burst consumed");
+  kbd_reader_status(&reader, &status);
+  failures += check(status.dropped >= 4, "overflow counted as dropped batches");
+  kbd_reader_batch_t batches[4];
+  failures += check(kbd_reader_drain(&reader, batches, 4) == 2, "queue kept its capacity");
+  kbd_reader_stop(&reader);
+  close(fds[0]);
+
+  /* Count-only readers feed stats without a queue (kbdd). */
+  char stats_path[] = "/tmp/test_kbd_reader_XXXXXX";
+  int stats_fd = mkstemp(stats_path);
+  stats_flusher_t flusher;
+  if (stats_fd < 0 || open_pipe(fds) != 0) {
+    return 1;
+  }
+  close(stats_fd);
+  unlink(stats_path);
+  failures += check(stats_flusher_start(&flusher, stats_path, "2025-01-01", NULL) == 0, "start flusher");
+  config.fd = fds[0];
+  config.no_queue = 1;
+  config.stats = &flusher;
+  failures += check(kbd_reader_start(&reader, &config) == 0, "start count-only");
+  failures += check(write(fds[1], burst, sizeof(burst)) == (ssize_t)sizeof(burst), "write count-only");
+  close(fds[1]);
+  failures += check(wait_closed(&reader), "count-only consumed");
+  failures += check(kbd_reader_drain(&reader, batches, 4) == 0, "nothing to drain");
+  kbd_reader_status(&reader, &status);
+  failures += check(status.dropped == 0, "count-only drops nothing");
+  unsigned long total = 0;
+  unsigned long day_count = 0;
+  stats_flusher_counts(&flusher, &total, &day_count);
+  failures += check(total == sizeof(burst) / 2 && day_count == total, "count-only counts");
+  kbd_reader_stop(&reader);
+  close(fds[0]);
+  stats_flusher_stop(&flusher);
+  static const char *const suffixes[] = {"", ".journal", ".index", ".keys"};
+  for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s%s", stats_path, suffixes[i]);
+    unlink(path);
+  }
+
+  return failures ? 1 : 0;
+}
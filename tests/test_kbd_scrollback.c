@@ -0,0 +1,67 @@
+#include "kbd_scrollback.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int line_is(const kbd_scrollback_t *sb, size_t index, const char *want) {
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  char buf[256];
+  if (kbd_scrollback_line_range(sb, index, &begin, &end) != 0) {
+    return 0;
+  }
+  size_t n = kbd_scrollback_copy(sb, begin, end, buf, sizeof(buf));
+  return n == strlen(want) && memcmp(buf, want, n) == 0;
+}
+
+int main(void) {
+  int failures = 0;
+  kbd_scrollback_t sb;
+
+  failures += check(kbd_scrollback_init(&sb, 0, 0) == 0, "init");
+  const char *typed = "hello\nwo\xc3\xa4\brld\n\b\b!";
+  kbd_scrollback_append(&sb, typed, strlen(typed));
+  failures += check(kbd_scrollback_line_count(&sb) == 2, "backspace joins lines");
+  failures += check(line_is(&sb, 0, "hello"), "first line");
+  failures += check(line_is(&sb, 1, "worl!"), "utf-8 and newline backspace");
+  failures += check(kbd_scrollback_line_at(&sb, 3) == 0 && kbd_scrollback_line_at(&sb, 7) == 1, "line_at");
+  failures += check(kbd_scrollback_find(&sb, "rl", 2, 0) == 8, "find");
+  failures += check(kbd_scrollback_find(&sb, "xyz", 3, 0) < 0, "no match");
+  kbd_scrollback_free(&sb);
+
+  /* Two 64 KiB chunks: fill past the cap and check eviction and search. */
+  failures += check(kbd_scrollback_init(&sb, 2 * KBD_SCROLLBACK_CHUNK, 0) == 0, "init small");
+  char line[64];
+  for (int i = 0; i < 20000; ++i) {
+    int n = snprintf(line, sizeof(line), "line %05d\n", i);
+    kbd_scrollback_append(&sb, line, (size_t)n);
+  }
+  failures += check(sb.end == 220000, "all bytes counted");
+  failures += check(sb.end - sb.start <= 2 * KBD_SCROLLBACK_CHUNK, "hard cap on bytes");
+  failures += check(sb.start > 0 && sb.first_line > 0, "old text evicted");
+  failures += check(kbd_scrollback_find(&sb, "line 00000", 10, 0) < 0, "evicted text not found");
+  failures += check(line_is(&sb, kbd_scrollback_line_count(&sb) - 2, "line 19999"), "last full line");
+  failures += check(sb.first_line + kbd_scrollback_line_count(&sb) == 20001, "line numbering");
+
+  /* Every line straddling the chunk boundary must still be found. */
+  uint64_t boundary = sb.end / KBD_SCROLLBACK_CHUNK * KBD_SCROLLBACK_CHUNK;
+  size_t index = kbd_scrollback_line_at(&sb, boundary);
+  uint64_t begin = 0;
+  uint64_t end = 0;
+  kbd_scrollback_line_range(&sb, index, &begin, &end);
+  kbd_scrollback_copy(&sb, begin, end, line, sizeof(line));
+  failures += check(begin < boundary && end > boundary, "line straddles a boundary");
+  failures += check(kbd_scrollback_find(&sb, line, (size_t)(end - begin), sb.start) == (int64_t)begin,
+                    "find across chunk boundary");
+  kbd_scrollback_free(&sb);
+
+  /* The line cap evicts whole lines. */
+  failures += check(kbd_scrollback_init(&sb, 0, 4) == 0, "init line cap");
+  kbd_scrollback_append(&sb, "a\nb\nc\nd\ne\n", 10);
+  failures += check(kbd_scrollback_line_count(&sb) == 4, "line cap");
+  failures += check(line_is(&sb, 0, "c") && sb.first_line == 2, "oldest lines dropped");
+  kbd_scrollback_free(&sb);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,60 @@
+#include "kbd_spsc.h"
+#include "test_util.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#define ITEMS 200000u
+
+static void *producer(void *arg) {
+  kbd_spsc_t *queue = arg;
+  for (uint32_t i = 0; i < ITEMS;) {
+    if (kbd_spsc_push(queue, &i) == 0) {
+      ++i;
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+int main(void) {
+  int failures = 0;
+  kbd_spsc_t queue;
+  uint32_t value = 0;
+
+  failures += check(kbd_spsc_init(&queue, 3, sizeof(uint32_t)) == 0, "init");
+  failures += check(kbd_spsc_pop(&queue, &value) != 0, "starts empty");
+  for (uint32_t i = 0; i < 4; ++i) {
+    failures += check(kbd_spsc_push(&queue, &i) == 0, "push within capacity");
+  }
+  failures += check(kbd_spsc_push(&queue, &value) != 0, "capacity rounds up to 4");
+  failures += check(kbd_spsc_count(&queue) == 4, "count");
+  failures += check(kbd_spsc_pop(&queue, &value) == 0 && value == 0, "fifo order");
+  const uint32_t *front = kbd_spsc_peek(&queue);
+  failures += check(front && *front == 1, "peek");
+  kbd_spsc_release(&queue);
+  kbd_spsc_free(&queue);
+
+  /* A producer thread streams a counter; the consumer sees every value in order. */
+  failures += check(kbd_spsc_init(&queue, 64, sizeof(uint32_t)) == 0, "init threaded");
+  pthread_t thread;
+  pthread_create(&thread, NULL, producer, &queue);
+  uint32_t expected = 0;
+  int in_order = 1;
+  while (expected < ITEMS) {
+    if (kbd_spsc_pop(&queue, &value) == 0) {
+      in_order &= value == expected;
+      ++expected;
+    } else {
+      sched_yield();
+    }
+  }
+  pthread_join(thread, NULL);
+  failures += check(in_order, "threaded order");
+  failures += check(kbd_spsc_count(&queue) == 0, "drained");
+  kbd_spsc_free(&queue);
+
+  return failures ? 1 : 0;
+}
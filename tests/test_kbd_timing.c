@@ -0,0 +1,75 @@
+#include "kbd_timing.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Within one sub-bucket (1/16) of `want`. */
+static int near(uint64_t got, uint64_t want) {
+  uint64_t diff = got > want ? got - want : want - got;
+  return diff <= want / 16;
+}
+
+#define MS 1000000ull
+
+int main(void) {
+  int failures = 0;
+  kbd_hist_t *hist = malloc(sizeof(*hist));
+  kbd_timing_t *timing = malloc(sizeof(*timing));
+  if (!hist || !timing) {
+    return 1;
+  }
+
+  kbd_hist_init(hist);
+  failures += check(kbd_hist_percentile(hist, 50.0) == 0, "empty histogram");
+  for (uint64_t v = 0; v < 32; ++v) {
+    kbd_hist_record(hist, v);
+  }
+  failures += check(kbd_hist_percentile(hist, 50.0) == 15, "small values are exact");
+  failures += check(kbd_hist_percentile(hist, 100.0) == 31, "max is exact");
+
+  /* 1..1000 ms uniformly: percentiles land within the bucket error. */
+  kbd_hist_init(hist);
+  for (uint64_t v = 1; v <= 1000; ++v) {
+    kbd_hist_record(hist, v * MS);
+  }
+  failures += check(near(kbd_hist_percentile(hist, 50.0), 500 * MS), "p50");
+  failures += check(near(kbd_hist_percentile(hist, 90.0), 900 * MS), "p90");
+  failures += check(near(kbd_hist_percentile(hist, 99.0), 990 * MS), "p99");
+  failures += check(kbd_hist_percentile(hist, 0.0) == MS, "p0 is the min");
+  failures += check(kbd_hist_percentile(hist, 100.0) == 1000 * MS, "p100 is the max");
+  kbd_hist_record(hist, UINT64_MAX);
+  failures += check(hist->max == (1ull << KBD_HIST_MAX_BITS) - 1, "huge values clamp");
+
+  /* a, b, autorepeat of b, Up (E0 48), then a pause before c. */
+  kbd_timing_init(timing, 0, 0);
+  kbd_timing_key(timing, 0x1E, 1000 * MS);
+  kbd_timing_key(timing, 0x9E, 1080 * MS);
+  kbd_timing_key(timing, 0x30, 1100 * MS);
+  kbd_timing_key(timing, 0x30, 1200 * MS);
+  kbd_timing_key(timing, 0xB0, 1220 * MS);
+  static const uint8_t up[] = {0xE0, 0x48, 0xE0, 0xC8};
+  kbd_timing_feed(timing, up, 2, 1300 * MS);
+  kbd_timing_feed(timing, up + 2, 2, 1340 * MS);
+  kbd_timing_key(timing, 0x2E, 9000 * MS);
+  failures += check(timing->interkey.total == 2, "autorepeat and idle gaps skipped");
+  failures += check(timing->interkey.min == 100 * MS && timing->interkey.max == 200 * MS,
+                    "inter-key intervals");
+  failures += check(timing->dwell.total == 3, "three releases");
+  failures += check(timing->dwell.min == 40 * MS && timing->dwell.max == 120 * MS, "dwell times");
+
+  /* 50 chars a second for 10 s is 3000 cpm; it decays once typing stops. */
+  kbd_timing_init(timing, 10000 * MS, 0);
+  for (uint64_t t = 0; t < 10000; t += 100) {
+    kbd_timing_count(timing, 5, 20000 * MS + t * MS);
+  }
+  double cpm = kbd_rate_cpm(&timing->rate, 29999 * MS);
+  failures += check(cpm > 2900.0 && cpm < 3100.0, "steady rate");
+  cpm = kbd_rate_cpm(&timing->rate, 25000 * MS + 10000 * MS);
+  failures += check(cpm > 1300.0 && cpm < 1700.0, "half the window expired");
+  failures += check(kbd_rate_cpm(&timing->rate, 100000 * MS) == 0.0, "idle window is empty");
+
+  free(hist);
+  free(timing);
+  return failures ? 1 : 0;
+}
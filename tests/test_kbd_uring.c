@@ -0,0 +1,82 @@
+#include "kbd_uring.h"
+#include "test_util.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Waits for the completion tagged `user_data`; other completions are skipped. */
+static int wait_for(kbd_uring_t *uring, uint64_t user_data, int32_t *res) {
+  kbd_uring_cqe_t cqes[4];
+  for (int tries = 0; tries < 8; ++tries) {
+    if (kbd_uring_submit(uring, 1) != 0) {
+      return -1;
+    }
+    size_t n = kbd_uring_reap(uring, cqes, 4);
+    for (size_t i = 0; i < n; ++i) {
+      if (cqes[i].user_data == user_data) {
+        *res = cqes[i].res;
+        return 0;
+      }
+    }
+  }
+  return -1;
+}
+
+int main(void) {
+  int failures = 0;
+  kbd_uring_t uring;
+  if (kbd_uring_init(&uring, 4, 2, 64) != 0) {
+    /* Old kernels and seccomp'd containers; the reader falls back to poll. */
+    fprintf(stderr, "io_uring unavailable, skipping\n");
+    return 0;
+  }
+  failures += check(kbd_uring_buffer(&uring, 1) != NULL && kbd_uring_buffer(&uring, 2) == NULL, "buffers");
+
+  int fds[2];
+  if (open_pipe(fds) != 0) {
+    return 1;
+  }
+
+  /* The read waits for data instead of completing with -EAGAIN. */
+  failures += check(kbd_uring_read(&uring, fds[0], 1, 7, 8) == 0, "queue read");
+  failures += check(kbd_uring_submit(&uring, 0) == 0, "submit");
+  kbd_uring_cqe_t cqes[4];
+  failures += check(kbd_uring_reap(&uring, cqes, 4) == 0, "nothing before data");
+  failures += check(write(fds[1], "abc", 3) == 3, "write");
+  int32_t res = 0;
+  failures += check(wait_for(&uring, 7, &res) == 0 && res == 3, "read completes with the bytes");
+  failures += check(memcmp(kbd_uring_buffer(&uring, 1), "abc", 3) == 0, "data in the registered buffer");
+
+  /* Reads follow the stream position. */
+  failures += check(write(fds[1], "defg", 4) == 4, "write again");
+  failures += check(kbd_uring_read(&uring, fds[0], 0, 9, 8) == 0, "queue second read");
+  failures += check(wait_for(&uring, 9, &res) == 0 && res == 4, "second read");
+  failures += check(memcmp(kbd_uring_buffer(&uring, 0), "defg", 4) == 0, "second data");
+
+  /* Two submissions per read: a four-entry queue holds two reads. */
+  failures += check(kbd_uring_read(&uring, fds[0], 0, 1, 8) == 0, "fill 1");
+  failures += check(kbd_uring_read(&uring, fds[0], 1, 2, 8) == 0, "fill 2");
+  failures += check(kbd_uring_read(&uring, fds[0], 0, 3, 8) == -1, "queue full");
+  failures += check(kbd_uring_poll(&uring, fds[0], 4) == -1, "no room for a poll");
+
+  /* EOF completes the pending reads with 0. */
+  close(fds[1]);
+  failures += check(wait_for(&uring, 1, &res) == 0 && res == 0, "EOF");
+  failures += check(kbd_uring_read(&uring, fds[0], 2, 5, 8) == -1, "bad buffer index");
+  close(fds[0]);
+
+  /* A plain poll reports readiness. */
+  if (open_pipe(fds) != 0) {
+    return 1;
+  }
+  failures += check(write(fds[1], "x", 1) == 1, "write poll");
+  failures += check(kbd_uring_poll(&uring, fds[0], 11) == 0, "queue poll");
+  failures += check(wait_for(&uring, 11, &res) == 0 && (res & POLLIN), "poll ready");
+  close(fds[0]);
+  close(fds[1]);
+
+  kbd_uring_free(&uring);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+#include "kbd_record.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static struct kbd_event make_event(uint32_t seq, uint8_t scancode) {
+  struct kbd_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.timestamp_ns = 1000u * seq;
+  ev.seq = seq;
+  ev.scancode = scancode;
+  return ev;
+}
+
+int main(void) {
+  int failures = 0;
+  struct kbd_event in[4] = {
+      make_event(10, 0x1E),
+      make_event(11, 0x9E),
+      make_event(14, 0x30),
+      make_event(15, 0xB0),
+  };
+  const unsigned char *bytes = (const unsigned char *)in;
+  struct kbd_event out[8];
+  size_t consumed = 0;
+
+  kbd_record_reader_t reader;
+  kbd_record_reader_init(&reader);
+
+  /* Split the stream mid-record to exercise the carry path. */
+  size_t n = kbd_record_reader_feed(&reader, bytes, 20, out, 8, &consumed);
+  if (n != 1 || consumed != 20 || out[0].scancode != 0x1E) {
+    fprintf(stderr, "first chunk: got %zu records, consumed %zu\n", n, consumed);
+    failures++;
+  }
+
+  n = kbd_record_reader_feed(&reader, bytes + 20, sizeof(in) - 20, out, 2, &consumed);
+  if (n != 2 || out[0].seq != 11 || out[1].seq != 14) {
+    fprintf(stderr, "second chunk: got %zu records\n", n);
+    failures++;
+  }
+  if (consumed != 12 + sizeof(struct kbd_event)) {
+    fprintf(stderr, "second chunk: expected a partial consume, got %zu\n", consumed);
+    failures++;
+  }
+
+  size_t offset = 20 + consumed;
+  n = kbd_record_reader_feed(&reader, bytes + offset, sizeof(in) - offset, out, 8, &consumed);
+  if (n != 1 || out[0].scancode != 0xB0 || consumed != sizeof(in) - offset) {
+    fprintf(stderr, "third chunk: got %zu records\n", n);
+    failures++;
+  }
+
+  if (reader.events != 4 || reader.lost != 2) {
+    fprintf(stderr, "expected 4 events and 2 lost, got %llu and %llu\n",
+            (unsigned long long)reader.events, (unsigned long long)reader.lost);
+    failures++;
+  }
+
+  if (kbd_record_device_format(-1) != KBD_FORMAT_RAW) {
+    fprintf(stderr, "invalid fd should report raw format\n");
+    failures++;
+  }
+
+  return failures == 0 ? 0 : 1;
+}
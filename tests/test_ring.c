@@ -0,0 +1,93 @@
+#include "kbd_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DATA_OFFSET 4096u
+#define DATA_SIZE 16u
+
+static void produce(struct kbd_ring_header *hdr, uint8_t *data, uint8_t val) {
+  uint32_t prod = hdr->producer;
+  data[prod & (DATA_SIZE - 1)] = val;
+  __atomic_store_n(&hdr->producer, prod + 1, __ATOMIC_RELEASE);
+}
+
+int main(void) {
+  size_t mem_size = DATA_OFFSET + DATA_SIZE;
+  uint8_t *mem = calloc(1, mem_size);
+  if (!mem) {
+    return 1;
+  }
+
+  struct kbd_ring_header *hdr = (struct kbd_ring_header *)mem;
+  uint8_t *data = mem + DATA_OFFSET;
+  hdr->magic = KBD_RING_MAGIC;
+  hdr->version = KBD_RING_VERSION;
+  hdr->data_offset = DATA_OFFSET;
+  hdr->data_size = DATA_SIZE;
+
+  kbd_ring_t ring;
+  if (kbd_ring_attach(&ring, mem, mem_size - 1) == 0) {
+    fprintf(stderr, "attach accepted a truncated mapping\n");
+    free(mem);
+    return 1;
+  }
+  if (kbd_ring_attach(&ring, mem, mem_size) != 0) {
+    fprintf(stderr, "attach failed\n");
+    free(mem);
+    return 1;
+  }
+
+  int failures = 0;
+  uint8_t out[32];
+  if (kbd_ring_read(&ring, out, sizeof(out)) != 0) {
+    fprintf(stderr, "empty ring returned data\n");
+    failures++;
+  }
+
+  /* Advance close to the end so the next batch wraps. */
+  for (uint8_t i = 0; i < 12; ++i) {
+    produce(hdr, data, i);
+  }
+  if (kbd_ring_read(&ring, out, sizeof(out)) != 12) {
+    fprintf(stderr, "expected 12 bytes\n");
+    failures++;
+  }
+
+  for (uint8_t i = 0; i < 10; ++i) {
+    produce(hdr, data, (uint8_t)(0x10 + i));
+  }
+  const uint8_t *span = NULL;
+  size_t avail = kbd_ring_peek(&ring, &span);
+  if (avail != 4 || span[0] != 0x10) {
+    fprintf(stderr, "expected a 4 byte span before the wrap, got %zu\n", avail);
+    failures++;
+  }
+
+  size_t n = kbd_ring_read(&ring, out, sizeof(out));
+  if (n != 10) {
+    fprintf(stderr, "expected 10 bytes across the wrap, got %zu\n", n);
+    failures++;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (out[i] != 0x10 + i) {
+      fprintf(stderr, "byte %zu expected 0x%02zX got 0x%02X\n", i, 0x10 + i, out[i]);
+      failures++;
+    }
+  }
+  if (hdr->consumer != hdr->producer) {
+    fprintf(stderr, "consumer did not catch up with producer\n");
+    failures++;
+  }
+
+  hdr->dropped = 3;
+  if (kbd_ring_dropped(&ring) != 3) {
+    fprintf(stderr, "dropped counter mismatch\n");
+    failures++;
+  }
+
+  kbd_ring_unmap(&ring);
+  free(mem);
+  return failures == 0 ? 0 : 1;
+}
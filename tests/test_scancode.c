@@ -29,6 +29,263 @@ static int feed(scancode_state_t *state,
   return 0;
 }
 
+/*
+ * Decodes `in` one byte at a time and through scancode_process_batch() with
+ * an output buffer of `out_size`, and checks that both agree.
+ */
+static int check_batch(const uint8_t *in, size_t len, size_t out_size, scancode_layout_t layout) {
+  char expected[8192];
+  size_t expected_len = 0;
+  unsigned long expected_count = 0;
+  scancode_state_t ref;
+  scancode_state_init_layout(&ref, layout);
+  for (size_t i = 0; i < len; ++i) {
+    char out[SCANCODE_MAX_OUTPUT];
+    unsigned long counted = 0;
+    size_t n = scancode_process(&ref, in[i], out, sizeof(out), &counted);
+    memcpy(expected + expected_len, out, n);
+    expected_len += n;
+    expected_count += counted;
+  }
+
+  char got[8192];
+  size_t got_len = 0;
+  unsigned long got_count = 0;
+  scancode_state_t state;
+  scancode_state_init_layout(&state, layout);
+  size_t pos = 0;
+  while (pos < len) {
+    char chunk[8192];
+    size_t consumed = 0;
+    unsigned long counted = 0;
+    size_t n = scancode_process_batch(&state, in + pos, len - pos, chunk, out_size, &consumed,
+                                      &counted);
+    if (consumed == 0) {
+      fprintf(stderr, "batch made no progress at %zu\n", pos);
+      return 1;
+    }
+    memcpy(got + got_len, chunk, n);
+    got_len += n;
+    got_count += counted;
+    pos += consumed;
+  }
+
+  if (got_len != expected_len || memcmp(got, expected, got_len) != 0 ||
+      got_count != expected_count) {
+    fprintf(stderr, "batch (out_size %zu) differs from per-byte decoding\n", out_size);
+    return 1;
+  }
+  return 0;
+}
+
+static int batch_tests(void) {
+  uint8_t in[2048];
+  uint32_t rng = 12345;
+  for (size_t i = 0; i < sizeof(in); ++i) {
+    rng = rng * 1103515245u + 12345u;
+    uint8_t code = (uint8_t)(rng >> 16);
+    /* Mostly plain make/break codes with occasional modifier traffic. */
+    if ((rng >> 8) % 16 == 0) {
+      static const uint8_t mods[] = {0x2A, 0xAA, 0x36, 0xB6, 0x3A, 0x1D, 0x9D, 0x38, 0xB8, 0x01};
+      code = mods[(rng >> 4) % sizeof(mods)];
+    }
+    in[i] = code;
+  }
+
+  int failures = 0;
+  failures += check_batch(in, sizeof(in), 4096, SCANCODE_LAYOUT_US);
+  failures += check_batch(in, sizeof(in), SCANCODE_MAX_OUTPUT, SCANCODE_LAYOUT_US);
+  failures += check_batch(in, sizeof(in), 40, SCANCODE_LAYOUT_US);
+  failures += check_batch(in + 3, 61, 4096, SCANCODE_LAYOUT_US);
+  failures += check_batch(in, sizeof(in), 4096, SCANCODE_LAYOUT_DE);
+  failures += check_batch(in, sizeof(in), SCANCODE_MAX_OUTPUT, SCANCODE_LAYOUT_DE);
+  failures += check_batch(in, sizeof(in), 4096, SCANCODE_LAYOUT_UK);
+  failures += check_batch(in, sizeof(in), 4096, SCANCODE_LAYOUT_DVORAK);
+
+  /* Extended sequences split at every possible chunk boundary. */
+  static const uint8_t ext[] = {
+      0x1E, 0xE0, 0x48, 0xE0, 0xC8, 0xE1, 0x1D, 0x45, 0xE1, 0x9D, 0xC5, 0x1F,
+      0xE0, 0x2A, 0xE0, 0x37, 0xE0, 0xB7, 0xE0, 0xAA, 0x45, 0x4F, 0xE0, 0x38,
+      0x10, 0xE0, 0xB8, 0xE0, 0x1C, 0x3B, 0x56, 0x39, 0xE0, 0x35, 0x20,
+  };
+  for (size_t len = 1; len <= sizeof(ext); ++len) {
+    failures += check_batch(ext, len, SCANCODE_MAX_OUTPUT, SCANCODE_LAYOUT_DE);
+  }
+  return failures;
+}
+
+/* Key ids from a stream with every kind of prefix; -1 ends the expected list. */
+static int key_id_tests(void) {
+  static const uint8_t stream[] = {
+      0x1E, 0x9E,             /* A make, break */
+      0xE0, 0x48, 0xE0, 0xC8, /* Up */
+      0xE0, 0x2A, 0xE0, 0x37, /* Print Screen with its fake shift */
+      0xE0, 0xB7, 0xE0, 0xAA,
+      0xE1, 0x1D, 0x45,       /* Pause */
+      0xE1, 0x9D, 0xC5, 0x30, /* B */
+  };
+  static const int expected[][2] = {
+      {0x1E, 0}, {0x1E, 1}, {0xC8, 0}, {0xC8, 1}, {0xB7, 0}, {0xB7, 1}, {0x30, 0}, {-1, 0},
+  };
+  scancode_key_state_t keys = {0};
+  size_t next = 0;
+  for (size_t i = 0; i < sizeof(stream); ++i) {
+    unsigned int id = 0;
+    int is_break = 0;
+    if (!scancode_key_id(&keys, stream[i], &id, &is_break)) {
+      continue;
+    }
+    if (expected[next][0] != (int)id || expected[next][1] != is_break) {
+      fprintf(stderr, "key id %zu: got 0x%02X/%d\n", next, id, is_break);
+      return 1;
+    }
+    ++next;
+  }
+  if (expected[next][0] != -1) {
+    fprintf(stderr, "key ids: only %zu events\n", next);
+    return 1;
+  }
+  return 0;
+}
+
+/* The per-key answer matches what decoding a lone press counts. */
+static int key_counted_tests(void) {
+  int failures = 0;
+  for (int layout = 0; layout < SCANCODE_LAYOUT_COUNT; ++layout) {
+    for (unsigned int key = 0; key < 256; ++key) {
+      scancode_state_t state;
+      scancode_state_init_layout(&state, (scancode_layout_t)layout);
+      char out[32];
+      unsigned long counted = 0;
+      if (key & 0x80) {
+        scancode_process(&state, 0xE0, out, sizeof(out), NULL);
+      }
+      scancode_process(&state, (uint8_t)(key & 0x7F), out, sizeof(out), &counted);
+      if ((unsigned long)scancode_key_counted((scancode_layout_t)layout, key) != counted) {
+        fprintf(stderr, "layout %d key 0x%02X: key_counted disagrees with decode\n", layout, key);
+        ++failures;
+      }
+    }
+  }
+  if (!scancode_key_counted(SCANCODE_LAYOUT_UK, 0x56) || scancode_key_counted(SCANCODE_LAYOUT_US, 0x0E) ||
+      !scancode_key_counted(SCANCODE_LAYOUT_US, 0x80 | 0x35) || scancode_key_counted(SCANCODE_LAYOUT_US, 0x47) ||
+      scancode_key_counted(SCANCODE_LAYOUT_COUNT, 0x1E)) {
+    fprintf(stderr, "key_counted spot checks failed\n");
+    ++failures;
+  }
+  return failures;
+}
+
+static int extended_tests(void) {
+  int failures = 0;
+  scancode_state_t state;
+  scancode_state_init(&state);
+
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x48, "<UP>", 0);
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0xC8, NULL, 0);
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x1D, "<CTRL>", 0);
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x9D, NULL, 0);
+  if (state.ctrl) {
+    fprintf(stderr, "right ctrl release not applied\n");
+    ++failures;
+  }
+
+  /* Fake shift around Print Screen must not latch shift. */
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x2A, NULL, 0);
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x37, "<PRTSC>", 0);
+  failures += feed(&state, 0x1E, "a", 1);
+
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x1C, "\n", 1);
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x35, "/", 1);
+
+  failures += feed(&state, 0xE1, NULL, 0);
+  failures += feed(&state, 0x1D, NULL, 0);
+  failures += feed(&state, 0x45, "<PAUSE>", 0);
+  failures += feed(&state, 0xE1, NULL, 0);
+  failures += feed(&state, 0x9D, NULL, 0);
+  failures += feed(&state, 0xC5, NULL, 0);
+  failures += feed(&state, 0x1E, "a", 1);
+
+  failures += feed(&state, 0x3B, "<F1>", 0);
+  failures += feed(&state, 0x58, "<F12>", 0);
+  failures += feed(&state, 0x37, "*", 1);
+  failures += feed(&state, 0x47, "<HOME>", 0);
+  failures += feed(&state, 0x45, "<NUM_ON>", 0);
+  failures += feed(&state, 0x47, "7", 1);
+  failures += feed(&state, 0x53, ".", 1);
+  failures += feed(&state, 0xC5, NULL, 0);
+  failures += feed(&state, 0x45, "<NUM_OFF>", 0);
+  failures += feed(&state, 0x4C, NULL, 0);
+
+  /* Right Alt is AltGr and selects the layout's third level. */
+  scancode_state_init_layout(&state, SCANCODE_LAYOUT_DE);
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0x38, "<ALTGR>", 0);
+  failures += feed(&state, 0x10, "@", 1);
+  failures += feed(&state, 0x12, "\xE2\x82\xAC", 1);
+  failures += feed(&state, 0x1E, "a", 1);
+  failures += feed(&state, 0xE0, NULL, 0);
+  failures += feed(&state, 0xB8, NULL, 0);
+  failures += feed(&state, 0x10, "q", 1);
+  return failures;
+}
+
+static int layout_tests(void) {
+  int failures = 0;
+  scancode_state_t state;
+
+  if (scancode_layout_from_name("DE") != SCANCODE_LAYOUT_DE ||
+      scancode_layout_from_name("dvorak") != SCANCODE_LAYOUT_DVORAK ||
+      scancode_layout_from_name("xx") != -1 || scancode_layout_from_name(NULL) != -1) {
+    fprintf(stderr, "scancode_layout_from_name mismatch\n");
+    ++failures;
+  }
+  if (scancode_state_init_layout(&state, SCANCODE_LAYOUT_COUNT) != -1 ||
+      state.layout != SCANCODE_LAYOUT_US) {
+    fprintf(stderr, "invalid layout accepted\n");
+    ++failures;
+  }
+
+  scancode_state_init_layout(&state, SCANCODE_LAYOUT_DE);
+  failures += feed(&state, 0x15, "z", 1);
+  failures += feed(&state, 0x2C, "y", 1);
+  failures += feed(&state, 0x27, "\xC3\xB6", 1);
+  failures += feed(&state, 0x0C, "\xC3\x9F", 1);
+  failures += feed(&state, 0x3A, "<CAPS_ON>", 0);
+  failures += feed(&state, 0x28, "\xC3\x84", 1);
+  failures += feed(&state, 0x08, "7", 1);
+  failures += feed(&state, 0x3A, "<CAPS_OFF>", 0);
+  failures += feed(&state, 0x2A, "<SHIFT>", 0);
+  failures += feed(&state, 0x08, "/", 1);
+  failures += feed(&state, 0x56, ">", 1);
+  failures += feed(&state, 0xAA, NULL, 0);
+
+  scancode_state_init_layout(&state, SCANCODE_LAYOUT_UK);
+  failures += feed(&state, 0x2B, "#", 1);
+  failures += feed(&state, 0x2A, "<SHIFT>", 0);
+  failures += feed(&state, 0x04, "\xC2\xA3", 1);
+  failures += feed(&state, 0x28, "@", 1);
+  failures += feed(&state, 0xAA, NULL, 0);
+
+  scancode_state_init_layout(&state, SCANCODE_LAYOUT_DVORAK);
+  failures += feed(&state, 0x10, "'", 1);
+  failures += feed(&state, 0x1F, "o", 1);
+  failures += feed(&state, 0x3A, "<CAPS_ON>", 0);
+  failures += feed(&state, 0x23, "D", 1);
+  failures += feed(&state, 0x11, ",", 1);
+  failures += feed(&state, 0x3A, "<CAPS_OFF>", 0);
+  failures += feed(&state, 0x0E, "\b", 0);
+  return failures;
+}
+
 int main(void) {
   int failures = 0;
   scancode_state_t state;
@@ -53,5 +310,11 @@ int main(void) {
   failures += feed(&state, 0x0E, "\b", 0);
   failures += feed(&state, 0xFF, NULL, 0);
 
+  failures += batch_tests();
+  failures += layout_tests();
+  failures += extended_tests();
+  failures += key_counted_tests();
+  failures += key_id_tests();
+
   return failures == 0 ? 0 : 1;
 }
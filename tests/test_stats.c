@@ -1,8 +1,11 @@
 #include "stats.h"
+#include "test_util.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 static int write_seed(const char *path) {
@@ -17,6 +20,117 @@ static int write_seed(const char *path) {
   return 0;
 }
 
+static int expect_counts(const char *path, const char *day, unsigned long total,
+                         unsigned long day_count) {
+  stats_t stats;
+  if (stats_init(&stats, path, day) != 0) {
+    fprintf(stderr, "stats_init failed for %s\n", day);
+    return 1;
+  }
+  int bad = stats.total != total || stats.day_count != day_count;
+  if (bad) {
+    fprintf(stderr, "%s: expected %lu/%lu got %lu/%lu\n", day, total, day_count, stats.total,
+            stats.day_count);
+  }
+  stats_free(&stats);
+  return bad;
+}
+
+static long file_size(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 ? (long)st.st_size : -1;
+}
+
+/*
+ * Starts from the state main() leaves behind: snapshot total=3 with
+ * 2025-01-07=2, plus one journaled delta of 4 for 2025-01-07.
+ */
+static int journal_tests(const char *path, const char *journal) {
+  int failures = 0;
+
+  /* The snapshot is untouched by saves; the delta lives in the journal. */
+  if (!file_contains(path, "total=3\n")) {
+    fprintf(stderr, "stats_save rewrote the snapshot\n");
+    ++failures;
+  }
+
+  /* A torn append is dropped and truncated away. */
+  FILE *fp = fopen(journal, "a");
+  if (!fp) {
+    return failures + 1;
+  }
+  fputs("torn", fp);
+  fclose(fp);
+  failures += expect_counts(path, "2025-01-07", 7, 6);
+  if (file_size(journal) !=
+      (long)(sizeof(stats_journal_header_t) + sizeof(stats_journal_record_t))) {
+    fprintf(stderr, "torn journal tail not truncated\n");
+    ++failures;
+  }
+
+  /* A new day journals separately and compaction folds everything. */
+  stats_t stats;
+  if (stats_init(&stats, path, "2025-01-08") != 0) {
+    return failures + 1;
+  }
+  stats_record(&stats, 5);
+  if (stats_save(&stats) != 0 || stats_compact(&stats) != 0) {
+    fprintf(stderr, "save/compact failed\n");
+    ++failures;
+  }
+  stats_free(&stats);
+  if (!file_contains(path, "total=12\njournal=1\n2025-01-08=5\n2025-01-07=6\n2025-01-06=1\n")) {
+    fprintf(stderr, "compacted snapshot has unexpected contents\n");
+    ++failures;
+  }
+  if (file_size(journal) != (long)sizeof(stats_journal_header_t)) {
+    fprintf(stderr, "journal not reset after compaction\n");
+    ++failures;
+  }
+  failures += expect_counts(path, "2025-01-08", 12, 5);
+  failures += expect_counts(path, "2025-01-07", 12, 6);
+
+  /* A journal left over from before the compaction is ignored. */
+  int fd = open(journal, O_WRONLY | O_TRUNC);
+  if (fd < 0) {
+    return failures + 1;
+  }
+  stats_journal_header_t header = {STATS_JOURNAL_MAGIC, STATS_JOURNAL_VERSION, 0};
+  stats_journal_record_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = STATS_JOURNAL_MAGIC;
+  rec.delta = 100;
+  memcpy(rec.day, "2025-01-08", 10);
+  int wrote = write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+              write(fd, &rec, sizeof(rec)) == (ssize_t)sizeof(rec);
+  close(fd);
+  if (!wrote) {
+    return failures + 1;
+  }
+  failures += expect_counts(path, "2025-01-08", 12, 5);
+
+  /* Enough saves trigger compaction on their own. */
+  if (stats_init(&stats, path, "2025-01-08") != 0) {
+    return failures + 1;
+  }
+  for (int i = 0; i < STATS_JOURNAL_COMPACT_RECORDS; ++i) {
+    stats_record(&stats, 1);
+    if (stats_save(&stats) != 0) {
+      fprintf(stderr, "stats_save failed at %d\n", i);
+      ++failures;
+      break;
+    }
+  }
+  if (stats.journal_records != 0 || stats.generation != 2) {
+    fprintf(stderr, "journal did not compact automatically\n");
+    ++failures;
+  }
+  stats_free(&stats);
+  failures += expect_counts(path, "2025-01-08", 12 + STATS_JOURNAL_COMPACT_RECORDS,
+                            5 + STATS_JOURNAL_COMPACT_RECORDS);
+  return failures;
+}
+
 int main(void) {
   char tmpl[] = "/tmp/kbdstatsXXXXXX";
   int fd = mkstemp(tmpl);
@@ -70,6 +184,11 @@ int main(void) {
   }
 
   stats_free(&stats2);
+
+  char journal[sizeof(tmpl) + 8];
+  snprintf(journal, sizeof(journal), "%s.journal", tmpl);
+  int failures = journal_tests(tmpl, journal);
+  unlink(journal);
   unlink(tmpl);
-  return 0;
+  return failures == 0 ? 0 : 1;
 }
@@ -0,0 +1,204 @@
+#include "stats_flusher.h"
+#include "test_util.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int journaled_count(const char *path, const char *day, unsigned long *day_count) {
+  stats_t stats;
+  if (stats_init(&stats, path, day) != 0) {
+    return -1;
+  }
+  *day_count = stats.day_count;
+  stats_free(&stats);
+  return 0;
+}
+
+/* Polls until `day` reaches `expected` on disk or about a second passes. */
+static int wait_for_disk(const char *path, const char *day, unsigned long expected) {
+  for (int i = 0; i < 200; ++i) {
+    unsigned long count = 0;
+    if (journaled_count(path, day, &count) == 0 && count == expected) {
+      return 0;
+    }
+    struct timespec ts = {0, 5 * 1000 * 1000};
+    nanosleep(&ts, NULL);
+  }
+  fprintf(stderr, "%s never reached %lu on disk\n", day, expected);
+  return 1;
+}
+
+int main(void) {
+  char tmpl[] = "/tmp/kbdflushXXXXXX";
+  int fd = mkstemp(tmpl);
+  if (fd < 0) {
+    return 1;
+  }
+  close(fd);
+  char journal[sizeof(tmpl) + 8];
+  char index[sizeof(tmpl) + 8];
+  char keys[sizeof(tmpl) + 8];
+  snprintf(journal, sizeof(journal), "%s.journal", tmpl);
+  snprintf(index, sizeof(index), "%s.index", tmpl);
+  snprintf(keys, sizeof(keys), "%s.keys", tmpl);
+
+  int failures = 0;
+  stats_flusher_config_t config;
+  stats_flusher_default_config(&config);
+  config.interval_ms = 20;
+  config.max_pending = 100;
+  config.fsync_policy = STATS_FSYNC_FLUSH;
+
+  stats_flusher_t flusher;
+  if (stats_flusher_start(&flusher, tmpl, "2025-02-01", &config) != 0) {
+    unlink(tmpl);
+    unlink(journal);
+    unlink(index);
+    unlink(keys);
+    return 1;
+  }
+
+  /* Small deltas coalesce and go out once the interval passes. */
+  for (int i = 0; i < 10; ++i) {
+    stats_flusher_record(&flusher, 1);
+  }
+  unsigned long total = 0;
+  unsigned long day_count = 0;
+  stats_flusher_counts(&flusher, &total, &day_count);
+  if (total != 10 || day_count != 10) {
+    fprintf(stderr, "counts %lu/%lu, expected 10/10\n", total, day_count);
+    ++failures;
+  }
+  failures += wait_for_disk(tmpl, "2025-02-01", 10);
+
+  /* Crossing max_pending flushes without waiting for the interval. */
+  pthread_mutex_lock(&flusher.lock);
+  flusher.config.interval_ms = 60 * 1000;
+  pthread_mutex_unlock(&flusher.lock);
+  stats_flusher_record(&flusher, 150);
+  failures += wait_for_disk(tmpl, "2025-02-01", 160);
+
+  /* Day rotation flushes the old day before switching. */
+  stats_flusher_record(&flusher, 5);
+  if (stats_flusher_set_day(&flusher, "2025-02-02") != 0) {
+    fprintf(stderr, "stats_flusher_set_day failed\n");
+    ++failures;
+  }
+  stats_flusher_counts(&flusher, &total, &day_count);
+  if (total != 165 || day_count != 0) {
+    fprintf(stderr, "after rotation %lu/%lu, expected 165/0\n", total, day_count);
+    ++failures;
+  }
+  stats_flusher_record(&flusher, 7);
+
+  /* A journal append that fails keeps the counts for the next flush. */
+  int read_only = open("/dev/null", O_RDONLY);
+  pthread_mutex_lock(&flusher.io_lock);
+  int journal_fd = flusher.stats.journal_fd;
+  flusher.stats.journal_fd = read_only;
+  pthread_mutex_unlock(&flusher.io_lock);
+  stats_flusher_record(&flusher, 2);
+  if (read_only < 0 || stats_flusher_flush(&flusher) == 0) {
+    fprintf(stderr, "flush into a read-only journal succeeded\n");
+    ++failures;
+  }
+
+  /* An append that lands but whose compaction fails still counts. */
+  static char missing_dir[] = "/nonexistent/kbdflush/stats.txt";
+  pthread_mutex_lock(&flusher.io_lock);
+  flusher.stats.journal_fd = journal_fd;
+  char *stats_path = flusher.stats.path;
+  unsigned long records = flusher.stats.journal_records;
+  flusher.stats.path = missing_dir;
+  flusher.stats.journal_records = STATS_JOURNAL_COMPACT_RECORDS - 1;
+  pthread_mutex_unlock(&flusher.io_lock);
+  stats_flusher_record(&flusher, 3);
+  if (stats_flusher_flush(&flusher) == 0) {
+    fprintf(stderr, "compaction into a missing directory succeeded\n");
+    ++failures;
+  }
+  pthread_mutex_lock(&flusher.io_lock);
+  flusher.stats.path = stats_path;
+  flusher.stats.journal_records = records + 1;
+  pthread_mutex_unlock(&flusher.io_lock);
+  close(read_only);
+
+  static const uint8_t codes[] = {0x23, 0xA3, 0x12, 0x92};
+  stats_flusher_record_keys(&flusher, codes, sizeof(codes));
+  /* Kernel aggregate counts: presses only, no bigrams. */
+  uint64_t presses[STATS_KEYS_COUNT] = {0};
+  presses[0x1E] = 4;
+  stats_flusher_record_presses(&flusher, presses);
+
+  if (stats_flusher_stop(&flusher) != 0) {
+    fprintf(stderr, "stats_flusher_stop failed\n");
+    ++failures;
+  }
+  if (!file_contains(tmpl, "total=177\n") || !file_contains(tmpl, "2025-02-02=12\n") ||
+      !file_contains(tmpl, "2025-02-01=165\n")) {
+    fprintf(stderr, "final snapshot missing counts\n");
+    ++failures;
+  }
+
+  /* The day index followed every flush, failed ones included. */
+  stats_index_t idx;
+  int32_t feb1 = 0;
+  if (stats_index_open(&idx, index, 0) != 0 || stats_day_from_string("2025-02-01", &feb1) != 0) {
+    fprintf(stderr, "day index missing\n");
+    ++failures;
+  } else {
+    if (stats_index_get(&idx, feb1) != 165 || stats_index_get(&idx, feb1 + 1) != 12 ||
+        stats_index_range(&idx, feb1, feb1 + 1) != 177) {
+      fprintf(stderr, "day index out of date\n");
+      ++failures;
+    }
+    stats_index_close(&idx);
+  }
+
+  /* Key counters are written out on stop. */
+  stats_keys_t *counted = malloc(sizeof(*counted));
+  if (!counted || stats_keys_load(counted, keys) != 0 || counted->bigrams[0x23][0x12] != 1 ||
+      counted->presses[0x1E] != 4 || counted->total != 6) {
+    fprintf(stderr, "key counters not persisted\n");
+    ++failures;
+  }
+  free(counted);
+
+  /*
+   * A truncated index is rebuilt from the snapshot on the next start, and
+   * damaged key counters start over instead of switching counting off.
+   */
+  if (truncate(index, 100) != 0 || truncate(keys, 10) != 0 ||
+      stats_flusher_start(&flusher, tmpl, "2025-02-02", &config) != 0) {
+    fprintf(stderr, "restart with a damaged index and keys failed\n");
+    ++failures;
+  } else {
+    if (!flusher.index_ready || stats_index_get(&flusher.index, feb1 + 1) != 12 ||
+        stats_index_range(&flusher.index, feb1, feb1 + 1) != 177) {
+      fprintf(stderr, "damaged day index not rebuilt\n");
+      ++failures;
+    }
+    if (!flusher.keys || flusher.keys->total != 0) {
+      fprintf(stderr, "damaged key counters not reset\n");
+      ++failures;
+    }
+    stats_flusher_record_keys(&flusher, codes, sizeof(codes));
+    stats_flusher_stop(&flusher);
+    counted = malloc(sizeof(*counted));
+    if (!counted || stats_keys_load(counted, keys) != 0 || counted->total != 2) {
+      fprintf(stderr, "key counters not written after a reset\n");
+      ++failures;
+    }
+    free(counted);
+  }
+
+  unlink(keys);
+  unlink(index);
+  unlink(journal);
+  unlink(tmpl);
+  return failures == 0 ? 0 : 1;
+}
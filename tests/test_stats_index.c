@@ -0,0 +1,112 @@
+#include "stats_index.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int32_t day_of(const char *text) {
+  int32_t day = 0;
+  if (stats_day_from_string(text, &day) != 0) {
+    fprintf(stderr, "bad date %s\n", text);
+    exit(1);
+  }
+  return day;
+}
+
+static int date_tests(void) {
+  int failures = 0;
+  char buf[11];
+  failures += check(day_of("1970-01-01") == 0, "epoch is day 0");
+  failures += check(day_of("2000-03-01") == 11017, "2000-03-01");
+  stats_day_to_string(day_of("2024-02-29"), buf);
+  failures += check(strcmp(buf, "2024-02-29") == 0, "leap day round trip");
+  int32_t day = 0;
+  failures += check(stats_day_from_string("2025-02-29", &day) != 0, "2025-02-29 rejected");
+  failures += check(stats_day_from_string("2025-1-01", &day) != 0, "short month rejected");
+  failures += check(stats_day_from_string("total", &day) != 0, "non-date rejected");
+  return failures;
+}
+
+/* Sums the same range slot by slot for comparison. */
+static uint64_t slow_range(const stats_index_t *index, int32_t first, int32_t last) {
+  uint64_t sum = 0;
+  for (int32_t d = first; d <= last; ++d) {
+    sum += stats_index_get(index, d);
+  }
+  return sum;
+}
+
+int main(void) {
+  int failures = date_tests();
+
+  char dir[] = "/tmp/kbdindexXXXXXX";
+  if (!mkdtemp(dir)) {
+    return 1;
+  }
+  char path[sizeof(dir) + 16];
+  char text[sizeof(dir) + 16];
+  snprintf(path, sizeof(path), "%s/index", dir);
+  snprintf(text, sizeof(text), "%s/stats.txt", dir);
+
+  FILE *fp = fopen(text, "w");
+  if (!fp) {
+    return 1;
+  }
+  fputs("total=60\njournal=3\n2025-01-07=10\n2025-01-06=20\n2019-12-31=30\nnoise\n", fp);
+  fclose(fp);
+
+  stats_index_t index;
+  int32_t base = day_of("2025-01-07");
+  failures += check(stats_index_open(&index, path, base) == 0, "create index");
+  /* 2019 is before the base, so importing grows the index backwards. */
+  failures += check(stats_index_import_text(&index, text) == 3, "import three days");
+  failures += check(stats_index_import_text(&index, text) == 3, "re-import is idempotent");
+  failures += check(stats_index_get(&index, day_of("2019-12-31")) == 30, "imported old day");
+  failures += check(stats_index_range(&index, day_of("2019-01-01"), day_of("2030-01-01")) == 60,
+                    "import total");
+
+  /* Jan 6 2025 is a Monday; its week ends Sunday Jan 12. */
+  failures += check(stats_index_add(&index, day_of("2025-01-12"), 5) == 0, "add");
+  failures += check(stats_index_add(&index, day_of("2025-01-13"), 7) == 0, "add next week");
+  failures += check(stats_index_week(&index, day_of("2025-01-09")) == 35, "week sum");
+  failures += check(stats_index_month(&index, day_of("2025-01-31")) == 42, "month sum");
+  failures += check(stats_index_year(&index, day_of("2019-06-01")) == 30, "year sum");
+
+  /* Far-future days grow the index forwards. */
+  failures += check(stats_index_add(&index, day_of("2031-05-05"), 9) == 0, "add far future");
+
+  uint32_t rng = 7;
+  int32_t lo = day_of("2019-01-01");
+  for (int i = 0; i < 2000; ++i) {
+    rng = rng * 1103515245u + 12345u;
+    int32_t d = lo + (int32_t)((rng >> 8) % 5000);
+    stats_index_add(&index, d, (rng >> 4) % 100);
+  }
+  for (int i = 0; i < 200; ++i) {
+    rng = rng * 1103515245u + 12345u;
+    int32_t a = lo - 100 + (int32_t)((rng >> 8) % 5200);
+    rng = rng * 1103515245u + 12345u;
+    int32_t b = a + (int32_t)((rng >> 8) % 800);
+    if (stats_index_range(&index, a, b) != slow_range(&index, a, b)) {
+      fprintf(stderr, "range mismatch %d..%d\n", a, b);
+      ++failures;
+      break;
+    }
+  }
+  uint64_t all = stats_index_range(&index, lo - 1000, lo + 10000);
+  failures += check(stats_index_sync(&index) == 0, "sync");
+  stats_index_close(&index);
+
+  /* Reopening keeps the data and rebuilds the prefixes. */
+  failures += check(stats_index_open(&index, path, 0) == 0, "reopen");
+  failures += check(stats_index_range(&index, lo - 1000, lo + 10000) == all, "reopen total");
+  failures += check(stats_index_get(&index, day_of("2031-05-05")) >= 9, "reopen far day");
+  stats_index_close(&index);
+
+  unlink(path);
+  unlink(text);
+  rmdir(dir);
+  return failures == 0 ? 0 : 1;
+}
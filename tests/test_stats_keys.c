@@ -0,0 +1,84 @@
+#include "stats_keys.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(void) {
+  int failures = 0;
+  stats_keys_t *keys = malloc(sizeof(*keys));
+  stats_keys_t *loaded = malloc(sizeof(*loaded));
+  if (!keys || !loaded) {
+    return 1;
+  }
+  stats_keys_init(keys);
+
+  /* "th", Up arrow, Print Screen with its fake shift, Pause, "e". */
+  static const uint8_t stream[] = {
+      0x14, 0x94, 0x23, 0xA3,             /* t h */
+      0xE0, 0x48, 0xE0, 0xC8,             /* Up */
+      0xE0, 0x2A, 0xE0, 0x37, 0xE0, 0xB7, /* fake shift, PrtSc */
+      0xE0, 0xAA, 0xE1, 0x1D, 0x45, 0xE1, /* fake shift up, Pause */
+      0x9D, 0xC5, 0x12, 0x92,             /* e */
+  };
+  /* Split mid-sequence to check state carries across calls. */
+  stats_keys_feed(keys, stream, 5);
+  stats_keys_feed(keys, stream + 5, sizeof(stream) - 5);
+
+  failures += check(keys->total == 5, "five presses");
+  failures += check(keys->presses[0x14] == 1 && keys->presses[0x23] == 1, "t and h");
+  failures += check(keys->presses[0xC8] == 1, "Up counted as 0xC8");
+  failures += check(keys->presses[0xB7] == 1, "PrtSc counted as 0xB7");
+  failures += check(keys->presses[0xAA] == 0 && keys->presses[0x2A] == 0, "fake shift ignored");
+  failures += check(keys->presses[0x1D] == 0 && keys->presses[0x45] == 0, "Pause ignored");
+  failures += check(keys->bigrams[0x14][0x23] == 1, "bigram t->h");
+  failures += check(keys->bigrams[0x23][0xC8] == 1, "bigram h->Up");
+  failures += check(keys->bigrams[0xB7][0x12] == 1, "bigram PrtSc->e");
+
+  for (int i = 0; i < 10; ++i) {
+    static const uint8_t he[] = {0x23, 0x12};
+    stats_keys_feed(keys, he, sizeof(he));
+  }
+  stats_bigram_t top[3];
+  size_t n = stats_keys_top_bigrams(keys, top, 3);
+  failures += check(n == 3, "three top bigrams");
+  /* The stream ended on 'e', so e->h and h->e both occur ten times. */
+  failures += check(top[0].count == 10 && top[1].count == 10 && top[2].count == 1,
+                    "top bigram counts");
+  failures += check(top[0].first == 0x12 && top[0].second == 0x23, "ties keep matrix order");
+
+  char path[] = "/tmp/kbdkeysXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return 1;
+  }
+  close(fd);
+  failures += check(stats_keys_save(keys, path, 1) == 0, "save");
+  failures += check(stats_keys_load(loaded, path) == 0, "load");
+  failures += check(loaded->total == keys->total &&
+                        memcmp(loaded->presses, keys->presses, sizeof(keys->presses)) == 0 &&
+                        memcmp(loaded->bigrams, keys->bigrams, sizeof(keys->bigrams)) == 0,
+                    "round trip");
+
+  /* Bigram counters saturate instead of wrapping. */
+  static const uint8_t pair[] = {0x02, 0x82, 0x03, 0x83};
+  stats_keys_init(loaded);
+  loaded->bigrams[0x02][0x03] = UINT32_MAX;
+  stats_keys_feed(loaded, pair, sizeof(pair));
+  failures += check(loaded->bigrams[0x02][0x03] == UINT32_MAX, "bigram saturates");
+
+  FILE *fp = fopen(path, "wb");
+  if (fp) {
+    fputs("not a key file", fp);
+    fclose(fp);
+  }
+  failures += check(stats_keys_load(loaded, path) != 0, "foreign file rejected");
+  unlink(path);
+  failures += check(stats_keys_load(loaded, path) == 0 && loaded->total == 0, "missing file");
+
+  free(keys);
+  free(loaded);
+  return failures == 0 ? 0 : 1;
+}
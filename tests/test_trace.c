@@ -0,0 +1,87 @@
+#include "kbd_trace.h"
+#include "kbd_sim_uapi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int write_records(const char *path) {
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    return 1;
+  }
+  /* The third record steps back in time, as merged per-CPU streams can. */
+  const uint64_t stamps[] = {5000, 6000, 5900, 9000};
+  for (size_t i = 0; i < 4; ++i) {
+    struct kbd_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.timestamp_ns = stamps[i];
+    ev.seq = (uint32_t)i;
+    ev.scancode = (uint8_t)(0x10 + i);
+    fwrite(&ev, sizeof(ev), 1, fp);
+  }
+  fclose(fp);
+  return 0;
+}
+
+int main(void) {
+  int failures = 0;
+  kbd_trace_t trace;
+
+  if (kbd_trace_generate(&trace, KBD_TRACE_RANDOM, 100, 7) != 0 || trace.count != 100) {
+    fprintf(stderr, "generate failed\n");
+    return 1;
+  }
+  for (size_t i = 0; i + 1 < trace.count; i += 2) {
+    if ((trace.codes[i] & 0x80) != 0 || trace.codes[i + 1] != (trace.codes[i] | 0x80)) {
+      fprintf(stderr, "event %zu is not a make/break pair\n", i);
+      failures++;
+      break;
+    }
+  }
+  if (kbd_trace_due_ns(&trace, 50, 1000.0, 1.0) != 50000000ull) {
+    fprintf(stderr, "rate pacing mismatch\n");
+    failures++;
+  }
+  if (kbd_trace_due_ns(&trace, 50, 0.0, 1.0) != 0) {
+    fprintf(stderr, "untimed trace should replay immediately\n");
+    failures++;
+  }
+  kbd_trace_free(&trace);
+
+  char tmpl[] = "/tmp/kbdtraceXXXXXX";
+  int fd = mkstemp(tmpl);
+  if (fd < 0) {
+    return 1;
+  }
+  close(fd);
+  if (write_records(tmpl) != 0 || kbd_trace_load_records(&trace, tmpl) != 0) {
+    unlink(tmpl);
+    return 1;
+  }
+  if (trace.count != 4 || trace.codes[3] != 0x13) {
+    fprintf(stderr, "expected 4 records\n");
+    failures++;
+  } else {
+    if (trace.offsets_ns[2] != 1000 || trace.offsets_ns[3] != 4000) {
+      fprintf(stderr, "offsets not monotonic relative times\n");
+      failures++;
+    }
+    if (kbd_trace_due_ns(&trace, 3, 0.0, 2.0) != 2000) {
+      fprintf(stderr, "speed scaling mismatch\n");
+      failures++;
+    }
+  }
+  kbd_trace_free(&trace);
+
+  if (kbd_trace_load_raw(&trace, tmpl) != 0 || trace.count != 4 * sizeof(struct kbd_event) ||
+      trace.offsets_ns != NULL) {
+    fprintf(stderr, "raw load mismatch\n");
+    failures++;
+  }
+  kbd_trace_free(&trace);
+
+  unlink(tmpl);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Reports a failed expectation; returns 1 so callers can sum failures. */
+static inline int check(int cond, const char *what) {
+  if (!cond) {
+    fprintf(stderr, "failed: %s\n", what);
+    return 1;
+  }
+  return 0;
+}
+
+static inline void sleep_ms(long ms) {
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+/* A pipe whose read end is non-blocking, like a capture device. */
+static inline int open_pipe(int fds[2]) {
+  return pipe(fds) == 0 && fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0 ? 0 : -1;
+}
+
+/* Whether the first KiB of `path` contains `needle`. */
+static inline int file_contains(const char *path, const char *needle) {
+  char buf[1024];
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return 0;
+  }
+  size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+  fclose(fp);
+  buf[n] = '\0';
+  return strstr(buf, needle) != NULL;
+}
+
+#endif
@@ -0,0 +1,649 @@
+/*
+ * Benchmarks for the capture path, written as one result per line in JSON
+ * or CSV so runs can be diffed or loaded into a spreadsheet:
+ *
+ *   kbd_bench --format json > before.json
+ *   kbd_bench --suite decode --bytes 4194304 --runs 9 --format csv
+ *   kbd_bench --suite pipeline --source capture.raw
+ *
+ * Suites:
+ *   decode    ns per scancode byte for scancode_process() and
+ *             scancode_process_batch() over typing-like and adversarial
+ *             traces (median of --runs)
+ *   stats     stats_init/stats_save/stats_compact latency percentiles for
+ *             snapshots of 10 to 10000 days
+ *   pipeline  read -> decode -> stats throughput through kbd_reader and the
+ *             stats flusher, fed from a pipe (or --source FILE)
+ *   mux       count-only read -> decode of --sources pipes through kbd_mux,
+ *             with one worker and with one worker per CPU
+ */
+#include "kbd_mux.h"
+#include "kbd_reader.h"
+#include "kbd_record.h"
+#include "kbd_timing.h"
+#include "kbd_trace.h"
+#include "scancode_map.h"
+#include "stats.h"
+#include "stats_flusher.h"
+#include "stats_index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_RESULTS 128
+#define MAX_RUNS 64
+#define MAX_SOURCES 64
+
+typedef struct {
+  const char *format;
+  const char *suite;
+  const char *source;
+  const char *tmpdir;
+  kbd_reader_backend_t backend;
+  size_t bytes;
+  size_t pipeline_bytes;
+  int runs;
+  unsigned int sources;
+} bench_opts_t;
+
+typedef struct {
+  const char *suite;
+  char name[48];
+  const char *metric;
+  double value;
+} bench_result_t;
+
+static bench_result_t g_results[MAX_RESULTS];
+static size_t g_result_count;
+static volatile unsigned long g_sink; /* keeps decode loops from being elided */
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--format json|csv] [--suite decode|stats|pipeline|mux|all]\n"
+          "          [--bytes N] [--runs N] [--pipeline-bytes N] [--source FILE]\n"
+          "          [--tmpdir DIR] [--backend auto|poll|uring] [--sources N]\n",
+          argv0);
+}
+
+static int parse_opts(int argc, char **argv, bench_opts_t *opts) {
+  static const struct option long_opts[] = {
+      {"format", required_argument, NULL, 'f'},
+      {"suite", required_argument, NULL, 's'},
+      {"bytes", required_argument, NULL, 'b'},
+      {"runs", required_argument, NULL, 'r'},
+      {"pipeline-bytes", required_argument, NULL, 'p'},
+      {"source", required_argument, NULL, 'S'},
+      {"tmpdir", required_argument, NULL, 't'},
+      {"backend", required_argument, NULL, 'B'},
+      {"sources", required_argument, NULL, 'n'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+
+  memset(opts, 0, sizeof(*opts));
+  opts->format = "json";
+  opts->suite = "all";
+  opts->tmpdir = "/tmp";
+  opts->bytes = 1u << 20;
+  opts->pipeline_bytes = 8u << 20;
+  opts->runs = 5;
+  opts->sources = 8;
+
+  int ch = 0;
+  while ((ch = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    switch (ch) {
+      case 'f':
+        opts->format = optarg;
+        break;
+      case 's':
+        opts->suite = optarg;
+        break;
+      case 'b':
+        opts->bytes = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        opts->runs = atoi(optarg);
+        break;
+      case 'p':
+        opts->pipeline_bytes = strtoull(optarg, NULL, 10);
+        break;
+      case 'S':
+        opts->source = optarg;
+        break;
+      case 't':
+        opts->tmpdir = optarg;
+        break;
+      case 'B': {
+        int backend = kbd_reader_backend_from_name(optarg);
+        if (backend < 0) {
+          return -1;
+        }
+        opts->backend = (kbd_reader_backend_t)backend;
+        break;
+      }
+      case 'n':
+        opts->sources = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        return -1;
+    }
+  }
+  if (strcmp(opts->format, "json") != 0 && strcmp(opts->format, "csv") != 0) {
+    return -1;
+  }
+  static const char *const suites[] = {"decode", "stats", "pipeline", "mux", "all"};
+  size_t suite = 0;
+  while (suite < sizeof(suites) / sizeof(suites[0]) && strcmp(opts->suite, suites[suite]) != 0) {
+    ++suite;
+  }
+  if (suite == sizeof(suites) / sizeof(suites[0])) {
+    return -1;
+  }
+  if (opts->runs < 1 || opts->runs > MAX_RUNS || opts->bytes == 0 || opts->pipeline_bytes == 0 ||
+      opts->sources == 0 || opts->sources > MAX_SOURCES) {
+    return -1;
+  }
+  return optind == argc ? 0 : -1;
+}
+
+static void add_result(const char *suite, const char *name, const char *metric, double value) {
+  if (g_result_count == MAX_RESULTS) {
+    return;
+  }
+  bench_result_t *result = &g_results[g_result_count++];
+  result->suite = suite;
+  snprintf(result->name, sizeof(result->name), "%s", name);
+  result->metric = metric;
+  result->value = value;
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double median(double *values, int count) {
+  qsort(values, (size_t)count, sizeof(*values), compare_double);
+  return values[count / 2];
+}
+
+static uint32_t xorshift(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/*
+ * Adversarial for the decoder: every key wrapped in shift, arrows and
+ * navigation keys behind 0xE0, Pause sequences and caps/num toggles, so
+ * nearly every byte leaves the plain-run fast path.
+ */
+static void fill_extended(uint8_t *codes, size_t len, uint32_t seed) {
+  static const uint8_t patterns[][6] = {
+      {0x2A, 0x1E, 0x9E, 0xAA, 0, 0}, /* Shift+A */
+      {0xE0, 0x48, 0xE0, 0xC8, 0, 0}, /* Up */
+      {0xE0, 0x53, 0xE0, 0xD3, 0, 0}, /* Delete */
+      {0xE1, 0x1D, 0x45, 0xE1, 0x9D, 0xC5}, /* Pause */
+      {0x3A, 0xBA, 0x45, 0xC5, 0, 0}, /* CapsLock, NumLock */
+      {0xE0, 0x38, 0x10, 0x90, 0xE0, 0xB8}, /* AltGr+Q */
+  };
+  static const size_t lengths[] = {4, 4, 4, 6, 4, 6};
+  size_t i = 0;
+  while (i < len) {
+    size_t pick = xorshift(&seed) % (sizeof(lengths) / sizeof(lengths[0]));
+    for (size_t j = 0; j < lengths[pick] && i < len; ++j) {
+      codes[i++] = patterns[pick][j];
+    }
+  }
+}
+
+static void fill_noise(uint8_t *codes, size_t len, uint32_t seed) {
+  for (size_t i = 0; i < len; ++i) {
+    codes[i] = (uint8_t)xorshift(&seed);
+  }
+}
+
+static uint64_t decode_single(const uint8_t *codes, size_t len) {
+  scancode_state_t state;
+  scancode_state_init(&state);
+  char out[SCANCODE_MAX_OUTPUT];
+  unsigned long counted = 0;
+  uint64_t start = kbd_record_now_ns();
+  for (size_t i = 0; i < len; ++i) {
+    scancode_process(&state, codes[i], out, sizeof(out), &counted);
+  }
+  uint64_t elapsed = kbd_record_now_ns() - start;
+  g_sink += counted;
+  return elapsed;
+}
+
+static uint64_t decode_batch(const uint8_t *codes, size_t len) {
+  scancode_state_t state;
+  scancode_state_init(&state);
+  char out[4096];
+  unsigned long total = 0;
+  uint64_t start = kbd_record_now_ns();
+  while (len > 0) {
+    size_t consumed = 0;
+    unsigned long counted = 0;
+    scancode_process_batch(&state, codes, len, out, sizeof(out), &consumed, &counted);
+    total += counted;
+    codes += consumed;
+    len -= consumed;
+  }
+  uint64_t elapsed = kbd_record_now_ns() - start;
+  g_sink += total;
+  return elapsed;
+}
+
+static int bench_decode(const bench_opts_t *opts) {
+  uint8_t *codes = malloc(opts->bytes);
+  if (!codes) {
+    return -1;
+  }
+  static const char *const traces[] = {"typing", "sequence", "extended", "noise"};
+  for (size_t t = 0; t < sizeof(traces) / sizeof(traces[0]); ++t) {
+    if (t < 2) {
+      kbd_trace_t trace;
+      if (kbd_trace_generate(&trace, t == 0 ? KBD_TRACE_RANDOM : KBD_TRACE_SEQUENCE, opts->bytes, 1) != 0) {
+        free(codes);
+        return -1;
+      }
+      memcpy(codes, trace.codes, opts->bytes);
+      kbd_trace_free(&trace);
+    } else if (t == 2) {
+      fill_extended(codes, opts->bytes, 2);
+    } else {
+      fill_noise(codes, opts->bytes, 3);
+    }
+
+    double single[MAX_RUNS];
+    double batch[MAX_RUNS];
+    for (int run = 0; run < opts->runs; ++run) {
+      single[run] = (double)decode_single(codes, opts->bytes) / (double)opts->bytes;
+      batch[run] = (double)decode_batch(codes, opts->bytes) / (double)opts->bytes;
+    }
+    char name[48];
+    snprintf(name, sizeof(name), "%s/process", traces[t]);
+    add_result("decode", name, "ns_per_byte", median(single, opts->runs));
+    snprintf(name, sizeof(name), "%s/batch", traces[t]);
+    add_result("decode", name, "ns_per_byte", median(batch, opts->runs));
+  }
+  free(codes);
+  return 0;
+}
+
+static void add_percentiles(const char *name, const kbd_hist_t *hist) {
+  add_result("stats", name, "p50_ns", (double)kbd_hist_percentile(hist, 50.0));
+  add_result("stats", name, "p99_ns", (double)kbd_hist_percentile(hist, 99.0));
+  add_result("stats", name, "max_ns", (double)hist->max);
+}
+
+/* A snapshot with `days` consecutive days ending on `today`. */
+static int write_snapshot(const char *path, int32_t today, int days) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    return -1;
+  }
+  fprintf(fp, "total=%lu\njournal=0\n", (unsigned long)days * 1000ul);
+  char day[11];
+  for (int i = 0; i < days; ++i) {
+    stats_day_to_string(today - i, day);
+    fprintf(fp, "%s=1000\n", day);
+  }
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+static void remove_stats_files(const char *path) {
+  static const char *const suffixes[] = {"", ".journal", ".tmp", ".index", ".keys"};
+  char buf[4096];
+  for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); ++i) {
+    snprintf(buf, sizeof(buf), "%s%s", path, suffixes[i]);
+    unlink(buf);
+  }
+}
+
+static int bench_stats(const bench_opts_t *opts) {
+  static const int sizes[] = {10, 100, 1000, 10000};
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/kbd_bench_stats.%ld.txt", opts->tmpdir, (long)getpid());
+  int32_t today = 0;
+  stats_day_from_string("2025-01-01", &today);
+  char day[11];
+  stats_day_to_string(today, day);
+
+  kbd_hist_t *hist = malloc(sizeof(*hist));
+  if (!hist) {
+    return -1;
+  }
+  int rc = 0;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && rc == 0; ++s) {
+    remove_stats_files(path);
+    if (write_snapshot(path, today, sizes[s]) != 0) {
+      rc = -1;
+      break;
+    }
+    char name[48];
+    stats_t stats;
+
+    kbd_hist_init(hist);
+    for (int i = 0; i < 50 && rc == 0; ++i) {
+      uint64_t start = kbd_record_now_ns();
+      rc = stats_init(&stats, path, day);
+      kbd_hist_record(hist, kbd_record_now_ns() - start);
+      if (rc == 0) {
+        stats_free(&stats);
+      }
+    }
+    snprintf(name, sizeof(name), "init/%d_days", sizes[s]);
+    add_percentiles(name, hist);
+
+    if (rc != 0 || stats_init(&stats, path, day) != 0) {
+      rc = -1;
+      break;
+    }
+    /* Below STATS_JOURNAL_COMPACT_RECORDS, so every save is a plain append. */
+    kbd_hist_init(hist);
+    for (int i = 0; i < 1000 && rc == 0; ++i) {
+      stats_record(&stats, 1);
+      uint64_t start = kbd_record_now_ns();
+      rc = stats_save(&stats);
+      kbd_hist_record(hist, kbd_record_now_ns() - start);
+    }
+    snprintf(name, sizeof(name), "save/%d_days", sizes[s]);
+    add_percentiles(name, hist);
+
+    kbd_hist_init(hist);
+    for (int i = 0; i < 10 && rc == 0; ++i) {
+      stats_record(&stats, 1);
+      uint64_t start = kbd_record_now_ns();
+      rc = stats_compact(&stats);
+      kbd_hist_record(hist, kbd_record_now_ns() - start);
+    }
+    snprintf(name, sizeof(name), "compact/%d_days", sizes[s]);
+    add_percentiles(name, hist);
+    stats_free(&stats);
+  }
+  remove_stats_files(path);
+  free(hist);
+  return rc;
+}
+
+typedef struct {
+  int fd;
+  const uint8_t *data;
+  size_t len;
+} pipe_writer_t;
+
+static void *write_pipe(void *arg) {
+  pipe_writer_t *writer = arg;
+  size_t done = 0;
+  while (done < writer->len) {
+    ssize_t n = write(writer->fd, writer->data + done, writer->len - done);
+    if (n > 0) {
+      done += (size_t)n;
+    } else if (n < 0 && errno != EINTR) {
+      break;
+    }
+  }
+  close(writer->fd);
+  return NULL;
+}
+
+static int bench_pipeline(const bench_opts_t *opts) {
+  int fds[2] = {-1, -1};
+  pthread_t thread;
+  pipe_writer_t writer = {-1, NULL, 0};
+  kbd_trace_t trace = {0};
+  size_t bytes = opts->pipeline_bytes;
+
+  if (opts->source) {
+    fds[0] = open(opts->source, O_RDONLY | O_NONBLOCK);
+    off_t size = fds[0] >= 0 ? lseek(fds[0], 0, SEEK_END) : -1;
+    if (fds[0] < 0 || size < 0 || lseek(fds[0], 0, SEEK_SET) != 0) {
+      perror("kbd_bench: source");
+      return -1;
+    }
+    bytes = (size_t)size;
+  } else {
+    if (kbd_trace_generate(&trace, KBD_TRACE_RANDOM, bytes, 4) != 0 || pipe(fds) != 0 ||
+        fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0) {
+      kbd_trace_free(&trace);
+      return -1;
+    }
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/kbd_bench_pipeline.%ld.txt", opts->tmpdir, (long)getpid());
+  remove_stats_files(path);
+  stats_flusher_t flusher;
+  if (stats_flusher_start(&flusher, path, "2025-01-01", NULL) != 0) {
+    close(fds[0]);
+    if (fds[1] >= 0) {
+      close(fds[1]);
+    }
+    kbd_trace_free(&trace);
+    return -1;
+  }
+
+  kbd_reader_config_t config = {0};
+  config.fd = fds[0];
+  config.format = KBD_FORMAT_RAW;
+  config.layout = SCANCODE_LAYOUT_US;
+  config.stats = &flusher;
+  config.backend = opts->backend;
+  kbd_reader_t reader;
+  uint64_t start = kbd_record_now_ns();
+  int rc = kbd_reader_start(&reader, &config);
+  if (rc == 0 && !opts->source) {
+    writer.fd = fds[1];
+    writer.data = trace.codes;
+    writer.len = bytes;
+    fds[1] = -1;
+    rc = pthread_create(&thread, NULL, write_pipe, &writer) == 0 ? 0 : -1;
+  }
+
+  /* Drain like the GUI does, just without the frame pacing. */
+  uint64_t batches = 0;
+  uint64_t counted = 0;
+  kbd_reader_status_t status = {0};
+  kbd_reader_batch_t out[64];
+  while (rc == 0) {
+    kbd_reader_status(&reader, &status);
+    size_t n = 0;
+    while ((n = kbd_reader_drain(&reader, out, 64)) > 0) {
+      for (size_t i = 0; i < n; ++i) {
+        counted += out[i].counted;
+      }
+      batches += n;
+    }
+    if (status.closed) {
+      break;
+    }
+    sched_yield();
+  }
+  uint64_t elapsed = kbd_record_now_ns() - start;
+
+  if (writer.fd >= 0) {
+    pthread_join(thread, NULL);
+  }
+  kbd_reader_stop(&reader);
+  stats_flusher_stop(&flusher);
+  close(fds[0]);
+  if (fds[1] >= 0) {
+    close(fds[1]);
+  }
+  kbd_trace_free(&trace);
+  remove_stats_files(path);
+  if (rc != 0) {
+    return -1;
+  }
+
+  double seconds = (double)elapsed / 1e9;
+  char name[48];
+  snprintf(name, sizeof(name), "%s/%s", opts->source ? "file" : "pipe", kbd_reader_backend_name(status.backend));
+  add_result("pipeline", name, "bytes", (double)bytes);
+  add_result("pipeline", name, "mb_per_s", (double)bytes / seconds / 1e6);
+  add_result("pipeline", name, "chars_per_s", (double)counted / seconds);
+  add_result("pipeline", name, "batches", (double)batches);
+  add_result("pipeline", name, "dropped_batches", (double)status.dropped);
+  return 0;
+}
+
+/*
+ * Splits --pipeline-bytes over --sources pipes, each with its own writer
+ * thread, and times the mux until every source hit EOF.
+ */
+static int mux_run(const kbd_trace_t *trace, size_t per_source, unsigned int sources, unsigned int workers,
+                   double *seconds, unsigned int *workers_used) {
+  int fds[MAX_SOURCES][2];
+  pthread_t threads[MAX_SOURCES];
+  pipe_writer_t writers[MAX_SOURCES];
+  kbd_mux_t mux;
+  if (kbd_mux_start(&mux, sources, workers) != 0) {
+    return -1;
+  }
+  *workers_used = mux.worker_count;
+
+  unsigned int opened = 0;
+  int rc = 0;
+  kbd_reader_config_t config = {0};
+  config.format = KBD_FORMAT_RAW;
+  config.layout = SCANCODE_LAYOUT_US;
+  config.no_queue = 1;
+  for (; opened < sources; ++opened) {
+    if (pipe(fds[opened]) != 0) {
+      rc = -1;
+      break;
+    }
+    config.fd = fds[opened][0];
+    if (fcntl(fds[opened][0], F_SETFL, O_NONBLOCK) != 0 || kbd_mux_attach(&mux, opened, &config) != 0) {
+      close(fds[opened][0]);
+      close(fds[opened][1]);
+      rc = -1;
+      break;
+    }
+  }
+
+  uint64_t start = kbd_record_now_ns();
+  unsigned int started = 0;
+  for (; rc == 0 && started < opened; ++started) {
+    writers[started].fd = fds[started][1];
+    writers[started].data = trace->codes + (size_t)started * per_source;
+    writers[started].len = per_source;
+    if (pthread_create(&threads[started], NULL, write_pipe, &writers[started]) != 0) {
+      rc = -1;
+      break;
+    }
+  }
+  /* Writers close their ends; the rest are closed here so every slot ends. */
+  for (unsigned int i = started; i < opened; ++i) {
+    close(fds[i][1]);
+  }
+  for (unsigned int done = 0; done < opened;) {
+    done = 0;
+    for (unsigned int i = 0; i < opened; ++i) {
+      kbd_reader_status_t status;
+      done += kbd_mux_status(&mux, i, &status) == 0 && status.closed;
+    }
+    if (done < opened) {
+      sched_yield();
+    }
+  }
+  *seconds = (double)(kbd_record_now_ns() - start) / 1e9;
+
+  for (unsigned int i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  kbd_mux_stop(&mux);
+  for (unsigned int i = 0; i < opened; ++i) {
+    close(fds[i][0]);
+  }
+  return rc;
+}
+
+static int bench_mux(const bench_opts_t *opts) {
+  size_t per_source = opts->pipeline_bytes / opts->sources;
+  kbd_trace_t trace = {0};
+  if (per_source == 0 || kbd_trace_generate(&trace, KBD_TRACE_RANDOM, per_source * opts->sources, 4) != 0) {
+    return -1;
+  }
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned int counts[2] = {1, cpus > 1 ? (unsigned int)cpus : 1};
+  int rc = 0;
+  for (size_t i = 0; i < 2 && rc == 0; ++i) {
+    if (i == 1 && counts[1] == counts[0]) {
+      break; /* one CPU: the second run would repeat the first */
+    }
+    double seconds = 0;
+    unsigned int workers = 0;
+    rc = mux_run(&trace, per_source, opts->sources, counts[i], &seconds, &workers);
+    if (rc == 0) {
+      char name[48];
+      snprintf(name, sizeof(name), "%u_sources/%u_workers", opts->sources, workers);
+      add_result("mux", name, "bytes", (double)(per_source * opts->sources));
+      add_result("mux", name, "mb_per_s", (double)(per_source * opts->sources) / seconds / 1e6);
+    }
+  }
+  kbd_trace_free(&trace);
+  return rc;
+}
+
+static void print_results(const char *format) {
+  if (strcmp(format, "csv") == 0) {
+    printf("suite,case,metric,value\n");
+    for (size_t i = 0; i < g_result_count; ++i) {
+      const bench_result_t *r = &g_results[i];
+      printf("%s,%s,%s,%.3f\n", r->suite, r->name, r->metric, r->value);
+    }
+    return;
+  }
+  printf("{\"results\": [\n");
+  for (size_t i = 0; i < g_result_count; ++i) {
+    const bench_result_t *r = &g_results[i];
+    printf("  {\"suite\": \"%s\", \"case\": \"%s\", \"metric\": \"%s\", \"value\": %.3f}%s\n", r->suite,
+           r->name, r->metric, r->value, i + 1 < g_result_count ? "," : "");
+  }
+  printf("]}\n");
+}
+
+int main(int argc, char **argv) {
+  bench_opts_t opts;
+  if (parse_opts(argc, argv, &opts) != 0) {
+    usage(argv[0]);
+    return 2;
+  }
+#ifndef __OPTIMIZE__
+  fprintf(stderr, "kbd_bench: built without optimization; use -DCMAKE_BUILD_TYPE=Release\n");
+#endif
+  int all = strcmp(opts.suite, "all") == 0;
+  int rc = 0;
+  if ((all || strcmp(opts.suite, "decode") == 0) && bench_decode(&opts) != 0) {
+    fprintf(stderr, "kbd_bench: decode suite failed\n");
+    rc = 1;
+  }
+  if ((all || strcmp(opts.suite, "stats") == 0) && bench_stats(&opts) != 0) {
+    fprintf(stderr, "kbd_bench: stats suite failed\n");
+    rc = 1;
+  }
+  if ((all || strcmp(opts.suite, "pipeline") == 0) && bench_pipeline(&opts) != 0) {
+    fprintf(stderr, "kbd_bench: pipeline suite failed\n");
+    rc = 1;
+  }
+  if ((all || strcmp(opts.suite, "mux") == 0) && bench_mux(&opts) != 0) {
+    fprintf(stderr, "kbd_bench: mux suite failed\n");
+    rc = 1;
+  }
+  print_results(opts.format);
+  return rc;
+}
@@ -0,0 +1,292 @@
+/*
+ * Userspace stand-in for /dev/kbd. Replays a scancode trace into a named
+ * pipe (or stdout) at a controlled rate so the lib/ + app/ pipeline can be
+ * driven without the kernel module:
+ *
+ *   kbd_replay --fifo /tmp/kbd --pattern random --count 1000000 --rate 200000 &
+ *   DEVICE_PATH=/tmp/kbd ./build/app/kbd_ui
+ *
+ * The pipe is held open read/write, so readers see the same semantics as
+ * kbd_sim_read: blocking reads wait for data, O_NONBLOCK reads return
+ * EAGAIN, and poll reports readiness. With --emit records the stream is
+ * struct kbd_event records (set KBD_FORMAT=record on the reader, since a
+ * pipe cannot answer KBD_IOC_GET_FORMAT).
+ */
+#include "kbd_record.h"
+#include "kbd_trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_BURST 4096
+
+typedef struct {
+  const char *fifo;
+  const char *trace_path;
+  int trace_records;
+  kbd_trace_pattern_t pattern;
+  size_t count;
+  double rate;
+  double speed;
+  size_t burst;
+  long loops;
+  int emit_records;
+  int nonblock;
+} replay_opts_t;
+
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig) {
+  (void)sig;
+  g_stop = 1;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--fifo PATH] [--trace FILE [--trace-records]]\n"
+          "          [--pattern sequence|random] [--count N] [--rate EVENTS_PER_S]\n"
+          "          [--speed FACTOR] [--burst N] [--loop N] [--emit raw|records]\n"
+          "          [--nonblock]\n"
+          "Writes to stdout when --fifo is not given. --loop 0 repeats forever.\n",
+          argv0);
+}
+
+static int parse_opts(int argc, char **argv, replay_opts_t *opts) {
+  static const struct option long_opts[] = {
+      {"fifo", required_argument, NULL, 'f'},
+      {"trace", required_argument, NULL, 't'},
+      {"trace-records", no_argument, NULL, 'R'},
+      {"pattern", required_argument, NULL, 'p'},
+      {"count", required_argument, NULL, 'c'},
+      {"rate", required_argument, NULL, 'r'},
+      {"speed", required_argument, NULL, 's'},
+      {"burst", required_argument, NULL, 'b'},
+      {"loop", required_argument, NULL, 'l'},
+      {"emit", required_argument, NULL, 'e'},
+      {"nonblock", no_argument, NULL, 'n'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+
+  memset(opts, 0, sizeof(*opts));
+  opts->pattern = KBD_TRACE_SEQUENCE;
+  opts->count = 16;
+  opts->speed = 1.0;
+  opts->burst = 1;
+  opts->loops = 1;
+
+  int ch = 0;
+  while ((ch = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    switch (ch) {
+      case 'f':
+        opts->fifo = optarg;
+        break;
+      case 't':
+        opts->trace_path = optarg;
+        break;
+      case 'R':
+        opts->trace_records = 1;
+        break;
+      case 'p':
+        if (strcmp(optarg, "random") == 0) {
+          opts->pattern = KBD_TRACE_RANDOM;
+        } else if (strcmp(optarg, "sequence") == 0) {
+          opts->pattern = KBD_TRACE_SEQUENCE;
+        } else {
+          return -1;
+        }
+        break;
+      case 'c':
+        opts->count = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        opts->rate = strtod(optarg, NULL);
+        break;
+      case 's':
+        opts->speed = strtod(optarg, NULL);
+        break;
+      case 'b':
+        opts->burst = strtoull(optarg, NULL, 10);
+        break;
+      case 'l':
+        opts->loops = strtol(optarg, NULL, 10);
+        break;
+      case 'e':
+        if (strcmp(optarg, "records") == 0) {
+          opts->emit_records = 1;
+        } else if (strcmp(optarg, "raw") == 0) {
+          opts->emit_records = 0;
+        } else {
+          return -1;
+        }
+        break;
+      case 'n':
+        opts->nonblock = 1;
+        break;
+      default:
+        return -1;
+    }
+  }
+
+  if (opts->burst == 0 || opts->burst > MAX_BURST) {
+    opts->burst = opts->burst == 0 ? 1 : MAX_BURST;
+  }
+  return optind == argc ? 0 : -1;
+}
+
+static int open_output(const replay_opts_t *opts) {
+  if (!opts->fifo) {
+    return STDOUT_FILENO;
+  }
+  if (mkfifo(opts->fifo, 0644) != 0 && errno != EEXIST) {
+    perror("mkfifo");
+    return -1;
+  }
+  /* Holding a read end too means readers never see EOF while we run. */
+  int fd = open(opts->fifo, O_RDWR | (opts->nonblock ? O_NONBLOCK : 0));
+  if (fd < 0) {
+    perror("open");
+  }
+  return fd;
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+  ts.tv_nsec = (long)(deadline_ns % 1000000000ull);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !g_stop) {
+  }
+}
+
+/*
+ * Writes one batch. Records are whole and batches stay under PIPE_BUF per
+ * write, so a reader never sees a torn record. In --nonblock mode a full
+ * pipe drops the batch, like the module's drop-newest policy.
+ */
+static int write_batch(int fd, const unsigned char *buf, size_t len, int nonblock, uint64_t *dropped,
+                       size_t events) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(fd, buf + done, len - done);
+    if (n > 0) {
+      done += (size_t)n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR && !g_stop) {
+      continue;
+    }
+    if (n < 0 && errno == EAGAIN && nonblock && done == 0) {
+      *dropped += events;
+      return 0;
+    }
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  replay_opts_t opts;
+  if (parse_opts(argc, argv, &opts) != 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  kbd_trace_t trace;
+  int rc = 0;
+  if (opts.trace_path) {
+    rc = opts.trace_records ? kbd_trace_load_records(&trace, opts.trace_path)
+                            : kbd_trace_load_raw(&trace, opts.trace_path);
+  } else {
+    rc = kbd_trace_generate(&trace, opts.pattern, opts.count, 1);
+  }
+  if (rc != 0 || trace.count == 0) {
+    fprintf(stderr, "kbd_replay: no trace events\n");
+    kbd_trace_free(&trace);
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  int fd = open_output(&opts);
+  if (fd < 0) {
+    kbd_trace_free(&trace);
+    return 1;
+  }
+
+  size_t unit = opts.emit_records ? sizeof(struct kbd_event) : 1;
+  size_t batch_events = opts.burst;
+  /* Keep each write atomic on a pipe. */
+  if (batch_events * unit > 4096) {
+    batch_events = 4096 / unit;
+  }
+  unsigned char *buf = malloc(batch_events * unit);
+  if (!buf) {
+    kbd_trace_free(&trace);
+    return 1;
+  }
+
+  uint64_t start = kbd_record_now_ns();
+  uint64_t loop_base = 0;
+  uint64_t sent = 0;
+  uint64_t dropped = 0;
+  uint32_t seq = 0;
+  for (long loop = 0; !g_stop && (opts.loops <= 0 || loop < opts.loops); ++loop) {
+    uint64_t loop_end = 0;
+    for (size_t i = 0; i < trace.count && !g_stop;) {
+      size_t n = trace.count - i < batch_events ? trace.count - i : batch_events;
+      uint64_t due = start + loop_base + kbd_trace_due_ns(&trace, opts.rate > 0 ? sent : i,
+                                                          opts.rate, opts.speed);
+      sleep_until(due);
+
+      uint64_t now = kbd_record_now_ns();
+      for (size_t j = 0; j < n; ++j) {
+        if (opts.emit_records) {
+          struct kbd_event ev;
+          memset(&ev, 0, sizeof(ev));
+          ev.timestamp_ns = now;
+          ev.seq = seq++;
+          ev.port = KBD_PORT_INJECT;
+          ev.scancode = trace.codes[i + j];
+          memcpy(buf + j * unit, &ev, sizeof(ev));
+        } else {
+          buf[j] = trace.codes[i + j];
+        }
+      }
+      if (write_batch(fd, buf, n * unit, opts.nonblock, &dropped, n) != 0) {
+        perror("write");
+        g_stop = 1;
+        rc = 1;
+        break;
+      }
+      i += n;
+      sent += n;
+    }
+    if (opts.rate <= 0) {
+      /* Recorded timing: the next loop starts after this one's last event. */
+      loop_end = kbd_trace_due_ns(&trace, trace.count - 1, 0, opts.speed);
+      loop_base += loop_end;
+    }
+  }
+
+  double secs = (double)(kbd_record_now_ns() - start) / 1e9;
+  fprintf(stderr, "kbd_replay: %llu events in %.3f s (%.0f events/s), %llu dropped\n",
+          (unsigned long long)sent, secs, secs > 0 ? (double)sent / secs : 0.0,
+          (unsigned long long)dropped);
+
+  free(buf);
+  if (fd != STDOUT_FILENO) {
+    close(fd);
+  }
+  kbd_trace_free(&trace);
+  return rc;
+}
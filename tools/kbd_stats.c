@@ -0,0 +1,212 @@
+/*
+ * Queries the day index that stats_flusher keeps next to stats.txt:
+ *
+ *   kbd_stats --index ~/.local/share/kbd_ui/stats.txt.index --week 2025-01-09
+ *   kbd_stats --index idx --from 2024-01-01 --to 2024-06-30
+ *   kbd_stats --index idx --import stats.txt
+ *   kbd_stats --keys ~/.local/share/kbd_ui/stats.txt.keys --top 20
+ *
+ * Every query is answered from block prefix sums, so even multi-year
+ * ranges touch only a few dozen slots.
+ */
+#include "stats_index.h"
+#include "stats_keys.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *index_path;
+  const char *import_path;
+  const char *day;
+  const char *from;
+  const char *to;
+  const char *week;
+  const char *month;
+  const char *year;
+  const char *keys_path;
+  size_t top;
+} stats_opts_t;
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s --index PATH [--import STATS_TXT] [--day D] [--from D --to D]\n"
+          "          [--week D] [--month D] [--year D]\n"
+          "       %s --keys PATH [--top N]\n"
+          "Dates are YYYY-MM-DD; --week/--month/--year sum the period containing D.\n"
+          "Key ids are set-1 make codes, with 0x80 set for 0xE0-prefixed keys.\n",
+          argv0,
+          argv0);
+}
+
+static int parse_opts(int argc, char **argv, stats_opts_t *opts) {
+  static const struct option long_opts[] = {
+      {"index", required_argument, NULL, 'i'},
+      {"import", required_argument, NULL, 'I'},
+      {"day", required_argument, NULL, 'd'},
+      {"from", required_argument, NULL, 'f'},
+      {"to", required_argument, NULL, 't'},
+      {"week", required_argument, NULL, 'w'},
+      {"month", required_argument, NULL, 'm'},
+      {"year", required_argument, NULL, 'y'},
+      {"keys", required_argument, NULL, 'k'},
+      {"top", required_argument, NULL, 'n'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+
+  memset(opts, 0, sizeof(*opts));
+  opts->top = 10;
+  int ch = 0;
+  while ((ch = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    switch (ch) {
+      case 'i':
+        opts->index_path = optarg;
+        break;
+      case 'I':
+        opts->import_path = optarg;
+        break;
+      case 'd':
+        opts->day = optarg;
+        break;
+      case 'f':
+        opts->from = optarg;
+        break;
+      case 't':
+        opts->to = optarg;
+        break;
+      case 'w':
+        opts->week = optarg;
+        break;
+      case 'm':
+        opts->month = optarg;
+        break;
+      case 'y':
+        opts->year = optarg;
+        break;
+      case 'k':
+        opts->keys_path = optarg;
+        break;
+      case 'n':
+        opts->top = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        return -1;
+    }
+  }
+  if ((!opts->index_path && !opts->keys_path) || optind != argc || (!opts->from != !opts->to) ||
+      opts->top == 0) {
+    return -1;
+  }
+  return 0;
+}
+
+static int parse_day(const char *text, int32_t *day) {
+  if (stats_day_from_string(text, day) != 0) {
+    fprintf(stderr, "kbd_stats: bad date '%s'\n", text);
+    return -1;
+  }
+  return 0;
+}
+
+/* Prints the most pressed keys and most frequent bigrams. */
+static int print_keys(const char *path, size_t top) {
+  stats_keys_t *keys = malloc(sizeof(*keys));
+  stats_bigram_t *bigrams = calloc(top, sizeof(*bigrams));
+  if (!keys || !bigrams || stats_keys_load(keys, path) != 0) {
+    fprintf(stderr, "kbd_stats: cannot load %s\n", path);
+    free(keys);
+    free(bigrams);
+    return 1;
+  }
+
+  printf("presses %llu\n", (unsigned long long)keys->total);
+  /* Selection over 256 keys is cheap enough to repeat per rank. */
+  unsigned char shown[STATS_KEYS_COUNT] = {0};
+  for (size_t rank = 0; rank < top; ++rank) {
+    int best = -1;
+    for (int k = 0; k < STATS_KEYS_COUNT; ++k) {
+      if (!shown[k] && keys->presses[k] > 0 && (best < 0 || keys->presses[k] > keys->presses[best])) {
+        best = k;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    shown[best] = 1;
+    printf("key 0x%02X %llu\n", best, (unsigned long long)keys->presses[best]);
+  }
+
+  size_t n = stats_keys_top_bigrams(keys, bigrams, top);
+  for (size_t i = 0; i < n; ++i) {
+    printf("bigram 0x%02X 0x%02X %u\n", bigrams[i].first, bigrams[i].second, bigrams[i].count);
+  }
+  free(keys);
+  free(bigrams);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  stats_opts_t opts;
+  if (parse_opts(argc, argv, &opts) != 0) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (opts.keys_path && print_keys(opts.keys_path, opts.top) != 0) {
+    return 1;
+  }
+  if (!opts.index_path) {
+    return 0;
+  }
+
+  /* Any date given seeds the base of a new index; imports grow it anyway. */
+  const char *dates[] = {opts.day, opts.from, opts.to, opts.week, opts.month, opts.year};
+  int32_t day = 0;
+  int32_t to = 0;
+  for (size_t i = sizeof(dates) / sizeof(dates[0]); i > 0; --i) {
+    if (dates[i - 1] && parse_day(dates[i - 1], &day) != 0) {
+      return 2;
+    }
+  }
+
+  stats_index_t index;
+  if (stats_index_open(&index, opts.index_path, day) != 0) {
+    perror("kbd_stats: open index");
+    return 1;
+  }
+
+  int rc = 0;
+  if (opts.import_path) {
+    long n = stats_index_import_text(&index, opts.import_path);
+    if (n < 0) {
+      perror("kbd_stats: import");
+      rc = 1;
+    } else {
+      printf("imported %ld\n", n);
+    }
+  }
+  if (rc == 0 && opts.day && parse_day(opts.day, &day) == 0) {
+    printf("day %s %llu\n", opts.day, (unsigned long long)stats_index_get(&index, day));
+  }
+  if (rc == 0 && opts.from && parse_day(opts.from, &day) == 0 && parse_day(opts.to, &to) == 0) {
+    printf("range %s..%s %llu\n", opts.from, opts.to,
+           (unsigned long long)stats_index_range(&index, day, to));
+  }
+  if (rc == 0 && opts.week && parse_day(opts.week, &day) == 0) {
+    printf("week %s %llu\n", opts.week, (unsigned long long)stats_index_week(&index, day));
+  }
+  if (rc == 0 && opts.month && parse_day(opts.month, &day) == 0) {
+    printf("month %s %llu\n", opts.month, (unsigned long long)stats_index_month(&index, day));
+  }
+  if (rc == 0 && opts.year && parse_day(opts.year, &day) == 0) {
+    printf("year %s %llu\n", opts.year, (unsigned long long)stats_index_year(&index, day));
+  }
+
+  if (opts.import_path && stats_index_sync(&index) != 0) {
+    rc = 1;
+  }
+  stats_index_close(&index);
+  return rc;
+}
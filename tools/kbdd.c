@@ -0,0 +1,788 @@
+/*
+ * Headless capture daemon: counts keystrokes from /dev/kbd into the same
+ * stats files as kbd_ui, without Qt or a display, and answers queries on a
+ * Unix socket:
+ *
+ *   kbdd --device /dev/kbd --stats /var/lib/kbdd/stats.txt &
+ *   kbdd --device /dev/kbd0 --device /dev/kbd1 --stats /var/lib/kbdd/stats.txt &
+ *   kbdd --query totals
+ *   kbdd --query status --socket /run/kbdd.sock
+ *
+ * Device reads and decoding run on a kbd_reader thread in count-only mode
+ * (no display queue) and counts are persisted by the stats flusher thread,
+ * so the main thread only serves the socket, rotates the day and reopens
+ * the device when it goes away. It stays in the foreground; run it under a
+ * service manager. Do not point kbd_ui at the same stats file while it runs.
+ *
+ * With several --device options (one per serio port node, say) each device
+ * keeps its own decoder and its own stats files, "<stats>.<device name>",
+ * and all of them are read by a kbd_mux with --workers epoll threads.
+ *
+ * With --aggregate nothing is read or decoded at all: the module counts
+ * key presses itself (load it with aggregate=1) and kbdd diffs a snapshot
+ * of those counters every --interval seconds (default 60), before a day
+ * rollover and before answering "totals" or "flush".
+ *
+ * Commands, one per line: "totals", "status", "flush". Replies are
+ * key=value lines; the connection closes when the client shuts down its
+ * side.
+ */
+#define _GNU_SOURCE /* accept4 */
+#include "kbd_device.h"
+#include "kbd_mux.h"
+#include "kbd_reader.h"
+#include "kbd_record.h"
+#include "kbd_ring.h"
+#include "scancode_map.h"
+#include "stats_flusher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 16
+#define MAX_DEVICES 16
+#define MAX_LINE 128
+#define MAX_REPLY 4096
+#define DEFAULT_INTERVAL_S 60
+
+_Static_assert(KBD_KEY_COUNT == STATS_KEYS_COUNT, "kernel and stats key ids differ");
+
+typedef struct {
+  const char *devices[MAX_DEVICES];
+  size_t device_count;
+  unsigned int workers;
+  const char *stats_path;
+  const char *socket_path;
+  const char *query;
+  int force_records;
+  int use_ring;
+  int aggregate;
+  unsigned int interval_s;
+  scancode_layout_t layout;
+  kbd_reader_backend_t backend;
+} kbdd_opts_t;
+
+typedef struct {
+  int fd;
+  size_t len;
+  char line[MAX_LINE];
+} client_t;
+
+typedef struct {
+  const char *path;
+  const char *name; /* basename of `path` */
+  char stats_path[4096];
+  stats_flusher_t stats;
+  char day[11]; /* the flusher's current day */
+  int fd;
+  unsigned int format;
+  kbd_ring_t ring;
+  kbd_reader_t reader; /* single device only; otherwise a mux slot */
+  int reader_running;
+  int aggregating;             /* --aggregate: polled, no reader */
+  struct kbd_key_counts counts; /* last snapshot */
+  uint64_t polls;
+  uint64_t opens;
+} kbdd_device_t;
+
+typedef struct {
+  const kbdd_opts_t *opts;
+  char day[11];
+  uint64_t next_poll_ns;
+  kbd_mux_t mux; /* running with more than one device */
+  size_t device_count;
+  kbdd_device_t devices[MAX_DEVICES];
+  client_t clients[MAX_CLIENTS];
+} kbdd_t;
+
+static volatile sig_atomic_t g_stop;
+
+static void on_signal(int sig) {
+  (void)sig;
+  g_stop = 1;
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--device PATH]... [--stats PATH] [--socket PATH] [--format record]\n"
+          "          [--layout us|uk|de|dvorak] [--mmap] [--backend auto|poll|uring]\n"
+          "          [--workers N] [--aggregate [--interval SECONDS]]\n"
+          "       %s --query totals|status|flush [--socket PATH]\n"
+          "The socket defaults to $XDG_RUNTIME_DIR/kbdd.sock (or /tmp/kbdd.sock) and\n"
+          "the stats to ~/.local/share/kbdd/stats.txt. With several devices, each\n"
+          "counts into <stats>.<device name> and --backend does not apply.\n"
+          "--aggregate reads the module's own key counters (aggregate=1) instead\n"
+          "of the event stream; it takes a single device.\n",
+          argv0,
+          argv0);
+}
+
+static int parse_opts(int argc, char **argv, kbdd_opts_t *opts) {
+  static const struct option long_opts[] = {
+      {"device", required_argument, NULL, 'd'},
+      {"stats", required_argument, NULL, 's'},
+      {"socket", required_argument, NULL, 'S'},
+      {"format", required_argument, NULL, 'f'},
+      {"layout", required_argument, NULL, 'l'},
+      {"mmap", no_argument, NULL, 'm'},
+      {"backend", required_argument, NULL, 'b'},
+      {"workers", required_argument, NULL, 'w'},
+      {"aggregate", no_argument, NULL, 'a'},
+      {"interval", required_argument, NULL, 'i'},
+      {"query", required_argument, NULL, 'q'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+
+  memset(opts, 0, sizeof(*opts));
+  opts->layout = SCANCODE_LAYOUT_US;
+  opts->interval_s = DEFAULT_INTERVAL_S;
+  int ch = 0;
+  while ((ch = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+    switch (ch) {
+      case 'd':
+        if (opts->device_count == MAX_DEVICES) {
+          return -1;
+        }
+        opts->devices[opts->device_count++] = optarg;
+        break;
+      case 's':
+        opts->stats_path = optarg;
+        break;
+      case 'S':
+        opts->socket_path = optarg;
+        break;
+      case 'f':
+        if (strcmp(optarg, "record") == 0) {
+          opts->force_records = 1;
+        } else if (strcmp(optarg, "auto") != 0) {
+          return -1;
+        }
+        break;
+      case 'l': {
+        int layout = scancode_layout_from_name(optarg);
+        if (layout < 0) {
+          return -1;
+        }
+        opts->layout = (scancode_layout_t)layout;
+        break;
+      }
+      case 'm':
+        opts->use_ring = 1;
+        break;
+      case 'b': {
+        int backend = kbd_reader_backend_from_name(optarg);
+        if (backend < 0) {
+          return -1;
+        }
+        opts->backend = (kbd_reader_backend_t)backend;
+        break;
+      }
+      case 'w': {
+        char *end = NULL;
+        unsigned long workers = strtoul(optarg, &end, 10);
+        if (!*optarg || *end || workers > KBD_MUX_MAX_WORKERS) {
+          return -1;
+        }
+        opts->workers = (unsigned int)workers;
+        break;
+      }
+      case 'a':
+        opts->aggregate = 1;
+        break;
+      case 'i': {
+        char *end = NULL;
+        unsigned long interval = strtoul(optarg, &end, 10);
+        if (!*optarg || *end || interval == 0 || interval > 86400) {
+          return -1;
+        }
+        opts->interval_s = (unsigned int)interval;
+        break;
+      }
+      case 'q':
+        opts->query = optarg;
+        break;
+      default:
+        return -1;
+    }
+  }
+  if (opts->device_count == 0) {
+    opts->devices[opts->device_count++] = "/dev/kbd";
+  }
+  /* The counters are module-wide, so a second device would count twice. */
+  if (opts->aggregate && (opts->device_count > 1 || opts->use_ring)) {
+    return -1;
+  }
+  return optind == argc ? 0 : -1;
+}
+
+/* mkdir -p: creates `path` and any missing parents. */
+static int make_dirs(char *path, mode_t mode) {
+  for (char *p = path + 1; *p; ++p) {
+    if (*p != '/') {
+      continue;
+    }
+    *p = '\0';
+    int rc = mkdir(path, mode);
+    *p = '/';
+    if (rc != 0 && errno != EEXIST) {
+      return -1;
+    }
+  }
+  return mkdir(path, mode) != 0 && errno != EEXIST ? -1 : 0;
+}
+
+/* Fills in the default socket and stats paths; the latter may need a mkdir. */
+static int default_paths(kbdd_opts_t *opts, char *socket_buf, char *stats_buf, size_t size) {
+  if (!opts->socket_path) {
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    snprintf(socket_buf, size, "%s/kbdd.sock", runtime && *runtime ? runtime : "/tmp");
+    opts->socket_path = socket_buf;
+  }
+  if (!opts->stats_path && !opts->query) {
+    const char *home = getenv("HOME");
+    if (!home || !*home) {
+      fprintf(stderr, "kbdd: HOME is not set; pass --stats\n");
+      return -1;
+    }
+    snprintf(stats_buf, size, "%s/.local/share/kbdd", home);
+    if (make_dirs(stats_buf, 0700) != 0) {
+      perror("kbdd: mkdir");
+      return -1;
+    }
+    strncat(stats_buf, "/stats.txt", size - strlen(stats_buf) - 1);
+    opts->stats_path = stats_buf;
+  }
+  return 0;
+}
+
+static int socket_address(const char *path, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    fprintf(stderr, "kbdd: socket path too long: %s\n", path);
+    return -1;
+  }
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+static int run_query(const kbdd_opts_t *opts) {
+  struct sockaddr_un addr;
+  if (socket_address(opts->socket_path, &addr) != 0) {
+    return 1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "kbdd: cannot connect to %s: %s\n", opts->socket_path, strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+  char line[MAX_LINE];
+  int len = snprintf(line, sizeof(line), "%s\n", opts->query);
+  if (len < 0 || (size_t)len >= sizeof(line) || write(fd, line, (size_t)len) != len) {
+    close(fd);
+    return 1;
+  }
+  shutdown(fd, SHUT_WR);
+  char buf[1024];
+  ssize_t n = 0;
+  int failed = 0;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    fwrite(buf, 1, (size_t)n, stdout);
+    failed |= strncmp(buf, "error", 5) == 0;
+  }
+  close(fd);
+  return n < 0 || failed ? 1 : 0;
+}
+
+static void local_day(char out[11]) {
+  time_t now = time(NULL);
+  struct tm tm;
+  localtime_r(&now, &tm);
+  strftime(out, 11, "%Y-%m-%d", &tm);
+}
+
+static int use_mux(const kbdd_t *d) {
+  return d->mux.running;
+}
+
+static void close_device(kbdd_t *d, kbdd_device_t *dev) {
+  /* A closed mux slot is already detached; attaching again frees it. */
+  if (dev->reader_running && !use_mux(d)) {
+    kbd_reader_stop(&dev->reader);
+  }
+  dev->reader_running = 0;
+  dev->aggregating = 0;
+  kbd_ring_unmap(&dev->ring);
+  if (dev->fd >= 0) {
+    close(dev->fd);
+    dev->fd = -1;
+  }
+}
+
+/*
+ * Counting starts at the open: presses from before belong to whoever was
+ * running then.
+ */
+static void open_aggregate(kbdd_device_t *dev) {
+  dev->fd = open(dev->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (dev->fd < 0) {
+    return;
+  }
+  if (kbd_device_key_counts(dev->fd, &dev->counts) != 0) {
+    fprintf(stderr, "kbdd: %s has no key counters: %s\n", dev->path, strerror(errno));
+    close(dev->fd);
+    dev->fd = -1;
+    return;
+  }
+  if (!dev->counts.enabled) {
+    fprintf(stderr, "kbdd: aggregation is off; load kbd_sim with aggregate=1\n");
+  }
+  dev->aggregating = 1;
+  dev->opens++;
+}
+
+/* Folds the presses since the last snapshot into the stats. */
+static void poll_counts(kbdd_t *d, kbdd_device_t *dev) {
+  if (!dev->aggregating) {
+    return;
+  }
+  struct kbd_key_counts cur;
+  if (kbd_device_key_counts(dev->fd, &cur) != 0) {
+    close_device(d, dev);
+    return;
+  }
+  uint64_t presses[KBD_KEY_COUNT];
+  unsigned long counted = kbd_device_key_delta(&dev->counts, &cur, d->opts->layout, presses);
+  stats_flusher_record(&dev->stats, counted);
+  stats_flusher_record_presses(&dev->stats, presses);
+  dev->counts = cur;
+  dev->polls++;
+}
+
+static void poll_all(kbdd_t *d) {
+  for (size_t i = 0; i < d->device_count; ++i) {
+    poll_counts(d, &d->devices[i]);
+  }
+}
+
+/* Same order as kbd_ui: mapped ring when asked for, then plain reads. */
+static void open_device(kbdd_t *d, kbdd_device_t *dev) {
+  if (d->opts->aggregate) {
+    open_aggregate(dev);
+    return;
+  }
+  if (d->opts->use_ring) {
+    dev->fd = open(dev->path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (dev->fd >= 0 && kbd_ring_map_device(&dev->ring, dev->fd) != 0) {
+      close(dev->fd);
+      dev->fd = -1;
+    }
+  }
+  if (dev->fd < 0) {
+    dev->fd = open(dev->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  }
+  if (dev->fd < 0) {
+    return;
+  }
+  dev->format = d->opts->force_records ? KBD_FORMAT_RECORD : kbd_record_device_format(dev->fd);
+
+  kbd_reader_config_t config = {0};
+  config.fd = dev->fd;
+  config.format = dev->format;
+  config.ring = dev->ring.hdr ? &dev->ring : NULL;
+  config.layout = d->opts->layout;
+  config.stats = &dev->stats;
+  config.no_queue = 1;
+  config.backend = d->opts->backend;
+  int rc = use_mux(d) ? kbd_mux_attach(&d->mux, (size_t)(dev - d->devices), &config)
+                      : kbd_reader_start(&dev->reader, &config);
+  if (rc != 0) {
+    close_device(d, dev);
+    return;
+  }
+  dev->reader_running = 1;
+  dev->opens++;
+}
+
+static void device_status(kbdd_t *d, kbdd_device_t *dev, kbd_reader_status_t *status) {
+  memset(status, 0, sizeof(*status));
+  if (!dev->reader_running) {
+    return;
+  }
+  if (use_mux(d)) {
+    kbd_mux_status(&d->mux, (size_t)(dev - d->devices), status);
+  } else {
+    kbd_reader_status(&dev->reader, status);
+  }
+}
+
+/* Runs once a second: day rollover and device (re)open. */
+static void tick(kbdd_t *d) {
+  char today[11];
+  local_day(today);
+  uint64_t now = kbd_record_now_ns();
+  /* Counts up to the rollover still belong to the old day. */
+  if (now >= d->next_poll_ns || strcmp(today, d->day) != 0) {
+    poll_all(d);
+    d->next_poll_ns = now + (uint64_t)d->opts->interval_s * 1000000000ull;
+  }
+  memcpy(d->day, today, sizeof(d->day));
+  for (size_t i = 0; i < d->device_count; ++i) {
+    kbdd_device_t *dev = &d->devices[i];
+    /* A failed switch keeps the old day and is retried next tick. */
+    if (strcmp(today, dev->day) != 0 && stats_flusher_set_day(&dev->stats, today) == 0) {
+      memcpy(dev->day, today, sizeof(dev->day));
+    }
+    kbd_reader_status_t status;
+    device_status(d, dev, &status);
+    if (status.closed) {
+      close_device(d, dev);
+    }
+    if (dev->fd < 0) {
+      open_device(d, dev);
+    }
+  }
+}
+
+static void reply(int fd, const char *text, size_t len) {
+  while (len > 0) {
+    ssize_t n = send(fd, text, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return; /* a client that does not read loses the rest */
+    }
+    text += n;
+    len -= (size_t)n;
+  }
+}
+
+/* Appends to `out`, keeping `*len` within `size`. */
+static void append(char *out, size_t size, int *len, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+
+static void append(char *out, size_t size, int *len, const char *fmt, ...) {
+  if (*len < 0 || (size_t)*len >= size) {
+    return;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(out + *len, size - (size_t)*len, fmt, ap);
+  va_end(ap);
+  *len = n < 0 ? -1 : *len + n;
+}
+
+static void device_status_lines(kbdd_t *d, kbdd_device_t *dev, char *out, size_t size, int *len) {
+  kbd_reader_status_t status;
+  device_status(d, dev, &status);
+  if (dev->aggregating) {
+    append(out, size, len, "device=%s\nopen=1\nbackend=aggregate\nenabled=%u\nopens=%llu\npolls=%llu\npresses=%llu\n",
+           dev->path, dev->counts.enabled, (unsigned long long)dev->opens, (unsigned long long)dev->polls,
+           (unsigned long long)dev->counts.total);
+    return;
+  }
+  append(out, size, len,
+         "device=%s\nopen=%d\nformat=%s\nmmap=%d\nbackend=%s\nopens=%llu\nevents=%llu\nlost=%llu\n",
+         dev->path, dev->reader_running, dev->format == KBD_FORMAT_RECORD ? "record" : "raw",
+         dev->ring.hdr != NULL, dev->reader_running ? kbd_reader_backend_name(status.backend) : "none",
+         (unsigned long long)dev->opens, (unsigned long long)status.events, (unsigned long long)status.lost);
+  struct kbd_fifo_info info;
+  if (dev->fd >= 0 && kbd_device_fifo_info(dev->fd, &info) == 0) {
+    append(out, size, len, "kernel_dropped=%llu\n", (unsigned long long)info.dropped);
+  }
+}
+
+/*
+ * Totals are summed over the devices; with more than one, each device's
+ * own follow as "<name>.total" and "<name>.today". Status repeats its
+ * block per device, each starting with "device=".
+ */
+static void handle_command(kbdd_t *d, int fd, const char *cmd) {
+  char out[MAX_REPLY];
+  int len = 0;
+  if (strcmp(cmd, "totals") == 0 || strcmp(cmd, "flush") == 0) {
+    poll_all(d);
+  }
+  if (strcmp(cmd, "totals") == 0) {
+    unsigned long total = 0;
+    unsigned long day_count = 0;
+    for (size_t i = 0; i < d->device_count; ++i) {
+      unsigned long dev_total = 0;
+      unsigned long dev_day = 0;
+      stats_flusher_counts(&d->devices[i].stats, &dev_total, &dev_day);
+      total += dev_total;
+      day_count += dev_day;
+    }
+    append(out, sizeof(out), &len, "total=%lu\nday=%s\ntoday=%lu\n", total, d->day, day_count);
+    for (size_t i = 0; d->device_count > 1 && i < d->device_count; ++i) {
+      unsigned long dev_total = 0;
+      unsigned long dev_day = 0;
+      stats_flusher_counts(&d->devices[i].stats, &dev_total, &dev_day);
+      append(out, sizeof(out), &len, "%s.total=%lu\n%s.today=%lu\n", d->devices[i].name, dev_total,
+             d->devices[i].name, dev_day);
+    }
+  } else if (strcmp(cmd, "status") == 0) {
+    for (size_t i = 0; i < d->device_count; ++i) {
+      device_status_lines(d, &d->devices[i], out, sizeof(out), &len);
+    }
+  } else if (strcmp(cmd, "flush") == 0) {
+    int failed = 0;
+    for (size_t i = 0; i < d->device_count; ++i) {
+      failed |= stats_flusher_flush(&d->devices[i].stats) != 0;
+    }
+    append(out, sizeof(out), &len, "%s\n", failed ? "error flush failed" : "ok");
+  } else if (*cmd) {
+    append(out, sizeof(out), &len, "error unknown command\n");
+  }
+  if (len > 0) {
+    reply(fd, out, (size_t)len < sizeof(out) ? (size_t)len : sizeof(out) - 1);
+  }
+}
+
+/* Returns -1 once the client is done (EOF, error or an overlong line). */
+static int serve_client(kbdd_t *d, client_t *c) {
+  ssize_t n = read(c->fd, c->line + c->len, sizeof(c->line) - 1 - c->len);
+  if (n < 0) {
+    return errno == EAGAIN || errno == EINTR ? 0 : -1;
+  }
+  if (n == 0) {
+    return -1;
+  }
+  c->len += (size_t)n;
+  c->line[c->len] = '\0';
+
+  char *start = c->line;
+  char *nl = NULL;
+  while ((nl = strchr(start, '\n')) != NULL) {
+    *nl = '\0';
+    if (nl > start && nl[-1] == '\r') {
+      nl[-1] = '\0';
+    }
+    handle_command(d, c->fd, start);
+    start = nl + 1;
+  }
+  c->len = strlen(start);
+  memmove(c->line, start, c->len + 1);
+  return c->len < sizeof(c->line) - 1 ? 0 : -1;
+}
+
+static int listen_socket(const char *path) {
+  struct sockaddr_un addr;
+  if (socket_address(path, &addr) != 0) {
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  /*
+   * A live kbdd owns this socket and its stats files, whose journal allows
+   * one writer only. Only a socket nobody answers on is stale and removed.
+   */
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe < 0) {
+    close(fd);
+    return -1;
+  }
+  int err = connect(probe, (const struct sockaddr *)&addr, sizeof(addr)) == 0 ? 0 : errno;
+  close(probe);
+  if (err == 0) {
+    fprintf(stderr, "kbdd: another kbdd is running on %s\n", path);
+    close(fd);
+    return -1;
+  }
+  if (err != ECONNREFUSED && err != ENOENT) {
+    fprintf(stderr, "kbdd: cannot check %s: %s\n", path, strerror(err));
+    close(fd);
+    return -1;
+  }
+  if (err == ECONNREFUSED) {
+    unlink(path);
+  }
+  if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, MAX_CLIENTS) != 0) {
+    fprintf(stderr, "kbdd: cannot listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void accept_clients(kbdd_t *d, int listen_fd) {
+  int fd = -1;
+  while ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+    size_t i = 0;
+    while (i < MAX_CLIENTS && d->clients[i].fd >= 0) {
+      ++i;
+    }
+    if (i == MAX_CLIENTS) {
+      reply(fd, "error busy\n", 11);
+      close(fd);
+      continue;
+    }
+    d->clients[i].fd = fd;
+    d->clients[i].len = 0;
+  }
+}
+
+/* Loads each device's stats; several devices also get the mux. */
+static int start_devices(kbdd_t *d) {
+  const kbdd_opts_t *opts = d->opts;
+  for (size_t i = 0; i < opts->device_count; ++i) {
+    kbdd_device_t *dev = &d->devices[i];
+    dev->path = opts->devices[i];
+    const char *slash = strrchr(dev->path, '/');
+    dev->name = slash ? slash + 1 : dev->path;
+    dev->fd = -1;
+    for (size_t j = 0; j < i; ++j) {
+      if (strcmp(d->devices[j].name, dev->name) == 0) {
+        fprintf(stderr, "kbdd: two devices named %s\n", dev->name);
+        return -1;
+      }
+    }
+    if (opts->device_count == 1) {
+      snprintf(dev->stats_path, sizeof(dev->stats_path), "%s", opts->stats_path);
+    } else {
+      snprintf(dev->stats_path, sizeof(dev->stats_path), "%s.%s", opts->stats_path, dev->name);
+    }
+    if (stats_flusher_start(&dev->stats, dev->stats_path, d->day, NULL) != 0) {
+      fprintf(stderr, "kbdd: cannot load stats from %s\n", dev->stats_path);
+      return -1;
+    }
+    memcpy(dev->day, d->day, sizeof(dev->day));
+    d->device_count++;
+  }
+  if (d->device_count > 1 && kbd_mux_start(&d->mux, d->device_count, opts->workers) != 0) {
+    fprintf(stderr, "kbdd: cannot start the device workers\n");
+    return -1;
+  }
+  return 0;
+}
+
+/* Readers record into the flushers, so they stop first. */
+static int stop_devices(kbdd_t *d) {
+  int rc = 0;
+  kbd_mux_stop(&d->mux);
+  for (size_t i = 0; i < d->device_count; ++i) {
+    close_device(d, &d->devices[i]);
+    rc |= stats_flusher_stop(&d->devices[i].stats);
+  }
+  d->device_count = 0;
+  return rc;
+}
+
+static int run_daemon(const kbdd_opts_t *opts) {
+  kbdd_t *d = calloc(1, sizeof(*d));
+  if (!d) {
+    return 1;
+  }
+  d->opts = opts;
+  for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+    d->clients[i].fd = -1;
+  }
+  local_day(d->day);
+  /* The socket is claimed first: it is what keeps a second kbdd off the stats. */
+  int listen_fd = listen_socket(opts->socket_path);
+  if (listen_fd < 0) {
+    free(d);
+    return 1;
+  }
+  if (start_devices(d) != 0) {
+    stop_devices(d);
+    close(listen_fd);
+    unlink(opts->socket_path);
+    free(d);
+    return 1;
+  }
+
+  /* No SA_RESTART: a signal has to interrupt poll() to be noticed. */
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  tick(d);
+  uint64_t next_tick = kbd_record_now_ns() + 1000000000ull;
+  while (!g_stop) {
+    struct pollfd fds[1 + MAX_CLIENTS];
+    size_t owners[1 + MAX_CLIENTS];
+    nfds_t count = 0;
+    fds[count].fd = listen_fd;
+    fds[count].events = POLLIN;
+    count++;
+    for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+      if (d->clients[i].fd >= 0) {
+        fds[count].fd = d->clients[i].fd;
+        fds[count].events = POLLIN;
+        owners[count] = i;
+        count++;
+      }
+    }
+
+    uint64_t now = kbd_record_now_ns();
+    int timeout = now >= next_tick ? 0 : (int)((next_tick - now) / 1000000ull) + 1;
+    int ready = poll(fds, count, timeout);
+    if (ready < 0 && errno != EINTR) {
+      perror("kbdd: poll");
+      break;
+    }
+    if (ready > 0) {
+      if (fds[0].revents & POLLIN) {
+        accept_clients(d, listen_fd);
+      }
+      for (nfds_t i = 1; i < count; ++i) {
+        client_t *c = &d->clients[owners[i]];
+        if (fds[i].revents && serve_client(d, c) != 0) {
+          close(c->fd);
+          c->fd = -1;
+        }
+      }
+    }
+    if (kbd_record_now_ns() >= next_tick) {
+      tick(d);
+      next_tick = kbd_record_now_ns() + 1000000000ull;
+    }
+  }
+
+  for (size_t i = 0; i < MAX_CLIENTS; ++i) {
+    if (d->clients[i].fd >= 0) {
+      close(d->clients[i].fd);
+    }
+  }
+  close(listen_fd);
+  unlink(opts->socket_path);
+  poll_all(d);
+  int rc = stop_devices(d) == 0 ? 0 : 1;
+  free(d);
+  return rc;
+}
+
+int main(int argc, char **argv) {
+  kbdd_opts_t opts;
+  char socket_buf[4096];
+  char stats_buf[4096];
+  if (parse_opts(argc, argv, &opts) != 0) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (default_paths(&opts, socket_buf, stats_buf, sizeof(stats_buf)) != 0) {
+    return 1;
+  }
+  return opts.query ? run_query(&opts) : run_daemon(&opts);
+}